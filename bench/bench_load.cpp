@@ -0,0 +1,107 @@
+/**
+ * @file bench_load.cpp
+ * @brief Benchmark for the parallel Buffer::Load pipeline across thread
+ * counts.
+ * @author rahuldangeofficial
+ *
+ * Usage: bench_load [size_mb] [max_threads]
+ *
+ * Generates a synthetic corpus (mixed line lengths, some UTF-8, CRLF-free),
+ * then loads it with 1, 2, 4, ... threads and reports the best of three
+ * runs for each count. The file is warmed into the page cache first so the
+ * numbers reflect the pipeline rather than the disk.
+ */
+
+#include "../include/buffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+std::string MakeCorpus(const std::string &path, size_t bytes) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    perror("fopen");
+    exit(1);
+  }
+
+  static const char *words[] = {"alpha", "beta",  "gamma", "δέλτα",
+                                "\tindent", "{", "}", "naïve", "0x7f3a"};
+  const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+  unsigned seed = 12345;
+  size_t written = 0;
+  std::string line;
+  while (written < bytes) {
+    line.clear();
+    seed = seed * 1103515245u + 12345u;
+    size_t n = (seed >> 16) % 24;
+    for (size_t i = 0; i < n; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      line += words[(seed >> 16) % wordCount];
+      line += ' ';
+    }
+    line += '\n';
+    fwrite(line.data(), 1, line.size(), f);
+    written += line.size();
+  }
+  fclose(f);
+  return path;
+}
+
+double LoadSeconds(const std::string &path, unsigned threads, int &lines) {
+  Buffer buffer;
+  auto start = std::chrono::steady_clock::now();
+  buffer.Load(path, threads);
+  auto end = std::chrono::steady_clock::now();
+  lines = buffer.LineCount();
+  return std::chrono::duration<double>(end - start).count();
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  setlocale(LC_ALL, "");
+  setenv("EDIT_NO_INDEX_CACHE", "1", 1); // Measure the full pipeline
+
+  size_t sizeMB = argc > 1 ? (size_t)atol(argv[1]) : 256;
+  unsigned maxThreads = argc > 2 ? (unsigned)atoi(argv[2])
+                                 : std::thread::hardware_concurrency();
+  if (maxThreads == 0)
+    maxThreads = 1;
+
+  const char *tmp = getenv("TMPDIR");
+  std::string path = std::string(tmp ? tmp : "/tmp") + "/edit_bench_load_" +
+                     std::to_string(getpid()) + ".txt";
+  MakeCorpus(path, sizeMB * 1024 * 1024);
+
+  int lines = 0;
+  LoadSeconds(path, 1, lines); // Warm the page cache
+
+  printf("corpus: %zu MB, %d lines\n", sizeMB, lines);
+  printf("%8s %10s %10s %8s\n", "threads", "seconds", "MB/s", "speedup");
+
+  double baseline = 0;
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < maxThreads; t *= 2)
+    counts.push_back(t);
+  counts.push_back(maxThreads);
+
+  for (unsigned threads : counts) {
+    double best = 1e30;
+    for (int run = 0; run < 3; ++run) {
+      best = std::min(best, LoadSeconds(path, threads, lines));
+    }
+    if (threads == 1)
+      baseline = best;
+    printf("%8u %10.3f %10.1f %7.2fx\n", threads, best, (double)sizeMB / best,
+           baseline / best);
+  }
+
+  unlink(path.c_str());
+  return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file bench_paths.cpp
+ * @brief Headless benchmark of the editor's hot paths; also the training
+ * workload for the profile-guided release build.
+ * @author rahuldangeofficial
+ *
+ * Usage: bench_paths [size_mb] [rounds]
+ *
+ * Generates a synthetic corpus, then times loading it, rendering frames
+ * while scrolling through it, typing into it, searching it and saving it,
+ * and reports the best of the rounds for each. Frames are rendered by the
+ * real Display into /dev/null at a fixed 50x160 size, so no terminal is
+ * needed and every run does the same work.
+ */
+
+#include "../include/buffer.hpp"
+#include "../include/display.hpp"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+namespace {
+const int FRAMES = 2000;
+const int KEYSTROKES = 50000;
+const int UNDOS = 1000;
+
+std::string MakeCorpus(const std::string &path, size_t bytes) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    perror("fopen");
+    exit(1);
+  }
+
+  static const char *words[] = {"alpha", "beta",  "gamma", "δέλτα",
+                                "\tindent", "{", "}", "naïve", "0x7f3a"};
+  const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+  unsigned seed = 12345;
+  size_t written = 0;
+  std::string line;
+  while (written < bytes) {
+    line.clear();
+    seed = seed * 1103515245u + 12345u;
+    size_t n = (seed >> 16) % 24;
+    for (size_t i = 0; i < n; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      line += words[(seed >> 16) % wordCount];
+      line += ' ';
+    }
+    line += '\n';
+    fwrite(line.data(), 1, line.size(), f);
+    written += line.size();
+  }
+  fclose(f);
+  return path;
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+double Load(const std::string &path) {
+  Buffer buffer;
+  auto start = std::chrono::steady_clock::now();
+  buffer.Load(path);
+  return Since(start);
+}
+
+double Render(Display &display, const Buffer &buffer) {
+  int lines = buffer.LineCount();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < FRAMES; ++i) {
+    // Page through the file, with a horizontal scroll now and then
+    int y = (int)((long long)i * 48 % lines);
+    int x = i % 10 == 9 ? (int)buffer.GetLine(y).size() : 0;
+    display.Scroll(buffer, y, x);
+    display.Render(buffer, y, x);
+  }
+  return Since(start);
+}
+
+double Type(Buffer &buffer) {
+  static const char text[] = "the quick brown fox ";
+  unsigned seed = 777;
+  int y = 0, x = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < KEYSTROKES; ++i) {
+    if (i % 64 == 0) { // Jump somewhere else in the file
+      seed = seed * 1103515245u + 12345u;
+      y = (int)((seed >> 8) % (unsigned)buffer.LineCount());
+      x = (int)buffer.GetLine(y).size() / 2;
+    }
+    buffer.BeginUndoGroup();
+    if (i % 41 == 40) {
+      buffer.InsertNewLine(y, x);
+      y++;
+      x = 0;
+    } else if (i % 9 == 8 && x > 0) {
+      buffer.DeleteChar(y, --x);
+    } else {
+      buffer.InsertChar(y, x++, text[i % (sizeof(text) - 1)]);
+    }
+    buffer.EndUndoGroup();
+  }
+  Buffer::Position cursor;
+  for (int i = 0; i < UNDOS; ++i)
+    buffer.Undo(cursor);
+  return Since(start);
+}
+
+double Search(const Buffer &buffer, size_t &hits) {
+  const std::string_view needle = "gamma";
+  hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int y = 0; y < buffer.LineCount(); ++y) {
+    std::string_view line = buffer.GetLine(y);
+    for (size_t at = line.find(needle); at != std::string_view::npos;
+         at = line.find(needle, at + needle.size()))
+      hits++;
+  }
+  return Since(start);
+}
+
+double Save(Buffer &buffer, const std::string &path) {
+  auto start = std::chrono::steady_clock::now();
+  buffer.SaveCopy(path);
+  return Since(start);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  setlocale(LC_ALL, "");
+  setenv("EDIT_NO_INDEX_CACHE", "1", 1); // Measure the full pipeline
+
+  size_t sizeMB = argc > 1 ? (size_t)atol(argv[1]) : 64;
+  int rounds = argc > 2 ? std::max(1, atoi(argv[2])) : 3;
+
+  const char *tmp = getenv("TMPDIR");
+  std::string base = std::string(tmp ? tmp : "/tmp") + "/edit_bench_paths_" +
+                     std::to_string(getpid());
+  std::string path = MakeCorpus(base + ".txt", sizeMB * 1024 * 1024);
+  std::string copy = base + ".out";
+
+  // The renderer draws into /dev/null at a fixed size
+  fflush(stdout);
+  int out = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  setenv("TERM", "xterm", 1);
+  setenv("LINES", "50", 1);
+  setenv("COLUMNS", "160", 1);
+
+  const char *names[] = {"load", "render", "edit", "search", "save"};
+  double best[5] = {1e30, 1e30, 1e30, 1e30, 1e30};
+  int lines = 0;
+  size_t hits = 0;
+  {
+    Display display;
+    Load(path); // Warm the page cache
+    for (int round = 0; round < rounds; ++round) {
+      Buffer buffer;
+      buffer.Load(path);
+      lines = buffer.LineCount();
+      double seconds[5] = {Load(path), Render(display, buffer), Type(buffer),
+                           Search(buffer, hits), Save(buffer, copy)};
+      for (int i = 0; i < 5; ++i)
+        best[i] = std::min(best[i], seconds[i]);
+    }
+  }
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+
+  printf("corpus: %zu MB, %d lines, %zu hits, best of %d\n", sizeMB, lines,
+         hits, rounds);
+  printf("%-8s %10s\n", "path", "seconds");
+  for (int i = 0; i < 5; ++i)
+    printf("%-8s %10.4f\n", names[i], best[i]);
+
+  unlink(path.c_str());
+  unlink(copy.c_str());
+  return 0;
+}
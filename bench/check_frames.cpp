@@ -0,0 +1,157 @@
+/**
+ * @file check_frames.cpp
+ * @brief Asserts that rendering a steady-state frame allocates nothing.
+ * @author rahuldangeofficial
+ *
+ * Usage: check_frames [frames]
+ *
+ * Loads a generated file with ASCII, UTF-8, tabs, control bytes and a very
+ * long line, decorates the view as the editor does (selection, extra
+ * cursors, change marks, a fold, a status message), and renders frames
+ * through the real Display into /dev/null at 50x160 while scrolling down
+ * and sideways, as text and as a table split at tabs. A first pass warms
+ * the reused buffers; during the second, every C++ heap allocation
+ * (operator new) is counted. Exits 1 if any
+ * happened, so the check can gate a build.
+ */
+
+#include "../include/buffer.hpp"
+#include "../include/display.hpp"
+#include <atomic>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+namespace {
+std::atomic<bool> g_counting(false);
+std::atomic<size_t> g_allocations(0);
+} // namespace
+
+void *operator new(size_t n) {
+  if (g_counting)
+    g_allocations++;
+  if (void *p = malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+void MakeFile(const std::string &path, int lines) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) {
+    perror("fopen");
+    exit(1);
+  }
+  for (int i = 0; i < lines; ++i) {
+    switch (i % 5) {
+    case 0:
+      fprintf(f, "plain ascii line %d with some words\n", i);
+      break;
+    case 1:
+      fprintf(f, "\tindented {\tδέλτα naïve 日本語 %d\n", i);
+      break;
+    case 2:
+      fprintf(f, "control \x01\x7f bytes %d }\n", i);
+      break;
+    case 3:
+      fprintf(f, "\n");
+      break;
+    default:
+      fprintf(f, "emoji 🙂 and more text to fill the row %d\n", i);
+    }
+  }
+  std::string wide(20000, 'w'); // Scrolled sideways below
+  fprintf(f, "%s\n", wide.c_str());
+  fclose(f);
+}
+
+/// Render one pass of frames: page down, with a sideways jump now and then.
+void Pass(Display &display, const Buffer &buffer, int frames) {
+  int lines = buffer.LineCount();
+  for (int i = 0; i < frames; ++i) {
+    int y = i % 7 == 6 ? lines - 1 : (int)((long long)i * 17 % lines);
+    int x = y == lines - 1 ? (i * 131) % (int)buffer.GetLine(y).size() : 0;
+    display.Scroll(buffer, y, x);
+    display.Render(buffer, y, x);
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  setlocale(LC_ALL, "");
+  setenv("EDIT_NO_INDEX_CACHE", "1", 1);
+  int frames = argc > 1 ? atoi(argv[1]) : 2000;
+  if (frames < 1)
+    frames = 1;
+
+  const char *tmp = getenv("TMPDIR");
+  std::string path = std::string(tmp ? tmp : "/tmp") + "/edit_check_frames_" +
+                     std::to_string(getpid()) + ".txt";
+  MakeFile(path, 5000);
+
+  // The renderer draws into /dev/null at a fixed size
+  fflush(stdout);
+  int out = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  setenv("TERM", "xterm", 1);
+  setenv("LINES", "50", 1);
+  setenv("COLUMNS", "160", 1);
+
+  size_t allocations;
+  {
+    Buffer buffer;
+    buffer.Load(path);
+
+    FoldSet folds;
+    folds.Add(11, 14);
+    auto changes = std::make_shared<DiffIndex::Hunks>();
+    changes->push_back({3, 2, 3, 0});
+    changes->push_back({40, 1, 39, 1});
+
+    Display display;
+    display.SetMessage("Checking frame allocations");
+    display.SetMode("FOLLOW");
+    display.SetSelections({{{5, 2}, {9, 4}}});
+    display.SetCursors({{20, 1}, {21, 1}});
+    display.SetBrackets({{1, 10}, {2, 26}});
+    display.SetChanges(changes);
+    display.SetFolds(folds);
+
+    auto widths = std::make_shared<Table::Widths>(Table::Widths{12, 30});
+
+    // Warm the reused buffers in both views, then count
+    Pass(display, buffer, frames);
+    display.SetTable('\t', widths);
+    Pass(display, buffer, frames);
+    display.SetTable(0, nullptr);
+    g_counting = true;
+    Pass(display, buffer, frames);
+    g_counting = false;
+    display.SetTable('\t', widths);
+    g_counting = true;
+    Pass(display, buffer, frames);
+    g_counting = false;
+    allocations = g_allocations;
+  }
+
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+  unlink(path.c_str());
+
+  printf("%d frames, %zu heap allocations\n", frames * 2, allocations);
+  if (allocations != 0) {
+    fprintf(stderr, "check_frames: steady-state frames allocated\n");
+    return 1;
+  }
+  return 0;
+}
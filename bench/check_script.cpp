@@ -0,0 +1,124 @@
+/**
+ * @file check_script.cpp
+ * @brief Asserts that a batch script sorting large files finishes.
+ * @author rahuldangeofficial
+ *
+ * Usage: check_script [files] [lines]
+ *
+ * Writes files of shuffled numbers, each longer than one sort task, and
+ * runs a "sort" script over them with the default thread count, as
+ * `edit --script` does. Script::Run spreads the files over the shared
+ * pool and each sort is itself parallel, so this is the nesting that once
+ * deadlocked the pool. Exits 1 if the run does not finish within a
+ * deadline, fails a file, or leaves a file unsorted.
+ */
+
+#include "../include/buffer.hpp"
+#include "../include/script.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <sys/stat.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/// Script::Run stops early once this is set; main.cpp owns it in the editor.
+volatile sig_atomic_t g_signalStatus = 0;
+
+namespace {
+// A run that takes longer than this is taken to be stuck
+const int DEADLINE_SECONDS = 60;
+
+void WriteFile(const std::string &path, const std::string &text) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f || fwrite(text.data(), 1, text.size(), f) != text.size()) {
+    perror(path.c_str());
+    exit(1);
+  }
+  fclose(f);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int files = argc > 1 ? atoi(argv[1]) : 4;
+  int lines = argc > 2 ? atoi(argv[2]) : 200000;
+  if (files < 1 || lines < 1) {
+    fprintf(stderr, "Usage: check_script [files] [lines]\n");
+    return 1;
+  }
+
+  std::string dir = "/tmp/edit_check_script_" + std::to_string(getpid());
+  if (mkdir(dir.c_str(), 0700) != 0) {
+    perror("mkdir");
+    return 1;
+  }
+  std::string ops = dir + "/ops.txt";
+  WriteFile(ops, "sort numeric\n");
+
+  std::mt19937 rng(42);
+  std::vector<std::string> paths;
+  for (int f = 0; f < files; ++f) {
+    std::vector<int> numbers(lines);
+    for (int i = 0; i < lines; ++i)
+      numbers[i] = i;
+    std::shuffle(numbers.begin(), numbers.end(), rng);
+    std::string text;
+    for (int n : numbers)
+      text += std::to_string(n) + "\n";
+    paths.push_back(dir + "/f" + std::to_string(f) + ".txt");
+    WriteFile(paths.back(), text);
+  }
+
+  // A deadlocked pool never returns: report it instead of hanging
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool done = false;
+  std::thread watchdog([&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!finished.wait_for(lock, std::chrono::seconds(DEADLINE_SECONDS),
+                           [&] { return done; })) {
+      fprintf(stderr, "check_script: no result after %d s (deadlock?)\n",
+              DEADLINE_SECONDS);
+      _exit(1);
+    }
+  });
+
+  Script script;
+  script.Load(ops);
+  std::vector<std::string> errors;
+  Script::Result result = script.Run(paths, 0, errors);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  finished.notify_all();
+  watchdog.join();
+
+  bool ok = errors.empty() && result.changed == (size_t)files;
+  for (const std::string &error : errors)
+    fprintf(stderr, "check_script: %s\n", error.c_str());
+  for (const std::string &path : paths) {
+    Buffer buffer;
+    buffer.Load(path, 1);
+    for (int y = 0; ok && y < lines; ++y)
+      ok = buffer.GetLine(y) == std::to_string(y);
+    unlink(path.c_str());
+  }
+  unlink(ops.c_str());
+  rmdir(dir.c_str());
+
+  printf("%d files of %d lines sorted in %.3f s\n", files, lines,
+         result.seconds);
+  if (!ok) {
+    fprintf(stderr, "check_script: files were not sorted\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Compare the hot path timings of the plain build against a release build.
+#
+# Usage: bench/compare_release.sh [release-pgo|release-lto] [size_mb] [rounds]
+#
+# Builds bench_paths plainly and with the release target's flags, runs both
+# on the same corpus size and prints the speedup per path. The tree is left
+# holding the release build.
+
+set -e
+cd "$(dirname "$0")/.."
+
+TARGET=${1:-release-pgo}
+SIZE=${2:-64}
+ROUNDS=${3:-3}
+BENCH=obj/bench_paths
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+echo "Building plain..."
+make clean > /dev/null
+make "$BENCH" > /dev/null
+"./$BENCH" "$SIZE" "$ROUNDS" > "$TMP/plain"
+
+echo "Building $TARGET..."
+make "$TARGET" RELEASE_GOALS="all $BENCH" > /dev/null
+"./$BENCH" "$SIZE" "$ROUNDS" > "$TMP/release"
+
+head -n 1 "$TMP/plain"
+awk -v target="$TARGET" '
+  NR == FNR { if (FNR > 2) plain[$1] = $2; next }
+  FNR == 1 { printf "%-8s %10s %10s %8s\n", "path", "plain", target, \
+             "speedup" }
+  FNR > 2 { printf "%-8s %10.4f %10.4f %7.2fx\n", $1, plain[$1], $2, \
+            ($2 > 0 ? plain[$1] / $2 : 0) }
+' "$TMP/plain" "$TMP/release"
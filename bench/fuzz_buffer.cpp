@@ -0,0 +1,389 @@
+/**
+ * @file fuzz_buffer.cpp
+ * @brief Randomized edit sequences against Buffer: checked against a plain
+ * model, timed per operation, and flagged when an operation's cost grows
+ * faster than the text it works on.
+ * @author rahuldangeofficial
+ *
+ * Usage: fuzz_buffer [seed] [ops_per_size]
+ *
+ * Two axes are swept: the number of lines (short lines, growing file) and
+ * the length of lines (few lines, growing lines). At each size a file is
+ * generated and loaded, then the same mix of operations is applied to the
+ * Buffer and to a vector-of-strings model: single bytes, UTF-8 characters
+ * and strings typed in, lines split and joined, characters and ranges
+ * deleted, ranges copied and pasted. Lines near every edit are compared
+ * after it, the whole text periodically, and the saved file at the end.
+ *
+ * For each operation the median cost at the smallest and largest size
+ * gives a log-log slope: about 0 when the cost does not depend on the
+ * size, 1 when it grows in proportion (memmove of a line or of the line
+ * index). Each operation has an expected class per axis. Every operation
+ * edits at most a few lines, so it should cost the same however many
+ * lines the file has: a slope above GROWS flags it. By line length the
+ * limit is SUPERLINEAR. Exits 2 on a mismatch (with the seed to replay
+ * it) and 1 on a regression.
+ */
+
+#include "../include/buffer.hpp"
+#include "../include/textutils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// Slope above which a cost counts as growing faster than linearly; leaves
+// room for cache effects at the large end of a linear operation
+const double SUPERLINEAR = 1.5;
+
+// Slope above which a cost expected to be constant counts as growing with
+// the size; an O(n) step shows as about 1, cache misses stay well below
+const double GROWS = 0.5;
+
+// Whole-text comparison interval, in operations
+const int CHECK_EVERY = 256;
+
+enum Op { INSERT, UTF8, TEXT, SPLIT, JOIN, DELETE, RANGE, PASTE, OPS };
+const char *const OP_NAMES[OPS] = {"insert", "utf8",   "text",  "split",
+                                   "join",   "delete", "range", "paste"};
+
+// Operations whose cost must not depend on the number of lines: all of
+// them, as ranges span at most three lines whatever the file size. By
+// line length every operation copies part of a line and may grow
+const bool CONSTANT_BY_LINES[OPS] = {true, true, true, true,
+                                     true, true, true, true};
+
+const char *const UTF8_CHARS[] = {"é", "δ", "ж", "日", "語", "🙂", "€"};
+
+using Position = Buffer::Position;
+
+/// The reference: lines as plain strings, edited the obvious way.
+struct Model {
+  std::vector<std::string> lines;
+
+  std::string Between(Position from, Position to) const {
+    if (from.y == to.y)
+      return lines[from.y].substr(from.x, to.x - from.x);
+    std::string text = lines[from.y].substr(from.x) + "\n";
+    for (int y = from.y + 1; y < to.y; ++y)
+      text += lines[y] + "\n";
+    return text + lines[to.y].substr(0, to.x);
+  }
+
+  void Delete(Position from, Position to) {
+    lines[from.y] = lines[from.y].substr(0, from.x) + lines[to.y].substr(to.x);
+    lines.erase(lines.begin() + from.y + 1, lines.begin() + to.y + 1);
+  }
+
+  void Insert(Position at, const std::string &text) {
+    std::string rest = lines[at.y].substr(at.x);
+    lines[at.y].resize(at.x);
+    std::string part;
+    int y = at.y;
+    bool first = true;
+    size_t start = 0;
+    for (;;) {
+      size_t nl = text.find('\n', start);
+      part = text.substr(start, nl == std::string::npos ? nl : nl - start);
+      if (first)
+        lines[y] += part;
+      else
+        lines.insert(lines.begin() + ++y, part);
+      first = false;
+      if (nl == std::string::npos)
+        break;
+      start = nl + 1;
+    }
+    lines[y] += rest;
+  }
+};
+
+struct Size {
+  const char *axis; // "lines" or "length"
+  int lines;
+  int length; // Bytes per generated line
+};
+
+struct Result {
+  std::vector<double> median[OPS]; // Nanoseconds, one per size
+};
+
+std::string TempPath(const char *suffix) {
+  const char *tmp = getenv("TMPDIR");
+  return std::string(tmp ? tmp : "/tmp") + "/edit_fuzz_buffer_" +
+         std::to_string(getpid()) + suffix;
+}
+
+/// Generated text: words, tabs and some UTF-8, lines of about `length`.
+void MakeFile(const std::string &path, const Size &size, std::mt19937 &rng,
+              Model &model) {
+  static const char *words[] = {"alpha", "beta", "\tgamma", "δέλτα",
+                                "naïve", "{",    "}",       "0x7f3a"};
+  model.lines.clear();
+  std::ofstream out(path, std::ios::binary);
+  for (int y = 0; y < size.lines; ++y) {
+    std::string line;
+    while ((int)line.size() < size.length) {
+      line += words[rng() % (sizeof(words) / sizeof(words[0]))];
+      line += ' ';
+    }
+    out << line << '\n';
+    model.lines.push_back(std::move(line));
+  }
+}
+
+/// A random character boundary in line y.
+int Boundary(const Model &model, int y, std::mt19937 &rng) {
+  const std::string &line = model.lines[y];
+  size_t x = rng() % (line.size() + 1);
+  while (x > 0 && x < line.size() && (line[x] & 0xC0) == 0x80)
+    x--;
+  return (int)x;
+}
+
+/// A random position and another up to two lines after it.
+void RandomRange(const Model &model, std::mt19937 &rng, Position &from,
+                 Position &to) {
+  int count = (int)model.lines.size();
+  from.y = (int)(rng() % count);
+  to.y = std::min(count - 1, from.y + (int)(rng() % 3));
+  from.x = Boundary(model, from.y, rng);
+  to.x = Boundary(model, to.y, rng);
+  if (to < from)
+    std::swap(from, to);
+}
+
+bool Same(const Buffer &buffer, const Model &model, int first, int last) {
+  if (buffer.LineCount() != (int)model.lines.size())
+    return false;
+  first = std::max(first, 0);
+  last = std::min(last, (int)model.lines.size() - 1);
+  for (int y = first; y <= last; ++y)
+    if (buffer.GetLine(y) != model.lines[y])
+      return false;
+  return true;
+}
+
+[[noreturn]] void Mismatch(unsigned seed, const Size &size, int op, Op kind) {
+  fprintf(stderr,
+          "fuzz_buffer: mismatch after operation %d (%s) at %s %d x %d, "
+          "seed %u\n",
+          op, OP_NAMES[kind], size.axis, size.lines, size.length, seed);
+  exit(2);
+}
+
+/// Apply `ops` random operations at one size, recording median costs.
+void Run(const Size &size, int ops, unsigned seed, Result &result) {
+  std::mt19937 rng(seed);
+  std::string path = TempPath(".txt");
+  std::string saved = TempPath(".out");
+  Model model;
+  MakeFile(path, size, rng, model);
+
+  Buffer buffer;
+  buffer.Load(path);
+  if (!Same(buffer, model, 0, (int)model.lines.size() - 1))
+    Mismatch(seed, size, 0, INSERT);
+
+  std::vector<double> costs[OPS];
+  for (int i = 1; i <= ops; ++i) {
+    Op kind = (Op)(rng() % OPS);
+    int count = (int)model.lines.size();
+    int y = (int)(rng() % count);
+    int x = Boundary(model, y, rng);
+    Position from, to;
+    std::string text;
+
+    // Pick the arguments first so only the Buffer call is timed
+    switch (kind) {
+    case INSERT:
+      text = std::string(1, (char)(' ' + rng() % 95));
+      break;
+    case UTF8:
+      text = UTF8_CHARS[rng() % (sizeof(UTF8_CHARS) / sizeof(char *))];
+      break;
+    case TEXT:
+      text = std::string(1 + rng() % 48, (char)('a' + rng() % 26));
+      break;
+    case JOIN:
+      if (y == 0)
+        y = 1 % count;
+      x = 0;
+      break;
+    case DELETE:
+      if (x == 0)
+        x = (int)model.lines[y].size();
+      break;
+    case RANGE:
+    case PASTE:
+      RandomRange(model, rng, from, to);
+      break;
+    default:
+      break;
+    }
+    if ((kind == JOIN && y == 0) || (kind == DELETE && x == 0))
+      continue; // Nothing to join or delete
+
+    auto start = std::chrono::steady_clock::now();
+    switch (kind) {
+    case INSERT:
+      buffer.InsertChar(y, x, text[0]);
+      break;
+    case UTF8:
+    case TEXT:
+      buffer.InsertString(y, x, text);
+      break;
+    case SPLIT:
+      buffer.InsertNewLine(y, x);
+      break;
+    case JOIN:
+    case DELETE:
+      buffer.DeleteChar(y, x);
+      break;
+    case RANGE:
+      buffer.DeleteRange(from, to);
+      break;
+    case PASTE:
+      buffer.InsertClip({y, x}, buffer.Copy(from, to));
+      break;
+    case OPS:
+      break;
+    }
+    costs[kind].push_back(std::chrono::duration<double, std::nano>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+
+    int last = y + 1;
+    switch (kind) {
+    case INSERT:
+    case UTF8:
+    case TEXT:
+      model.Insert({y, x}, text);
+      break;
+    case SPLIT:
+      model.Insert({y, x}, "\n");
+      break;
+    case JOIN:
+      y--;
+      model.Delete({y, (int)model.lines[y].size()}, {y + 1, 0});
+      break;
+    case DELETE: {
+      size_t prev = TextUtils::PrevCharIdx(model.lines[y], x);
+      model.Delete({y, (int)prev}, {y, x});
+      break;
+    }
+    case RANGE:
+      model.Delete(from, to);
+      y = from.y;
+      break;
+    case PASTE: {
+      std::string clip = model.Between(from, to);
+      model.Insert({y, x}, clip);
+      last = y + (int)std::count(clip.begin(), clip.end(), '\n') + 1;
+      break;
+    }
+    case OPS:
+      break;
+    }
+
+    bool whole = i % CHECK_EVERY == 0 || i == ops;
+    if (!Same(buffer, model, whole ? 0 : y - 1,
+              whole ? (int)model.lines.size() - 1 : last))
+      Mismatch(seed, size, i, kind);
+  }
+
+  // The saved bytes, with or without a final newline
+  buffer.SaveCopy(saved);
+  std::ifstream in(saved, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+  std::string expected;
+  for (size_t y = 0; y < model.lines.size(); ++y)
+    expected += (y ? "\n" : "") + model.lines[y];
+  if (bytes != expected && bytes != expected + "\n")
+    Mismatch(seed, size, ops, INSERT);
+  unlink(path.c_str());
+  unlink(saved.c_str());
+
+  for (int k = 0; k < OPS; ++k) {
+    std::vector<double> &c = costs[k];
+    double median = 0;
+    if (!c.empty()) {
+      std::nth_element(c.begin(), c.begin() + c.size() / 2, c.end());
+      median = c[c.size() / 2];
+    }
+    result.median[k].push_back(median);
+  }
+}
+
+/// Sweep one axis; returns the number of operations flagged.
+int Sweep(const std::vector<Size> &sizes, int ops, unsigned seed) {
+  Result result;
+  for (const Size &size : sizes)
+    Run(size, ops, seed, result);
+
+  const Size &small = sizes.front();
+  const Size &large = sizes.back();
+  bool byLines = std::string(small.axis) == "lines";
+  double growth = byLines ? (double)large.lines / small.lines
+                          : (double)large.length / small.length;
+
+  printf("\nmedian ns per operation, by %s\n%-8s", small.axis, "op");
+  for (const Size &size : sizes)
+    printf(" %10d", byLines ? size.lines : size.length);
+  printf(" %7s %7s\n", "slope", "limit");
+
+  int flagged = 0;
+  for (int k = 0; k < OPS; ++k) {
+    const std::vector<double> &m = result.median[k];
+    printf("%-8s", OP_NAMES[k]);
+    for (double ns : m)
+      printf(" %10.0f", ns);
+    double slope = m.front() > 0 && m.back() > 0
+                       ? std::log(m.back() / m.front()) / std::log(growth)
+                       : 0;
+    bool constant = byLines && CONSTANT_BY_LINES[k];
+    double limit = constant ? GROWS : SUPERLINEAR;
+    bool bad = slope > limit;
+    flagged += bad;
+    printf(" %7.2f %7.2f%s\n", slope, limit,
+           !bad ? "" : constant ? "  GROWS WITH SIZE" : "  SUPERLINEAR");
+  }
+  return flagged;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  setlocale(LC_ALL, "");
+  setenv("EDIT_NO_INDEX_CACHE", "1", 1);
+
+  unsigned seed = argc > 1 ? (unsigned)strtoul(argv[1], nullptr, 10)
+                           : (unsigned)std::random_device()();
+  int ops = argc > 2 ? std::max((int)OPS, atoi(argv[2])) : 8000;
+  printf("seed %u, %d operations per size\n", seed, ops);
+
+  int flagged = Sweep({{"lines", 8192, 40},
+                       {"lines", 32768, 40},
+                       {"lines", 131072, 40}},
+                      ops, seed);
+  flagged += Sweep({{"length", 64, 2048},
+                    {"length", 64, 8192},
+                    {"length", 64, 32768}},
+                   ops, seed);
+
+  if (flagged > 0) {
+    fprintf(stderr,
+            "fuzz_buffer: %d operation(s) scale worse than expected\n",
+            flagged);
+    return 1;
+  }
+  return 0;
+}
@@ -7,19 +7,47 @@
 #ifndef BUFFER_HPP
 #define BUFFER_HPP
 
+#include "compression.hpp"
+#include "linestore.hpp"
+#include "textutils.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+class IndexCache;
+class ThreadPool;
+
 /**
  * @class Buffer
  * @brief Manages the text content of the file being edited.
  *
  * Responsibilities:
- * - Stores lines of text strings in a vector.
+ * - Stores lines as views into the original file bytes (lossless).
  * - Handles file I/O operations (Load, Save).
- * - Implements modifications (Insert, Delete).
+ * - Implements modifications (Insert, Delete), singly or batched.
+ * - Records modifications in an undo/redo journal.
  * - Tracks "dirty" state (unsaved changes).
  *
+ * Storage:
+ * - The file is read once into an immutable source block, in parallel
+ *   chunks that are then indexed and UTF-8 checked on a thread pool.
+ * - Follow mode appends further blocks as the file grows.
+ * - Large files keep line checkpoints in a sidecar (see IndexCache). On
+ *   reopen, each checkpointed chunk is read and indexed on first access
+ *   while a background sweep fills in the rest, so the first screen does
+ *   not wait for the whole file.
+ * - Compressed files (gzip, zstd) are inflated on a background thread in
+ *   blocks cut at line ends, each indexed as it arrives; the blocks are
+ *   appended as source blocks, as in follow mode, and Save compresses the
+ *   text again.
+ * - Unchanged lines reference that block; no per-line copies are made.
+ * - A line is copied into its own edit slot the first time it is modified.
+ * - Tabs, '\r' and control bytes are kept verbatim; expansion is a
+ *   rendering concern (see TextUtils).
+ *
  * Safety:
  * - All indices are bounds-checked.
  * - File operations use robust error handling.
@@ -27,15 +55,107 @@
  */
 class Buffer {
 public:
+  /// Line terminator style detected on load and used for edited lines.
+  enum class LineEnding { LF, CRLF };
+
+  /// Identity of the file on disk, used to spot changes by other processes.
+  struct DiskState {
+    bool exists = false;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+
+    bool operator==(const DiskState &o) const {
+      return exists == o.exists && dev == o.dev && ino == o.ino &&
+             size == o.size && mtimeNs == o.mtimeNs;
+    }
+  };
+
+  /// Outcome of Buffer::Ingest.
+  enum class IngestResult { Unchanged, Appended, Reset };
+
+  /// Lines [firstLine, firstLine + oldLines) were replaced by newLines lines.
+  struct ReloadResult {
+    int firstLine;
+    int oldLines;
+    int newLines;
+  };
+
+  /// Bytes held by each part of a buffer (see Memory).
+  struct MemoryUsage {
+    size_t text;  // Source blocks: the file and adopted paste blocks
+    size_t lines; // Line index
+    size_t edits; // Edit slots holding modified lines
+    size_t undo;  // Undo/redo journal, with clip bytes no block holds
+  };
+
+  /// Lines [first, first + removed) were replaced by `added` lines.
+  struct LineEdit {
+    int first;
+    int removed;
+    int added;
+  };
+
+  /// A run of inflated text ending at a line boundary (or the end).
+  struct TextPiece {
+    std::shared_ptr<const char> bytes;
+    size_t size;
+  };
+  using TextPieces = std::vector<TextPiece>;
+
+  /// A place in the text: line index and byte offset within the line.
+  struct Position {
+    int y;
+    int x;
+
+    bool operator==(const Position &o) const { return y == o.y && x == o.x; }
+    bool operator!=(const Position &o) const { return !(*this == o); }
+    bool operator<(const Position &o) const {
+      return y < o.y || (y == o.y && x < o.x);
+    }
+  };
+
+  /// Text between two positions, from <= to.
+  struct Range {
+    Position from;
+    Position to;
+  };
+
+  /**
+   * Copied text, as the bytes Save would write for the range. Runs of
+   * untouched lines point into the shared source blocks, so copying a
+   * large region copies no text; only edited lines are owned.
+   */
+  struct Clip {
+    struct Piece {
+      std::shared_ptr<const char> block; // Source block or owned bytes
+      size_t blockSize;
+      size_t offset; // Start of the run within block
+      size_t length;
+    };
+    std::vector<Piece> pieces;
+
+    bool Empty() const { return pieces.empty(); }
+    size_t Size() const;
+  };
+
   Buffer();
-  ~Buffer() = default;
+  ~Buffer();
+
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
 
   /**
    * @brief Load content from a file path.
    * @param path File path.
+   * @param threads Worker count; 0 uses the shared pool, 1 runs serially.
+   * @param background For a compressed file, return once the first
+   * checkpoint of text is in and let the rest arrive through Pump.
    * @throws std::runtime_error if file exisits but cannot be read.
    */
-  void Load(const std::string &path);
+  void Load(const std::string &path, unsigned threads = 0,
+            bool background = false);
 
   /**
    * @brief Save content to disk atomically.
@@ -45,19 +165,113 @@ public:
    * 2. fsync() to ensure data hits the disk.
    * 3. Rename {filename}.tmp to {filename} (POSIX atomic guarantee).
    *
+   * Unchanged lines are written straight from the source block in
+   * contiguous runs, so only edited lines are re-encoded.
+   *
    * @throws std::runtime_error on I/O failure.
    */
   void Save();
 
+  /**
+   * @brief Atomically write the content to another path (e.g. a recovery
+   * copy). Does not change the filename, dirty flag or disk state.
+   * @throws std::runtime_error on I/O failure.
+   */
+  void SaveCopy(const std::string &path);
+
+  /**
+   * @brief Check whether the file on disk differs from what was last
+   * loaded or saved (size, mtime or inode changed).
+   */
+  bool ExternallyModified() const;
+
+  /**
+   * @brief Whether the file existed when last loaded or saved.
+   */
+  bool ExistsOnDisk() const { return m_disk.exists; }
+
+  /**
+   * @brief Re-read the file after an external change.
+   *
+   * The current content is matched against the new bytes from the front
+   * and the back; only the differing middle region is re-indexed, and line
+   * numbers outside it are preserved. Discards unsaved edits, so callers
+   * should only reload a clean buffer.
+   *
+   * @param threads Worker count, as for Load.
+   * @return The replaced line range, for cursor and scroll fix-ups.
+   * @throws std::runtime_error if the file cannot be read.
+   */
+  ReloadResult Reload(unsigned threads = 0);
+
+  /**
+   * @brief Pick up bytes appended to the file since it was last read
+   * (follow mode).
+   *
+   * Cost is proportional to the appended bytes: only they (plus a trailing
+   * partial line, which they may complete) are preaded and indexed into a
+   * new source block. A truncated or replaced (rotated) file is loaded
+   * afresh. Does nothing while the buffer has unsaved edits.
+   *
+   * @param threads Worker count, as for Load.
+   * @throws std::runtime_error if the file cannot be read.
+   */
+  IngestResult Ingest(unsigned threads = 0);
+
+  /**
+   * @brief Adopt the lines a background load has inflated since the
+   * previous call, without waiting for more.
+   *
+   * Lines only arrive at the end of the file's text and before any edit:
+   * the first modification (or Save) waits for the rest of the stream.
+   *
+   * @param appended Receives the lines added at the end since the previous
+   * call, including any a modification waited for (removed is 0).
+   * @param line Wait until this line has arrived (or the stream ended),
+   * e.g. to paint a restored position; -1 does not wait.
+   * @return false if there was nothing to report.
+   */
+  bool Pump(LineEdit &appended, int line = -1);
+
+  /**
+   * @brief Whether a background load still has lines to deliver through
+   * Pump. Becomes false on the Pump call that reports the last of them.
+   */
+  bool Streaming() const { return m_streaming; }
+
+  /**
+   * @brief Why a compressed file stopped inflating early (empty if it did
+   * not). Such a buffer holds only the text before the damage, so Save
+   * refuses to write it over the file.
+   */
+  const std::string &StreamError() const { return m_streamError; }
+
+  /**
+   * @brief The text a compressed file inflated to, in order, once all of
+   * it is in (null for any other file, or while streaming).
+   *
+   * The pieces are the buffer's own immutable source blocks, so handing
+   * them to a worker costs neither a copy nor a second inflation.
+   */
+  std::shared_ptr<const TextPieces> InflatedText() const {
+    return m_inflated;
+  }
+
+  /**
+   * @brief Compression of the file on disk, kept when saving.
+   */
+  Compression::Format GetCompression() const { return m_compression; }
+
   // --- content access ---
 
   /**
-   * @brief Get a read-only reference to a specific line.
+   * @brief Get a read-only view of a specific line (without terminator).
    * @param y 0-based line index.
-   * @return const std::string& line content.
-   * @note Returns empty string if out of bounds (safe access).
+   * @return std::string_view line content, valid until the next mutation.
+   * @note Returns empty view if out of bounds (safe access).
+   * @note Safe to call from several threads while no mutation runs.
    */
-  const std::string &GetLine(int y) const;
+  std::string_view GetLine(int y) const;
 
   /**
    * @brief Get total number of lines.
@@ -69,6 +283,30 @@ public:
    */
   bool IsDirty() const;
 
+  /**
+   * @brief Lines indexed lazily from the index sidecar turned out not to
+   * match the file (it changed while loading). The lines are blank where
+   * they disagreed until Reload; ExternallyModified reports it too.
+   */
+  bool Stale() const;
+
+  /**
+   * @brief Line ending style detected on load (LF for new files).
+   */
+  LineEnding GetLineEnding() const { return m_eol; }
+
+  /**
+   * @brief Encoding class of the text: set on load and widened by edits
+   * that insert other kinds of bytes (never narrowed). Selects the
+   * TextUtils kernels used to render and move through it.
+   */
+  TextUtils::Encoding GetEncoding() const { return m_encoding; }
+
+  /**
+   * @brief Longest line seen while indexing, in bytes (a width bound).
+   */
+  size_t LongestLine() const { return m_longestLine; }
+
   // --- modification ---
 
   /**
@@ -101,17 +339,277 @@ public:
    */
   void InsertNewLine(int y, int x);
 
+  /**
+   * @brief Copy the text between two positions (in either order).
+   * @note Cost is proportional to the number of lines, not bytes.
+   */
+  Clip Copy(Position from, Position to) const;
+
+  /**
+   * @brief Delete the text between two positions (in either order).
+   *
+   * Only the two boundary lines are touched; the lines between are
+   * dropped from the index without visiting their bytes.
+   *
+   * @return Where the cursor belongs afterwards (the earlier position).
+   */
+  Position DeleteRange(Position from, Position to);
+
+  /**
+   * @brief Insert copied text at a position in one bulk operation.
+   *
+   * The clip's blocks become source blocks of this buffer, so pasted lines
+   * reference the same bytes instead of copying them.
+   *
+   * @return The position just after the inserted text.
+   */
+  Position InsertClip(Position at, const Clip &clip);
+
+  /**
+   * @brief Replace every range with the same text in one pass (the
+   * multi-cursor edit).
+   *
+   * Ranges must be sorted and must not overlap; empty ranges insert. The
+   * line index is rebuilt once between the first and last range rather
+   * than shifted per range. The batch is a single undo step.
+   *
+   * @return For each range, the position just after its replacement.
+   */
+  std::vector<Position> ReplaceRanges(const std::vector<Range> &ranges,
+                                      std::string_view text);
+
+  /**
+   * @brief Replace lines [first, first + count) with those lines in a new
+   * order, dropping the ones it leaves out (sort, unique, filter).
+   *
+   * Line references move; no text is copied, and the journal keeps the
+   * order rather than the reordered text. The whole change is one undo
+   * step.
+   *
+   * @param order Indices relative to first, each used at most once.
+   * @return The start of the first line of the result.
+   */
+  Position ReorderLines(int first, int count,
+                        const std::vector<uint32_t> &order);
+
+  // --- undo ---
+
+  /**
+   * @brief Group the following modifications into one undo step, until
+   * the matching EndUndoGroup. Groups nest; only the outermost counts.
+   */
+  void BeginUndoGroup();
+  void EndUndoGroup();
+
+  /**
+   * @brief Revert the last undo step.
+   * @param cursor Receives where the step started.
+   * @return false if there is nothing to undo.
+   */
+  bool Undo(Position &cursor);
+
+  /**
+   * @brief Re-apply the last undone step.
+   * @param cursor Receives the end of the re-applied text.
+   * @return false if there is nothing to redo.
+   */
+  bool Redo(Position &cursor);
+
+  /**
+   * @brief Lines touched by modifications since the previous call (or the
+   * last Load), merged into one range of the current text.
+   * @return false if nothing was modified. Reload and Ingest do not count:
+   * they follow the file rather than edit it.
+   */
+  bool TakeLineEdit(LineEdit &edit);
+
+  /**
+   * @brief Heap bytes held, per part (allocated capacity, not just size).
+   */
+  MemoryUsage Memory() const;
+
   // --- helpers ---
 
   const std::string &GetFileName() const { return m_filename; }
 
 private:
-  std::vector<std::string> m_lines;
+  /**
+   * A line is either a span of the source block or an owned edit slot.
+   * `term` records how many terminator bytes followed the span on disk so
+   * that runs of untouched lines can be written back verbatim. m_lines
+   * packs them into 8 bytes each (see LineStore).
+   */
+  using LineRef = LineStore::Ref;
+
+  /**
+   * Immutable source bytes occupying [base, base + size) of a virtual
+   * offset space. Load creates one block; follow-mode ingestion appends
+   * more without touching existing ones.
+   */
+  struct SourceBlock {
+    size_t base;
+    size_t size;
+    std::shared_ptr<const char> bytes;
+  };
+
+  /// What indexing learned about the bytes besides line boundaries.
+  struct ScanSummary {
+    TextUtils::Utf8Stats utf8;
+    int firstTerm = 0;      // Terminator of the first terminated line
+    size_t longestLine = 0; // Bytes, terminator excluded
+
+    void Note(size_t length, int term) {
+      if (firstTerm == 0)
+        firstTerm = term;
+      if (length > longestLine)
+        longestLine = length;
+    }
+    void Merge(const ScanSummary &o) {
+      utf8.Merge(o.utf8);
+      if (firstTerm == 0)
+        firstTerm = o.firstTerm;
+      if (o.longestLine > longestLine)
+        longestLine = o.longestLine;
+    }
+  };
+
+  /// Deferred chunk indexing after a sidecar hit (defined in buffer.cpp).
+  struct LazyIndex;
+
+  /// Background inflation of a compressed file (defined in buffer.cpp).
+  struct Inflow;
+
+  /**
+   * One journaled modification: the text between at and removedEnd was
+   * replaced by the text between at and insertedEnd. Clips share storage
+   * with the buffer, so large deletions cost no copies to remember.
+   *
+   * Changes made by one Splice share a nonzero batch number; their
+   * positions are those after the whole batch, and before holds each
+   * range as it was before it, so undo/redo replay the batch as one Splice.
+   *
+   * A ReorderLines change has an order instead of inserted text; redo
+   * reapplies it to the restored lines.
+   */
+  struct Change {
+    Position at;
+    Position removedEnd;
+    Position insertedEnd;
+    Clip removed;
+    Clip inserted;
+    uint32_t batch = 0;
+    Range before = {};
+    std::shared_ptr<const std::vector<uint32_t>> order = nullptr;
+  };
+
+  std::vector<SourceBlock> m_blocks; // Sorted by base, never empty
+  size_t m_sourceEnd;                // First unused virtual offset
+  LineStore m_lines;
+  std::vector<std::string> m_edits;
+  std::vector<int32_t> m_freeSlots;
   std::string m_filename;
+  DiskState m_disk;
+  LineEnding m_eol;
+  TextUtils::Encoding m_encoding;
+  size_t m_longestLine;
+  bool m_finalNewline;
   bool m_dirty;
+  bool m_stale; // Lazy indexing found the file unlike its sidecar
+  std::unique_ptr<LazyIndex> m_lazy; // Null once every line is indexed
+  Compression::Format m_compression;
+  std::unique_ptr<Inflow> m_inflow; // Null once the stream is all adopted
+  bool m_streaming;                 // Pump has more to report
+  int m_streamLines;                // Lines adopted from the stream
+  int m_reportedLines;              // ... of which Pump reported
+  std::string m_streamError;
+  std::shared_ptr<const TextPieces> m_inflated; // See InflatedText
+  // Deques: at UNDO_LIMIT every edit drops the oldest group from the front
+  std::deque<std::vector<Change>> m_undo;
+  std::deque<std::vector<Change>> m_redo;
+  int m_undoDepth;    // Open BeginUndoGroup calls
+  bool m_groupOpen;   // m_undo.back() belongs to the open group
+  bool m_replaying;   // Undo/redo in progress: do not journal
+  uint32_t m_batches; // Last Change::batch handed out
+  LineEdit m_lineEdit; // Pending for TakeLineEdit while m_lineEdited
+  bool m_lineEdited;
 
   // Ensure at least one line exists
   void EnsureLine();
+
+  // Replace all source blocks with a single one at base 0
+  void ResetSource(std::shared_ptr<const char> bytes, size_t size);
+
+  // Pointer to the byte at a virtual source offset
+  const char *SourceAt(size_t offset) const;
+
+  // Block holding a virtual source offset
+  const SourceBlock &BlockAt(size_t offset) const;
+
+  // Virtual base of a block, adding it to the source space if new
+  size_t AdoptBlock(const std::shared_ptr<const char> &bytes, size_t size);
+
+  // Text of a line reference (source span or edit slot)
+  std::string_view Text(const LineRef &ref) const;
+
+  // Journal a modification (no-op while replaying undo/redo)
+  void Record(Change change);
+
+  // Forget all undo/redo history (the content was replaced wholesale)
+  void ClearHistory();
+
+  // Merge a modification into the range TakeLineEdit reports
+  void NoteLineEdit(int first, int removed, int added);
+
+  // Replace each range with its clip, in one pass over the lines they span
+  std::vector<Position> Splice(const std::vector<Range> &ranges,
+                               const std::vector<const Clip *> &clips);
+
+  // Clip of text with each '\n' spelled as this buffer's line ending
+  Clip ClipFromText(std::string_view text) const;
+
+  // Index [begin, end) of data into lines appended to out, in parallel
+  static void IndexLines(const char *data, size_t begin, size_t end,
+                         ThreadPool *pool, LineStore &out,
+                         ScanSummary &summary);
+
+  // Write the content to path via temp file + fsync + rename
+  DiskState WriteAtomic(const std::string &path) const;
+
+  // Set up lazy loading from a matching sidecar; takes fd on success
+  bool LoadIndexed(int fd, const IndexCache &cache, bool appended,
+                   unsigned threads);
+
+  // Wait for lazy loading to complete (before anything reshapes m_lines)
+  void FinishLoading();
+
+  // Abandon lazy loading without completing it
+  void DropLazy();
+
+  // Inflate a compressed file from fd (taken) in the background, waiting
+  // for the first checkpoint only, or for all of it
+  void LoadCompressed(int fd, bool background);
+
+  // Append inflated blocks, waiting until at least minimum were adopted
+  // (or the stream ended); finishes the stream once it has ended
+  void AdoptInflated(size_t minimum);
+
+  // Abandon inflation without completing it
+  void DropInflow();
+
+  // Terminator bytes Save would write after line y
+  std::string_view Terminator(int y) const;
+
+  // Copy a line into an edit slot (once) and return its mutable text
+  std::string &Mutable(int y);
+
+  // Store text in a free (or new) edit slot and return its index
+  int32_t AllocSlot(std::string text);
+
+  // Return an edit slot to the free list
+  void ReleaseSlot(int32_t slot);
+
+  // Widen the encoding class to cover inserted text
+  void NoteText(std::string_view text);
 };
 
 #endif // BUFFER_HPP
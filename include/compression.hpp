@@ -0,0 +1,108 @@
+/**
+ * @file compression.hpp
+ * @brief Compression class declaration for transparent gzip/zstd files.
+ * @author rahuldangeofficial
+ */
+
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct iovec;
+
+/**
+ * @class Compression
+ * @brief Reads and writes compressed files (e.g. rotated *.log.gz) as if
+ * they were the text inside.
+ *
+ * Responsibilities:
+ * - Recognize a compressed file by its magic bytes, not its name.
+ * - Inflate it as a stream, piece by piece (Decoder), so the text can be
+ *   indexed while the rest is still being inflated.
+ * - Compress the text again, in the same format, when it is saved.
+ *
+ * Notes:
+ * - gzip goes through zlib and is always available. zstd needs libzstd at
+ *   build time (EDIT_ZSTD, set by the Makefile when it finds the library).
+ * - Concatenated gzip members and zstd frames read as one text.
+ */
+class Compression {
+public:
+  enum class Format { None, Gzip, Zstd };
+
+  /**
+   * @brief Format of data starting with these bytes (at least 4 wanted).
+   */
+  static Format Detect(const char *head, size_t n);
+
+  /**
+   * @brief Format of the file behind fd, from its first bytes.
+   */
+  static Format Sniff(int fd);
+
+  /**
+   * @brief Format of the file at path (None if it cannot be read).
+   */
+  static Format Probe(const std::string &path);
+
+  /**
+   * @brief Whether this build can read and write the format.
+   */
+  static bool Supported(Format format);
+
+  /// Short name for messages ("gzip", "zstd").
+  static const char *Name(Format format);
+
+  /**
+   * @brief Inflated bytes per checkpoint: EDIT_INFLATE_CHECKPOINT (bytes,
+   * or with a K or M suffix) if set and sane, else
+   * INFLATE_CHECKPOINT_BYTES. Read once.
+   */
+  static size_t CheckpointBytes();
+
+  /**
+   * @brief Inflate a whole compressed file into text.
+   * @return false if path is not a compressed file (text is untouched).
+   * @throws std::runtime_error if the data is corrupt or unsupported.
+   */
+  static bool InflateFile(const std::string &path, std::string &text);
+
+  /**
+   * @brief Compress the bytes of iov, in order, and write them to fd.
+   * @throws std::runtime_error on I/O failure.
+   */
+  static void Write(int fd, Format format, const std::vector<iovec> &iov);
+
+  /**
+   * @class Decoder
+   * @brief Streaming decompression of a file, read with pread from offset
+   * 0 (the descriptor's position is left alone; fd is not owned).
+   */
+  class Decoder {
+  public:
+    /// @throws std::runtime_error if the format is not supported.
+    Decoder(int fd, Format format);
+    ~Decoder();
+
+    Decoder(const Decoder &) = delete;
+    Decoder &operator=(const Decoder &) = delete;
+
+    /**
+     * @brief Inflate up to n bytes into out.
+     * @return Bytes produced; fewer than n only at the end of the text,
+     * or when damage follows (the next call then throws).
+     * @throws std::runtime_error on corrupt or truncated data.
+     */
+    size_t Read(char *out, size_t n);
+
+  private:
+    struct State;
+    std::unique_ptr<State> m_state;
+  };
+};
+
+#endif // COMPRESSION_HPP
@@ -7,6 +7,7 @@
 #ifndef CONSTANTS_HPP
 #define CONSTANTS_HPP
 
+#include <cstdint>
 #include <string>
 
 namespace Edit {
@@ -14,6 +15,62 @@ namespace Edit {
 // Helper for safe atomic file operations
 const std::string TEMP_EXTENSION = ".tmp";
 
+// Emergency copy written when a signal arrives but the file on disk is newer
+const std::string RECOVER_EXTENSION = ".recovered";
+
+// Load pipeline: bytes handed to each worker per chunk
+const size_t LOAD_CHUNK_BYTES = 4 * 1024 * 1024;
+
+// Line index sidecar: files at least this big get one
+const size_t INDEX_CACHE_MIN_BYTES = 16 * 1024 * 1024;
+
+// Line index sidecar: one offset checkpoint per this many lines
+const uint32_t CHECKPOINT_LINES = 65536;
+
+// Compressed files: inflated text handed from the background inflater to
+// the buffer per checkpoint; the first screen waits for the first one only.
+// EDIT_INFLATE_CHECKPOINT overrides it (Compression::CheckpointBytes)
+const size_t INFLATE_CHECKPOINT_BYTES = 4 * 1024 * 1024;
+
+// Hex view: bytes sampled from the start of a file to detect binaries
+const size_t BINARY_SAMPLE_BYTES = 64 * 1024;
+
+// Undo history: edit groups kept before the oldest is dropped
+const size_t UNDO_LIMIT = 1000;
+
+// Multi-cursor: upper bound on simultaneous cursors
+const size_t MAX_CURSORS = 100000;
+
+// Bracket highlight: unindexed lines one redraw may index to find a match
+const int BRACKET_SCAN_LINES = 256 * 1024;
+
+// Word completion: candidates offered (and cycled through) per Ctrl+P
+const size_t COMPLETIONS = 8;
+
+// Line operations: bytes of (key, line) pairs a sort may hold before it
+// spills sorted runs to a temporary file
+const size_t LINE_OP_MEMORY = 256 * 1024 * 1024;
+
+// Resize: quiet time after the last SIGWINCH before relayout, so a
+// window drag redraws once
+const int RESIZE_SETTLE_MS = 30;
+
+// Session: line filter answers remembered per file (Up/Down recall them)
+const size_t SESSION_HISTORY = 50;
+
+// Mouse wheel: rows the view scrolls per notch
+const int WHEEL_ROWS = 3;
+
+// Table view: rows of a delimited file sampled for column widths, however
+// long it is, and the widest a column is drawn (longer fields are cut)
+const int TABLE_SAMPLE_ROWS = 4096;
+const int TABLE_COLUMN_WIDTH = 40;
+
+// Project search: hits kept before the search stops, and bytes of each
+// matching line kept for the result list
+const size_t SEARCH_MAX_HITS = 100000;
+const size_t SEARCH_LINE_BYTES = 512;
+
 // UI Defaults
 const int TAB_STOP = 4;
 
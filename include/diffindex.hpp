@@ -0,0 +1,157 @@
+/**
+ * @file diffindex.hpp
+ * @brief DiffIndex class declaration: background diff of the buffer against
+ * the saved file, for gutter change markers.
+ * @author rahuldangeofficial
+ */
+
+#ifndef DIFFINDEX_HPP
+#define DIFFINDEX_HPP
+
+#include "buffer.hpp"
+#include "lineblocks.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class DiffIndex
+ * @brief Keeps a line diff between the buffer and its saved version.
+ *
+ * Responsibilities:
+ * - Hash the saved file's lines (the base) on a worker thread.
+ * - Take edited line ranges from the UI thread and re-diff only the
+ *   stretch between the nearest unchanged lines around them.
+ * - Publish the resulting hunks for the gutter and "next change".
+ *
+ * Cost per edit:
+ * - Current lines live in blocks (LineBlocks), so an edit rewrites the
+ *   block or two it touched rather than shifting every line after it.
+ * - Only the hunks of the re-diffed stretch are rebuilt; those after it
+ *   just move by the lines the edit added or removed.
+ *
+ * Diffing:
+ * - Lines are compared by 64-bit hash (text only, not the line ending).
+ * - Common prefix and suffix are trimmed first.
+ * - Small stretches use Myers' O(ND) algorithm, up to a bounded D.
+ * - Big ones are first split at lines unique on both sides, in order
+ *   (patience anchoring), so a few edits spread over a long file stay cheap.
+ *   A stretch without anchors and beyond the D bound is reported as
+ *   replaced wholesale.
+ *
+ * Safety:
+ * - The UI thread only queues work and swaps in published results; it
+ *   never waits for a diff.
+ * - The base is read from disk by the worker, or from the immutable
+ *   pieces a compressed buffer inflated, so the buffer itself is never
+ *   shared across threads.
+ */
+class DiffIndex {
+public:
+  /// Current lines [first, first + count) replace base lines
+  /// [baseFirst, baseFirst + baseCount). Either count may be zero.
+  struct Hunk {
+    int first;
+    int count;
+    int baseFirst;
+    int baseCount;
+  };
+
+  using Hunks = std::vector<Hunk>;
+
+  DiffIndex();
+  ~DiffIndex();
+
+  DiffIndex(const DiffIndex &) = delete;
+  DiffIndex &operator=(const DiffIndex &) = delete;
+
+  /**
+   * @brief The buffer was (re)loaded: base and current are the file on
+   * disk, expected to have lineCount lines.
+   * @param inflated The file's text if the buffer already inflated it
+   * (Buffer::InflatedText); the worker then leaves the disk alone.
+   */
+  void Reset(const std::string &path, int lineCount,
+             std::shared_ptr<const Buffer::TextPieces> inflated = nullptr);
+
+  /**
+   * @brief The buffer's lines changed (from Buffer::TakeLineEdit).
+   */
+  void Edited(const Buffer &buffer, const Buffer::LineEdit &edit);
+
+  /**
+   * @brief The file and a clean buffer changed together (reload, follow):
+   * apply the edit to the base as well.
+   */
+  void Synced(const Buffer &buffer, const Buffer::LineEdit &edit);
+
+  /**
+   * @brief The buffer was saved: it is the new base.
+   */
+  void Saved();
+
+  /**
+   * @brief Latest published hunks, sorted by first (never null).
+   */
+  std::shared_ptr<const Hunks> Published() const;
+
+  /**
+   * @brief Heap bytes of the line hashes and hunks, as of the last publish.
+   */
+  size_t MemoryBytes() const;
+
+private:
+  struct Job {
+    enum class Type { Reset, Edited, Synced, Saved } type;
+    std::string path; // Reset
+    int first;        // Edited, Synced
+    int removed;
+    int expected;     // Reset: line count
+    std::vector<uint64_t> hashes;
+    std::shared_ptr<const Buffer::TextPieces> inflated; // Reset
+  };
+
+  // UI side
+  std::deque<Job> m_jobs;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop;
+  std::shared_ptr<const Hunks> m_published;
+  size_t m_workBytes; // Worker-side vectors, updated with m_published
+
+  // Worker side: hashes of the base lines, and of the current lines in
+  // blocks, each with the base line it matches (-1 for changed lines).
+  // While m_same, current is the base and only m_base is kept.
+  struct Rows {
+    std::vector<uint64_t> hashes;
+    std::vector<int> match;
+  };
+
+  std::vector<uint64_t> m_base;
+  LineBlocks<Rows> m_current;
+  Hunks m_hunks; // As of the last job, published by copy
+  bool m_valid;
+  bool m_same;
+
+  std::thread m_worker;
+
+  void Queue(Job job);
+  void Work();
+  void Apply(Job &job);
+  void SetSame();
+  void Split();
+  std::vector<uint64_t> Flatten();
+  void Splice(int first, int removed, const std::vector<uint64_t> &hashes);
+  int Match(int y);
+  int PrevMatched(int y);
+  int NextMatched(int y);
+  void Rediff(int first, int count, int delta);
+  void Publish();
+};
+
+#endif // DIFFINDEX_HPP
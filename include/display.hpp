@@ -8,6 +8,15 @@
 #define DISPLAY_HPP
 
 #include "buffer.hpp"
+#include "diffindex.hpp"
+#include "folds.hpp"
+#include "hexfile.hpp"
+#include "projectsearch.hpp"
+#include "table.hpp"
+#include <csignal>
+#include <memory>
+#include <string>
+#include <vector>
 
 /**
  * @class Display
@@ -16,7 +25,24 @@
  * Responsibilities:
  * - Initialize and cleanup ncurses window.
  * - Render visible portion of Buffer.
+ * - Highlight selections, extra cursors and the matching bracket pair.
+ * - Collapse folded lines to their header.
+ * - Render a HexFile as offset / hex / ASCII rows (the hex view).
+ * - Render delimited text as aligned columns (the table view), the first
+ *   column pinned while the rest scroll sideways.
+ * - Render the hits of a project search as a list to pick from.
  * - Render status bar.
+ * - Track the terminal size from SIGWINCH (see Resize).
+ * - Scroll the view on its own (mouse wheel), leaving the cursor behind.
+ *
+ * Notes:
+ * - The size is only re-read when a resize signal arrived, not per frame.
+ * - ncurses may use the terminal's scroll region (idlok): after a scroll
+ *   the rows still on screen are shifted by the terminal and only the
+ *   rows exposed are sent.
+ * - A steady-state frame does no heap allocation: rows are composed in a
+ *   reused buffer and the status bar is rebuilt only when what it shows
+ *   changes (bench/check_frames checks this).
  */
 class Display {
 public:
@@ -31,31 +57,216 @@ public:
    */
   void Render(const Buffer &buffer, int cursorY, int cursorX);
 
+  /**
+   * @brief Apply a pending terminal resize: wait for the burst of signals
+   * to settle, resize the ncurses screen and force a full redraw. Scroll
+   * and ScrollHex call it, so the next frame clamps to the new size.
+   * @return false if no resize was pending.
+   */
+  bool Resize();
+
   /**
    * @brief Update view offsets (scrolling) based on cursor position.
+   * A view scrolled with ScrollView stays put until FollowCursor.
    */
   void Scroll(const Buffer &buffer, int cursorY, int cursorX);
 
+  /**
+   * @brief Scroll the view by rows (negative: up) without moving the
+   * cursor, as the mouse wheel does; folds count as one row.
+   */
+  void ScrollView(int rows, int lineCount);
+
+  /**
+   * @brief Let the view follow the cursor again after ScrollView.
+   */
+  void FollowCursor() { m_detached = false; }
+
+  /**
+   * @brief Show a one-line notice in the status bar (empty string clears).
+   */
+  void SetMessage(const std::string &message);
+
+  /**
+   * @brief Set the mode tag shown after the file details (e.g. "FOLLOW").
+   */
+  void SetMode(const std::string &mode);
+
+  /**
+   * @brief Highlight these ranges (sorted, non-overlapping; empty clears).
+   */
+  void SetSelections(std::vector<Buffer::Range> ranges);
+
+  /**
+   * @brief Mark these extra cursor positions (sorted; empty clears). The
+   * primary cursor is the terminal cursor and is not included.
+   */
+  void SetCursors(std::vector<Buffer::Position> cursors);
+
+  /**
+   * @brief Mark lines changed since the last save in the gutter ('+' added,
+   * '~' modified, '-' lines deleted below).
+   */
+  void SetChanges(std::shared_ptr<const DiffIndex::Hunks> changes);
+
+  /**
+   * @brief Underline these bracket positions (sorted; empty clears).
+   */
+  void SetBrackets(std::vector<Buffer::Position> brackets);
+
+  /**
+   * @brief Show only the header line of each fold.
+   */
+  void SetFolds(const FoldSet &folds);
+
+  /**
+   * @brief Draw lines as columns split at delimiter (0: as plain text),
+   * sized to widths (sampled by Table) or wider where rows on screen need.
+   */
+  void SetTable(char delimiter, std::shared_ptr<const Table::Widths> widths);
+
+  /**
+   * @brief Byte of line under screen column screenX (gutter included), in
+   * the text or table layout shown.
+   */
+  size_t ByteAtX(std::string_view line, int screenX);
+
+  /**
+   * @brief Scroll the hex view so the byte at cursor is visible.
+   */
+  void ScrollHex(const HexFile &file, uint64_t cursor);
+
+  /**
+   * @brief Render the hex view with the cursor on a byte.
+   * @param asciiPane The cursor is in the ASCII column, not the hex one.
+   * @param lowNibble In the hex column, on the second digit.
+   */
+  void RenderHex(const HexFile &file, uint64_t cursor, bool asciiPane,
+                 bool lowNibble);
+
+  /**
+   * @brief Render project search hits as "path:line: text" rows, the
+   * selected one highlighted and kept on screen, the match underlined.
+   * @param matchBytes Length of the text searched for.
+   * @param status Shown in the status bar (the count and progress).
+   */
+  void RenderHits(const std::vector<ProjectSearch::Hit> &hits,
+                  size_t selected, size_t matchBytes,
+                  const std::string &status);
+
+  /**
+   * @brief Hit shown on screen row screenY by the last RenderHits.
+   */
+  size_t HitAtRow(int screenY) const { return m_hitTop + (size_t)screenY; }
+
+  /**
+   * @brief Bytes per hex view row at the current width (a power of two).
+   */
+  int HexColumns() const;
+
+  /**
+   * @brief File line shown on screen row screenY (clamped to the last line).
+   */
+  int LineAtRow(int screenY, int lineCount) const;
+
   // Getters for screen dimensions
   int Rows() const;
   int Cols() const;
   int GetRowOff() const;
   int GetColOff() const;
   int GetGutterWidth() const;
+  void SetRowOff(int rowOff);
+  void SetColOff(int colOff);
 
 private:
   int m_screenRows;
   int m_screenCols;
 
+  // SIGWINCH count already applied, and the handler it replaced
+  int m_resizes;
+  struct sigaction m_oldWinch;
+
   // Scrolling offsets (top-left of the view)
   int m_rowOff;
   int m_colOff;
 
+  // Scrolled away from the cursor (wheel); Scroll leaves the view alone
+  bool m_detached;
+
   // Gutter width for line numbers
   int m_gutterWidth;
 
+  // Width and trimming kernels for the encoding of the buffer shown
+  const TextUtils::Kernels *m_text;
+
+  // Status bar notice, replaces the branding while set
+  std::string m_message;
+
+  // Mode tag, empty in normal editing
+  std::string m_mode;
+
+  // Highlighted ranges and extra cursors, both sorted by position
+  std::vector<Buffer::Range> m_selections;
+  std::vector<Buffer::Position> m_cursors;
+
+  // Changed lines from the diff against the saved file
+  std::shared_ptr<const DiffIndex::Hunks> m_changes;
+
+  // Bracket pair at the cursor, sorted
+  std::vector<Buffer::Position> m_brackets;
+
+  // Folded regions; rows step over them
+  FoldSet m_folds;
+
+  // Table view: delimiter (0: off), sampled widths, and the widths drawn,
+  // which only grow; m_pinned is the width of the pinned first column
+  char m_delimiter;
+  std::shared_ptr<const Table::Widths> m_sampled;
+  Table::Widths m_columns;
+  int m_pinned;
+  std::vector<Table::Field> m_fields; // Scratch for splitting a line
+  std::string m_layout;               // A row laid out as columns
+  std::string m_cell;                 // One field cut to its column
+
+  // Hit list: first hit shown
+  size_t m_hitTop;
+
+  // Hex view: offset of the first byte shown, and offset column digits
+  uint64_t m_hexTop;
+  int m_hexDigits;
+
+  // One row of text (or the status bar) as handed to ncurses; reused by
+  // every row of every frame
+  std::string m_row;
+
+  // Status bar segments and what they were built from
+  struct Status {
+    bool stale = true; // Message or mode changed
+    std::string file;
+    int lines = -1;
+    bool dirty = false;
+    std::string left;
+
+    int y = -1;
+    int x = -1;
+    size_t cursors = 0;
+    char right[64] = "";
+  } m_status;
+
   void DrawRows(const Buffer &buffer);
+  void DrawTableRow(int screenY, std::string_view line);
+  void FitColumns(const Buffer &buffer);
+  int ColumnWidth(size_t field) const;
+  int Column(std::string_view line, size_t x);
+  void DrawSelections(int screenY, int fileRow, std::string_view line);
+  void DrawCursors(int screenY, int fileRow, std::string_view line);
+  void DrawChange(int screenY, int fileRow, int lineCount);
+  void DrawBrackets(int screenY, int fileRow, std::string_view line);
+  void DrawFold(int screenY, const FoldSet::Fold &fold,
+                std::string_view line);
+  void Highlight(int screenY, int start, int end, unsigned attr);
   void DrawStatusBar(const Buffer &buffer, int cursorY, int cursorX);
+  void DrawStatusLine(std::string_view left, std::string_view right);
   void UpdateGutterWidth(int lineCount);
 };
 
@@ -9,8 +9,17 @@
 #define EDITOR_HPP
 
 #include "buffer.hpp"
+#include "diffindex.hpp"
 #include "display.hpp"
+#include "filewatcher.hpp"
+#include "folds.hpp"
+#include "projectsearch.hpp"
+#include "session.hpp"
+#include "structure.hpp"
+#include "table.hpp"
+#include "wordindex.hpp"
 #include <string>
+#include <vector>
 
 /**
  * @class Editor
@@ -19,7 +28,22 @@
  * Responsibilities:
  * - Run the main loop.
  * - Dispatch input to modifying actions.
- * - Maintain cursor position.
+ * - Maintain cursor positions and selections; edits made with several
+ *   cursors go to the Buffer as one batch (one undo step).
+ * - Hold the clipboard for cut/copy/paste.
+ * - Run bulk line operations (sort, unique, filter, reverse) on the
+ *   selected lines or the whole buffer.
+ * - React to changes made to the file by other processes.
+ * - Reopen a file where it was left: cursor, scroll and prompt history
+ *   come back from its Session.
+ * - Search the files of the project (Ctrl+F, or edit --grep) and open the
+ *   hit picked from the list at its match; the file being edited is saved
+ *   and closed first, as on quit.
+ * - Show delimited files as a table (Ctrl+E), where Ctrl+Left/Right step
+ *   between fields instead of words.
+ * - Feed edits to the background diff behind the gutter markers, to
+ *   the bracket/indent index behind matching and folding, and to the word
+ *   index behind completion.
  *
  * Safety:
  * - Ensures graceful exit.
@@ -36,9 +60,30 @@ public:
    */
   void Run(const std::string &path);
 
+  /**
+   * @brief Start in follow (tail) mode: appended lines stream in and the
+   * view sticks to the end while the cursor is on the last line.
+   */
+  void SetFollow(bool follow);
+
+  /**
+   * @brief Search the files under root for pattern and list the hits as
+   * they arrive; the one picked opens at its match and is edited as in
+   * Run. Returns at once if none is picked.
+   * @param threads Search workers, as for ProjectSearch::Start.
+   */
+  void Grep(const std::string &root, const std::string &pattern,
+            unsigned threads = 0);
+
 private:
   Buffer m_buffer;
   Display m_display; // RAII display
+  FileWatcher m_watcher;
+  DiffIndex m_diff; // Changes against the saved file
+  StructureIndex m_structure;
+  FoldSet m_folds;
+  WordIndex m_words;
+  Table m_table; // Table view: delimiter and sampled column widths
 
   // Cursor position (0-based)
   int m_cy;
@@ -46,14 +91,101 @@ private:
 
   bool m_running;
 
+  // Disk copy is newer than our unsaved edits; already reported
+  bool m_conflict;
+
+  // Follow (tail) mode for growing files
+  bool m_follow;
+
+  // Selection runs from the anchor to the cursor while m_selecting
+  bool m_selecting;
+  Buffer::Position m_anchor;
+
+  // Cut/copied text; shares storage with the buffer it came from
+  Buffer::Clip m_clipboard;
+
+  // A cursor besides the primary one (m_cy, m_cx, m_anchor, m_selecting)
+  struct Cursor {
+    Buffer::Position pos;
+    Buffer::Position anchor; // Selection start while selecting
+    bool selecting;
+  };
+
+  // Extra cursors, sorted by position, never on the primary's position
+  std::vector<Cursor> m_cursors;
+
+  // Completion being cycled: the prefix typed at m_completeAt and the
+  // candidate (m_completions[m_completion]) inserted after it
+  bool m_completing;
+  Buffer::Position m_completeAt;
+  std::string m_completePrefix;
+  std::vector<std::string> m_completions;
+  size_t m_completion;
+
+  // Answers accepted by Prompt, oldest first; kept in the file's Session
+  std::vector<std::string> m_history;
+
+  // Project search: the running (or last) search, its hits so far and the
+  // one selected in the list
+  ProjectSearch m_search;
+  std::string m_searchRoot;
+  std::string m_searchText;
+  std::vector<ProjectSearch::Hit> m_hits;
+  size_t m_hit;
+
+  // Cursor and width kernels for the buffer's current encoding
+  const TextUtils::Kernels &Text() const {
+    return TextUtils::KernelsFor(m_buffer.GetEncoding());
+  }
+
+  // Lifetime of one file: load it, edit it, remember where we were
+  void Open(const std::string &path);
+  void Loop();
+  void Close();
+
   // Actions
   void ProcessKey();
-  void MoveCursor(int keyType);
+  void MoveCursor(int keyType, bool extend);
+  Buffer::Position Step(Buffer::Position pos, int keyType) const;
+  std::vector<Cursor> AllCursors() const;
+  void SetCursors(const std::vector<Cursor> &all);
+  void EditAll(const std::string &text, bool backspace);
+  void AddCursorBelow();
+  void AddCursorsAtMatches();
+  void ColumnSelect();
+  void Undo(bool redo);
+  void SyncEdits();
+  void FileChanged(const Buffer::LineEdit &edit);
+  void FileReset();
+  void NextChange();
+  void JumpToBracket();
+  void ToggleFold();
+  void Complete();
+  void LineCommand();
+  void MemoryReport();
+  void SyncIngest(Buffer::IngestResult result, int lines);
+  void PumpStream(int line = -1);
+  void RestoreSession(const Session::State &session);
+  bool GetSelection(Buffer::Position &from, Buffer::Position &to) const;
+  bool DeleteSelection();
+  void Copy(bool cut);
+  void Paste();
   void InsertChar(int c);
   void InsertNewLine();
   void DeleteChar();
-  void Save();
+  bool Save();
+  bool Confirm(const std::string &question);
+  int Choose(const std::string &question, const std::string &keys);
+  bool Prompt(const std::string &question, std::string &answer);
+  void CheckExternalChange();
+  void FollowFile();
+  void ToggleFollow();
+  void ToggleTable();
+  void FindInFiles();
+  bool PickHit();
+  bool OpenHit(const ProjectSearch::Hit &hit);
   void HandleMouseClick(int screenY, int screenX);
+  void HandleMouseDrag(int screenY, int screenX);
 };
 
 #endif // EDITOR_HPP
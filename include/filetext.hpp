@@ -0,0 +1,77 @@
+/**
+ * @file filetext.hpp
+ * @brief FileText class declaration: a file's bytes as Buffer::Load reads
+ * them, for the background indexes that work from disk.
+ * @author rahuldangeofficial
+ */
+
+#ifndef FILETEXT_HPP
+#define FILETEXT_HPP
+
+#include "buffer.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class FileText
+ * @brief Read-only text of a file, split into lines the way the buffer
+ * splits it.
+ *
+ * Responsibilities:
+ * - Map a plain file, or inflate a compressed one into memory; or read
+ *   the pieces a buffer already inflated (Buffer::InflatedText), so a
+ *   compressed file is inflated once per load, not once per index.
+ * - Hand out its lines without "\n" or a "\r" before it.
+ *
+ * Notes:
+ * - A missing or unreadable file reads as empty; the buffer shows it as
+ *   one empty line, which callers account for.
+ * - Offsets run through the pieces as if they were one string; no line
+ *   spans two pieces.
+ * - Used by worker threads that must not touch the buffer (DiffIndex,
+ *   WordIndex, Table).
+ */
+class FileText {
+public:
+  /**
+   * @brief Read the file at path, or take inflated as its text if given.
+   * @throws std::runtime_error if a compressed file is corrupt.
+   */
+  explicit FileText(
+      const std::string &path,
+      std::shared_ptr<const Buffer::TextPieces> inflated = nullptr);
+  ~FileText();
+
+  FileText(const FileText &) = delete;
+  FileText &operator=(const FileText &) = delete;
+
+  size_t Size() const { return m_size; }
+
+  /**
+   * @brief The line starting at offset pos; pos moves past its "\n".
+   * @return Empty once pos is at or past the end.
+   */
+  std::string_view Line(size_t &pos) const;
+
+private:
+  struct Piece {
+    const char *data;
+    size_t start; // Offset of data[0]
+    size_t size;
+  };
+
+  std::vector<Piece> m_pieces;
+  std::shared_ptr<const Buffer::TextPieces> m_inflated;
+  std::string m_text; // A compressed file's text, inflated here
+  void *m_map;        // A plain file's mapping, or nullptr
+  size_t m_mapSize;
+  size_t m_size;
+  mutable size_t m_last; // Piece of the previous Line, tried first
+
+  void Add(const char *data, size_t size);
+};
+
+#endif // FILETEXT_HPP
@@ -0,0 +1,52 @@
+/**
+ * @file filewatcher.hpp
+ * @brief FileWatcher class declaration for noticing external file changes.
+ * @author rahuldangeofficial
+ */
+
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <string>
+
+/**
+ * @class FileWatcher
+ * @brief Reports when another process may have touched the edited file.
+ *
+ * Responsibilities:
+ * - Watch the file's directory with inotify (Linux), so in-place writes,
+ *   renames over the file (git checkout, atomic saves) and deletes are seen.
+ * - Drain pending events without blocking.
+ *
+ * Notes:
+ * - Events are hints; callers confirm with Buffer::ExternallyModified(),
+ *   which also filters out our own saves.
+ * - Without inotify every Poll() reports a possible change, so the stat
+ *   comparison does the work.
+ */
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  /**
+   * @brief Start watching path (replaces any previous watch).
+   */
+  void Watch(const std::string &path);
+
+  /**
+   * @brief Non-blocking check for events about the watched file.
+   * @return true if the file may have changed since the last call.
+   */
+  bool Poll();
+
+private:
+  int m_fd;    // inotify instance, -1 if unavailable
+  int m_wd;    // Watch descriptor on the parent directory
+  std::string m_name; // Base name to filter directory events by
+};
+
+#endif // FILEWATCHER_HPP
@@ -0,0 +1,88 @@
+/**
+ * @file folds.hpp
+ * @brief FoldSet class declaration: collapsed line ranges and movement over
+ * the lines that stay visible.
+ * @author rahuldangeofficial
+ */
+
+#ifndef FOLDS_HPP
+#define FOLDS_HPP
+
+#include "buffer.hpp"
+#include <vector>
+
+/**
+ * @class FoldSet
+ * @brief Disjoint folded regions, sorted by header line.
+ *
+ * Responsibilities:
+ * - Add and remove folds; a fold covering others absorbs them.
+ * - Step up and down over visible lines and count the visible lines in a
+ *   range, for the cursor, paging, scrolling and drawing.
+ * - Follow line edits: folds below shift, folds an edit reaches into open.
+ *
+ * Notes:
+ * - Every query costs a binary search per visible line or per fold
+ *   crossed; hidden lines are never visited.
+ */
+class FoldSet {
+public:
+  /// Line first stays visible as the fold's header; (first, last] hide.
+  struct Fold {
+    int first;
+    int last;
+  };
+
+  bool Empty() const { return m_folds.empty(); }
+  void Clear() { m_folds.clear(); }
+
+  /**
+   * @brief Fold lines (first, last] under first.
+   */
+  void Add(int first, int last);
+
+  /**
+   * @brief Open the fold headed by or hiding line y.
+   * @return false if there is none.
+   */
+  bool Remove(int y);
+
+  /**
+   * @brief The fold headed by line y, or nullptr.
+   */
+  const Fold *Find(int y) const;
+
+  /**
+   * @brief Line y if it is visible, else the header of the fold hiding it.
+   */
+  int Header(int y) const;
+
+  /**
+   * @brief The visible line n visible lines below (visible) line y, or
+   * the last visible line.
+   */
+  int Down(int y, int n, int lineCount) const;
+
+  /**
+   * @brief The visible line n visible lines above (visible) line y, or 0.
+   */
+  int Up(int y, int n) const;
+
+  /**
+   * @brief Number of visible lines in [from, to).
+   */
+  int Rows(int from, int to) const;
+
+  /**
+   * @brief Lines changed (from Buffer::TakeLineEdit or a reload).
+   */
+  void Edited(const Buffer::LineEdit &edit);
+
+private:
+  std::vector<Fold> m_folds;
+
+  /// Index of the last fold with first <= y, or -1.
+  int At(int y) const;
+};
+
+#endif // FOLDS_HPP
@@ -0,0 +1,51 @@
+/**
+ * @file hexeditor.hpp
+ * @brief HexEditor class declaration - main loop of the hex view.
+ * @author rahuldangeofficial
+ */
+
+#ifndef HEXEDITOR_HPP
+#define HEXEDITOR_HPP
+
+#include "display.hpp"
+#include "hexfile.hpp"
+#include <cstdint>
+#include <string>
+
+/**
+ * @class HexEditor
+ * @brief Controller for binary files: a HexFile shown by Display.
+ *
+ * Responsibilities:
+ * - Run the hex view loop: move a byte cursor, overwrite bytes as hex
+ *   digits or (in the ASCII column) as characters, undo.
+ * - Save patched pages on quit, as the text editor saves on quit.
+ *
+ * Safety:
+ * - A signal saves and exits, as in the text editor.
+ */
+class HexEditor {
+public:
+  HexEditor();
+
+  /**
+   * @brief Run the hex view loop.
+   * @param path File to view and patch.
+   */
+  void Run(const std::string &path);
+
+private:
+  HexFile m_file;
+  Display m_display;
+
+  uint64_t m_cursor; // Byte offset
+  bool m_asciiPane;  // Typing goes to the ASCII column
+  bool m_lowNibble;  // Next hex digit replaces the low nibble
+  bool m_running;
+
+  void ProcessKey();
+  void Move(int keyType);
+  void Type(int c);
+};
+
+#endif // HEXEDITOR_HPP
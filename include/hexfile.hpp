@@ -0,0 +1,108 @@
+/**
+ * @file hexfile.hpp
+ * @brief HexFile class declaration: a memory-mapped file with an overlay of
+ * patched bytes, for the hex view.
+ * @author rahuldangeofficial
+ */
+
+#ifndef HEXFILE_HPP
+#define HEXFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @class HexFile
+ * @brief Byte-addressed view of a file that is never decoded into lines.
+ *
+ * Responsibilities:
+ * - Map the file read-only; opening costs the same for 1 KB or 10 GB.
+ * - Keep edits as an overlay of patched bytes (offset -> byte) on top of
+ *   the mapping, with an undo journal.
+ * - Save by writing back only the pages that hold patches.
+ *
+ * Safety:
+ * - Saving writes pages in place (then fsync) rather than through a temp
+ *   file: rewriting a multi-GB file to change a few bytes is what this
+ *   mode avoids. Bytes are overwritten, never inserted or removed, so the
+ *   file keeps its size and layout.
+ *
+ * Notes:
+ * - The mapping is shared, so pages written by Save read back through it.
+ */
+class HexFile {
+public:
+  HexFile();
+  ~HexFile();
+
+  HexFile(const HexFile &) = delete;
+  HexFile &operator=(const HexFile &) = delete;
+
+  /**
+   * @brief Whether the start of the file looks binary rather than text
+   * (see TextUtils::LooksBinary). False if it cannot be read.
+   */
+  static bool LooksBinary(const std::string &path);
+
+  /**
+   * @brief Map the file.
+   * @throws std::runtime_error if it cannot be opened or mapped.
+   */
+  void Open(const std::string &path);
+
+  const std::string &GetFileName() const { return m_filename; }
+  uint64_t Size() const { return m_size; }
+  bool IsDirty() const { return !m_patches.empty(); }
+
+  /**
+   * @brief Copy bytes [offset, offset + n) with patches applied; n is
+   * clamped to the end of the file.
+   * @return Bytes copied.
+   */
+  size_t Read(uint64_t offset, uint8_t *out, size_t n) const;
+
+  /**
+   * @brief Whether the byte at offset differs from the file on disk.
+   */
+  bool IsPatched(uint64_t offset) const;
+
+  /**
+   * @brief Overwrite the byte at offset (ignored past the end).
+   */
+  void Set(uint64_t offset, uint8_t byte);
+
+  /**
+   * @brief Revert the last Set.
+   * @param offset Receives the byte it changed.
+   * @return false if there is nothing to undo.
+   */
+  bool Undo(uint64_t &offset);
+
+  /**
+   * @brief Write every patched page back to the file and fsync it.
+   * @return Pages written.
+   * @throws std::runtime_error on I/O failure; patches are kept.
+   */
+  size_t Save();
+
+private:
+  struct Change {
+    uint64_t offset;
+    bool patched;  // The offset was already patched before
+    uint8_t value; // Its patch value then
+  };
+
+  std::string m_filename;
+  int m_fd;
+  const uint8_t *m_map;
+  uint64_t m_size;
+  std::map<uint64_t, uint8_t> m_patches;
+  std::vector<Change> m_undo;
+
+  void Close();
+};
+
+#endif // HEXFILE_HPP
@@ -0,0 +1,110 @@
+/**
+ * @file indexcache.hpp
+ * @brief IndexCache class declaration for the persistent line index sidecar.
+ * @author rahuldangeofficial
+ */
+
+#ifndef INDEXCACHE_HPP
+#define INDEXCACHE_HPP
+
+#include "buffer.hpp"
+#include "textutils.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class IndexCache
+ * @brief Line-offset checkpoints for large files, kept between sessions.
+ *
+ * Responsibilities:
+ * - Store, per file, the offset of every CHECKPOINT_LINES-th line plus the
+ *   encoding and width summary, under $XDG_CACHE_HOME/edit/index/.
+ * - Map a stored sidecar back in and decide whether it still applies:
+ *   exactly (same inode, size and mtime) or as a prefix of a file that has
+ *   only been appended to.
+ *
+ * Notes:
+ * - The sidecar is mmap'ed; checkpoints are read straight from the mapping.
+ * - Any mismatch or I/O error simply means "no cache"; it is never fatal.
+ * - Set EDIT_NO_INDEX_CACHE=1 to disable reading and writing sidecars.
+ */
+class IndexCache {
+public:
+  /// How a sidecar relates to the file currently on disk.
+  enum class Match { None, Exact, Appended };
+
+  /// File-wide facts recorded alongside the checkpoints.
+  struct Summary {
+    uint64_t size = 0;        // File bytes the index covers
+    uint64_t lineCount = 0;
+    uint64_t longestLine = 0; // Bytes, terminator excluded
+    TextUtils::Utf8Stats utf8;
+    int firstTerm = 0;        // 0 none, 1 "\n", 2 "\r\n"
+    bool finalNewline = false;
+  };
+
+  IndexCache();
+  ~IndexCache();
+
+  IndexCache(const IndexCache &) = delete;
+  IndexCache &operator=(const IndexCache &) = delete;
+
+  /**
+   * @brief Whether a file of this size should use the cache at all.
+   */
+  static bool Enabled(uint64_t size);
+
+  /**
+   * @brief Map the sidecar for path and match it against the open file.
+   * @param disk Identity of the file as just opened.
+   * @param fd Open descriptor, used to verify an append-only change.
+   */
+  Match Open(const std::string &path, const Buffer::DiskState &disk, int fd);
+
+  const Summary &GetSummary() const { return m_summary; }
+
+  /// Offsets of lines 0, CHECKPOINT_LINES, 2 * CHECKPOINT_LINES, ...
+  const uint64_t *Checkpoints() const { return m_checkpoints; }
+  size_t CheckpointCount() const { return m_count; }
+
+  /**
+   * @brief Atomically write a sidecar (best effort; errors are ignored).
+   * @param fd Open descriptor, used to fingerprint the tail for append checks.
+   */
+  static void Store(const std::string &path, const Buffer::DiskState &disk,
+                    const Summary &summary,
+                    const std::vector<uint64_t> &checkpoints, int fd);
+
+  /**
+   * @brief Delete the sidecar for path, e.g. after it proved inconsistent.
+   */
+  static void Discard(const std::string &path);
+
+  /**
+   * @brief realpath() of path, or path itself if it does not resolve.
+   */
+  static std::string Canonical(const std::string &path);
+
+  /**
+   * @brief Where per-file cache data of one kind lives:
+   * $XDG_CACHE_HOME/edit/<kind>/<hash of canonical><extension>, or ""
+   * if there is no cache directory. Shared by the sidecar and Session.
+   */
+  static std::string EntryPath(const std::string &canonical,
+                               const char *kind, const char *extension);
+
+  /**
+   * @brief mkdir -p, mode 0700: paths of edited files are private.
+   */
+  static bool MakeDirs(const std::string &dir);
+
+private:
+  void *m_map;
+  size_t m_mapSize;
+  Summary m_summary;
+  const uint64_t *m_checkpoints;
+  size_t m_count;
+};
+
+#endif // INDEXCACHE_HPP
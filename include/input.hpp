@@ -24,16 +24,38 @@ enum KeyType {
   K_HOME,
   K_END,
   K_DELETE,
-  K_ESC,
-  K_QUIT, // Ctrl-Q
-  K_MOUSE // Mouse click
+  K_ESC,    // Collapses extra cursors, otherwise quits
+  K_QUIT,   // Ctrl-Q
+  K_MOUSE,      // Mouse button press
+  K_MOUSE_DRAG, // Mouse moved (or released) with the button held
+  K_FOLLOW,     // Ctrl-T: toggle follow (tail) mode
+  K_COPY,       // Ctrl-C
+  K_CUT,        // Ctrl-X
+  K_PASTE,      // Ctrl-V
+  K_UNDO,       // Ctrl-Z
+  K_REDO,       // Ctrl-Y
+  K_ADD_CURSOR, // Ctrl-N: add a cursor on the line below
+  K_MATCHES,    // Ctrl-D: a cursor at each match of the selection or word
+  K_COLUMN,     // Ctrl-L: turn the selection into a column selection
+  K_NEXT_CHANGE, // Ctrl-G: jump to the next changed line
+  K_BRACKET,     // Ctrl-B: jump to the matching bracket
+  K_FOLD,        // Ctrl-K: fold or unfold the block at the cursor
+  K_WORD_LEFT,   // Ctrl-Left: start of the previous word
+  K_WORD_RIGHT,  // Ctrl-Right: end of the next word
+  K_COMPLETE,    // Ctrl-P: complete the word before the cursor (again: next)
+  K_LINES,       // Ctrl-O: sort, unique, filter or reverse lines
+  K_MEMORY,      // Ctrl-R: report memory use per subsystem
+  K_WHEEL,       // Mouse wheel: scroll the view by value rows (< 0: up)
+  K_TABLE,       // Ctrl-E: toggle the table (aligned columns) view
+  K_FIND         // Ctrl-F: search the files under the working directory
 };
 
 struct Key {
   KeyType type;
-  int value;  // ASCII value if type == K_CHAR
-  int mouseY; // Screen row if type == K_MOUSE
-  int mouseX; // Screen col if type == K_MOUSE
+  int value;  // ASCII value if type == K_CHAR, rows if K_WHEEL
+  int mouseY; // Screen row if type == K_MOUSE / K_MOUSE_DRAG
+  int mouseX; // Screen col if type == K_MOUSE / K_MOUSE_DRAG
+  bool shift; // Shift held with a movement key (extends the selection)
 };
 } // namespace Edit
 
@@ -44,6 +66,7 @@ struct Key {
  * Responsibilities:
  * - Read character from ncurses.
  * - Translate raw int to internal Key type.
+ * - Merge a burst of queued wheel events into one (one frame per flick).
  */
 class Input {
 public:
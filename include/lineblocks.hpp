@@ -0,0 +1,183 @@
+/**
+ * @file lineblocks.hpp
+ * @brief LineBlocks class template: the buffer's lines cut into blocks of
+ * about a target size, each carrying an index's summary of its lines.
+ * @author rahuldangeofficial
+ */
+
+#ifndef LINEBLOCKS_HPP
+#define LINEBLOCKS_HPP
+
+#include "buffer.hpp"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+/**
+ * @class LineBlocks
+ * @brief Runs of consecutive lines with a payload T per run, kept in step
+ * with the buffer's line edits.
+ *
+ * Responsibilities:
+ * - Split lineCount lines into blocks of the target size.
+ * - Apply a Buffer::LineEdit by re-splitting only the run of blocks it
+ *   touched; a short tail takes the next block in, so blocks do not
+ *   fragment. Replaced blocks are handed to the caller first and the new
+ *   ones start from T().
+ * - Find the block holding a line by binary search over cached first
+ *   lines. An edit forgets the cache from its block on, and a lookup
+ *   extends it only as far as the line it wants, so typing and looking up
+ *   around the cursor cost the blocks in between, not the file.
+ *
+ * Notes:
+ * - Used by the indexes that summarise the buffer a block at a time
+ *   (StructureIndex, WordIndex) and by DiffIndex for its copy of the
+ *   current lines; not thread-safe.
+ */
+template <typename T> class LineBlocks {
+public:
+  struct Block {
+    int lines;
+    T data;
+  };
+
+  explicit LineBlocks(int target)
+      : m_target(target), m_lineCount(0), m_known(0) {}
+
+  /**
+   * @brief Forget every block; there are now lineCount lines.
+   */
+  void Reset(int lineCount) {
+    m_blocks.clear();
+    m_lineCount = lineCount;
+    for (int left = lineCount; left > 0; left -= m_target)
+      m_blocks.push_back({std::min(left, m_target), T()});
+    m_first.resize(m_blocks.size());
+    m_known = 0;
+  }
+
+  /**
+   * @brief Lines changed; drop(block) is called for each block replaced,
+   * in order. An edit that does not fit the current lines replaces every
+   * block.
+   * @return Index of the first new block (the run's lines start at the
+   * same line as before).
+   */
+  template <typename Drop>
+  size_t Edited(const Buffer::LineEdit &edit, Drop drop) {
+    int lineCount = m_lineCount - edit.removed + edit.added;
+
+    // The run of blocks the edit touched, and how many lines it now holds
+    size_t b = 0, last = m_blocks.size();
+    int total;
+    if (!m_blocks.empty() && edit.first >= 0 && edit.removed >= 0 &&
+        edit.added >= 0 && edit.first + edit.removed <= m_lineCount) {
+      int blockFirst;
+      b = Locate(std::min(edit.first, m_lineCount - 1), blockFirst);
+      int left = edit.removed + edit.first - blockFirst;
+      total = edit.added - edit.removed;
+      for (last = b; last < m_blocks.size() && (last == b || left > 0);
+           ++last) {
+        total += m_blocks[last].lines;
+        left -= m_blocks[last].lines;
+      }
+      int tail = total % m_target;
+      if ((total == 0 || (tail > 0 && tail < m_target / 2)) &&
+          last < m_blocks.size())
+        total += m_blocks[last++].lines;
+    } else {
+      total = lineCount = std::max(lineCount, 1);
+    }
+    m_lineCount = lineCount;
+
+    for (size_t i = b; i < last; ++i)
+      drop(m_blocks[i]);
+    std::vector<Block> split;
+    for (int n = total; n > 0; n -= m_target)
+      split.push_back({std::min(n, m_target), T()});
+
+    // Overwrite the run in place and move the tail only if its length
+    // changed, which an edit inside one block seldom does
+    size_t keep = std::min(split.size(), last - b);
+    std::move(split.begin(), split.begin() + keep, m_blocks.begin() + b);
+    if (split.size() > keep)
+      m_blocks.insert(m_blocks.begin() + last,
+                      std::make_move_iterator(split.begin() + keep),
+                      std::make_move_iterator(split.end()));
+    else
+      m_blocks.erase(m_blocks.begin() + b + keep, m_blocks.begin() + last);
+    m_first.resize(m_blocks.size());
+    m_known = std::min(m_known, b);
+    return b;
+  }
+
+  /**
+   * @brief Index of the block holding line y, and its first line; Size()
+   * and LineCount() past the last line.
+   */
+  size_t Locate(int y, int &blockFirst) {
+    if (y >= m_lineCount) {
+      blockFirst = m_lineCount;
+      return m_blocks.size();
+    }
+    while (KnownEnd() <= y)
+      Learn();
+    size_t b = (size_t)(std::upper_bound(m_first.begin(),
+                                         m_first.begin() + m_known, y) -
+                        m_first.begin());
+    b = b > 0 ? b - 1 : 0;
+    blockFirst = m_first[b];
+    return b;
+  }
+
+  /**
+   * @brief First line of block b.
+   */
+  int First(size_t b) {
+    while (m_known <= b)
+      Learn();
+    return m_first[b];
+  }
+
+  size_t Size() const { return m_blocks.size(); }
+  int LineCount() const { return m_lineCount; }
+  Block &operator[](size_t b) { return m_blocks[b]; }
+  const Block &operator[](size_t b) const { return m_blocks[b]; }
+  typename std::vector<Block>::iterator begin() { return m_blocks.begin(); }
+  typename std::vector<Block>::iterator end() { return m_blocks.end(); }
+  typename std::vector<Block>::const_iterator begin() const {
+    return m_blocks.begin();
+  }
+  typename std::vector<Block>::const_iterator end() const {
+    return m_blocks.end();
+  }
+
+  /**
+   * @brief Heap bytes of the blocks and the first-line cache (not what
+   * the payloads own).
+   */
+  size_t MemoryBytes() const {
+    return m_blocks.capacity() * sizeof(Block) +
+           m_first.capacity() * sizeof(int);
+  }
+
+private:
+  std::vector<Block> m_blocks;
+  std::vector<int> m_first; // First line of each block, valid below m_known
+  int m_target;
+  int m_lineCount;
+  size_t m_known;
+
+  /// Line just past the blocks whose first line is known.
+  int KnownEnd() const {
+    return m_known == 0 ? 0
+                        : m_first[m_known - 1] + m_blocks[m_known - 1].lines;
+  }
+
+  void Learn() {
+    m_first[m_known] = KnownEnd();
+    m_known++;
+  }
+};
+
+#endif // LINEBLOCKS_HPP
@@ -0,0 +1,68 @@
+/**
+ * @file lineops.hpp
+ * @brief LineOps class declaration: sort, unique, filter and reverse over
+ * whole lines of a Buffer.
+ * @author rahuldangeofficial
+ */
+
+#ifndef LINEOPS_HPP
+#define LINEOPS_HPP
+
+#include "buffer.hpp"
+#include "constants.hpp"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @class LineOps
+ * @brief Bulk line operations, applied as one Buffer::ReorderLines.
+ *
+ * Responsibilities:
+ * - Work out the new order of a range of lines: sorted (bytewise or by
+ *   leading number, stable), first occurrences only, lines containing or
+ *   not containing a pattern, or reversed.
+ * - Sort line indices paired with a fixed-size key (the first 8 bytes,
+ *   the number or the hash of the line), never line copies; the text is
+ *   only consulted when keys tie. Runs are sorted in parallel and merged
+ *   pairwise in parallel. When the pairs and their merge scratch would
+ *   exceed the memory budget, sorted runs are spilled to a temporary file
+ *   and merged back from there.
+ *
+ * Notes:
+ * - Lines are read through Buffer::GetLine, which is safe from several
+ *   threads while nothing mutates the buffer.
+ * - Numbers are an optional sign, digits and a decimal point after
+ *   leading blanks; a line without one sorts as 0 (as sort -n does).
+ */
+class LineOps {
+public:
+  enum class Op { Sort, SortNumeric, Unique, Keep, Remove, Reverse };
+
+  /**
+   * @brief Order of lines [first, first + count) after op.
+   * @param pattern Substring for Keep and Remove.
+   * @param pool Workers to use; nullptr runs serially.
+   * @param memoryBudget Bytes of sort pairs and scratch to hold before
+   * spilling.
+   * @return Indices relative to first, each at most once.
+   * @throws std::runtime_error if a spill file cannot be written or read.
+   */
+  static std::vector<uint32_t>
+  Plan(const Buffer &buffer, int first, int count, Op op,
+       std::string_view pattern, ThreadPool *pool,
+       size_t memoryBudget = Edit::LINE_OP_MEMORY);
+
+  /**
+   * @brief Plan and apply the result as one undo step.
+   * @param threads As Buffer::Load: 0 uses the shared pool, 1 runs inline.
+   * @return Number of lines the range holds afterwards.
+   */
+  static int Apply(Buffer &buffer, int first, int count, Op op,
+                   std::string_view pattern = std::string_view(),
+                   unsigned threads = 0);
+};
+
+#endif // LINEOPS_HPP
@@ -0,0 +1,147 @@
+/**
+ * @file linestore.hpp
+ * @brief LineStore class declaration: the buffer's line index, packed into
+ * blocks of lines with one base offset each.
+ * @author rahuldangeofficial
+ */
+
+#ifndef LINESTORE_HPP
+#define LINESTORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class LineStore
+ * @brief Where each line of a Buffer lives: a span of the source space or
+ * an edit slot, in blocks of about BLOCK_LINES lines.
+ *
+ * Responsibilities:
+ * - Keep 8 bytes per line: a 32-bit offset from its block's base, a 30-bit
+ *   length and the 2-bit terminator (an edited line keeps its slot in the
+ *   offset instead).
+ * - Replace a run of lines by editing the block it lies in, or by cutting
+ *   only the blocks it touches anew, so splitting or joining a line costs
+ *   the same whatever the line count.
+ * - Find the block holding a line through a Fenwick tree of block sizes.
+ *
+ * Safety:
+ * - Const members may run on several threads at once (parallel sorts and
+ *   hashes read lines); nothing may change the store meanwhile, except
+ *   Fill on blocks nobody reads yet.
+ *
+ * Notes:
+ * - A block's lines are spans within 4 GB of its base; a line that does
+ *   not fit starts a block of its own. Source offsets themselves are
+ *   64-bit.
+ */
+class LineStore {
+public:
+  /// One line, unpacked.
+  struct Ref {
+    size_t offset; // Offset in the source space (unused when slot >= 0)
+    size_t length; // Content length in bytes, terminator excluded
+    int32_t slot;  // Index into the edit slots, or -1 for a source span
+    uint8_t term;  // 0 (none), 1 ("\n") or 2 ("\r\n") in the source
+  };
+
+  /// Lines per block when lines are added in order (and Blank's blocks).
+  static constexpr int BLOCK_LINES = 2048;
+
+  /// Longest source span a line can be.
+  static constexpr size_t MAX_LENGTH = (1u << 30) - 2;
+
+  LineStore();
+
+  int Count() const { return m_count; }
+
+  /// Line y, which must exist.
+  Ref Get(int y) const;
+
+  /// Overwrite line y, which must exist.
+  void Set(int y, const Ref &ref);
+
+  /**
+   * @brief Replace lines [first, first + count) with lines[0, n).
+   * @throws std::runtime_error for a span longer than MAX_LENGTH.
+   */
+  void Replace(int first, int count, const Ref *lines, size_t n);
+  void Replace(int first, int count, const std::vector<Ref> &lines) {
+    Replace(first, count, lines.data(), lines.size());
+  }
+
+  /// Add a line at the end.
+  void Push(const Ref &ref);
+
+  /// Move the lines of other to the end; other is left empty.
+  void Append(LineStore &&other);
+
+  /// Add delta to every source offset (lines indexed from 0 in a block of
+  /// their own, before they join a buffer).
+  void Shift(size_t delta);
+
+  /// Add count empty lines at the end of an empty store, in blocks of
+  /// exactly BLOCK_LINES, for Fill to complete later.
+  void Blank(int count);
+
+  /**
+   * @brief Fill Blank lines [first, first + n); first is a multiple of
+   * BLOCK_LINES and the run ends at a block end or at the last line.
+   * Safe beside readers of other blocks.
+   * @return false if a block's spans were not within 4 GB of each other;
+   * those lines are left empty.
+   */
+  bool Fill(int first, const Ref *lines, size_t n);
+
+  void Clear();
+
+  /// Call fn(ref) for each line in order.
+  template <typename Fn> void ForEach(Fn fn) const {
+    for (const Block &block : m_blocks) {
+      for (const Entry &entry : block.entries)
+        fn(Unpack(block, entry));
+    }
+  }
+
+  /// Heap bytes of the blocks and the tree (allocated capacity).
+  size_t MemoryBytes() const;
+
+private:
+  struct Entry {
+    uint32_t offset;      // From the block's base, or the edit slot
+    uint32_t length : 30; // SLOT for an edited line
+    uint32_t term : 2;
+  };
+
+  struct Block {
+    size_t base;
+    std::vector<Entry> entries;
+  };
+
+  std::vector<Block> m_blocks;
+  std::vector<int> m_tree; // Fenwick tree of block sizes, 1-based
+  size_t m_top;            // Highest power of two <= block count
+  int m_count;
+
+  static bool Fits(const Block &block, const Ref &ref);
+  static Entry Pack(const Block &block, const Ref &ref);
+  static Ref Unpack(const Block &block, const Entry &entry);
+
+  // Block holding line y (< Count()) and y's index in it
+  size_t Locate(int y, int &at) const;
+
+  // Cut run into blocks replacing [b, e), taking a neighbour in if short
+  void Rebuild(size_t b, size_t e, std::vector<Ref> run);
+
+  // Re-cut block b once it has grown too big or shrunk too small
+  void Rebalance(size_t b);
+
+  // Append lines [from, to) of block b to out
+  void Unpack(size_t b, size_t from, size_t to, std::vector<Ref> &out) const;
+  void AddBlock(Block block);
+  void AddLines(size_t b, int delta);
+  void BuildTree();
+};
+
+#endif // LINESTORE_HPP
@@ -0,0 +1,110 @@
+/**
+ * @file projectsearch.hpp
+ * @brief ProjectSearch class declaration: literal search across the files
+ * of a directory tree, in the background.
+ * @author rahuldangeofficial
+ */
+
+#ifndef PROJECTSEARCH_HPP
+#define PROJECTSEARCH_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ProjectSearch
+ * @brief Finds a literal string in every text file under a directory.
+ *
+ * Responsibilities:
+ * - Walk the tree, skipping .git and whatever the .gitignore files met on
+ *   the way exclude.
+ * - Map each file and scan it whole with TextUtils::Find (the matcher of
+ *   the in-buffer searches), skipping files that look binary.
+ * - Spread the files over a ThreadPool of its own (never the shared one
+ *   the editor's foreground work uses): workers take the next file as they
+ *   finish one, so a few huge files do not hold up the rest.
+ * - Hand out hits while the search runs (Take), one per matching line.
+ *
+ * Notes:
+ * - .gitignore support covers globs, '!' negation, trailing '/' for
+ *   directories, anchored patterns and leading or trailing "**".
+ * - Symbolic links are not followed, so a tree is never searched twice.
+ * - Hits stop at Edit::SEARCH_MAX_HITS; Capped() then reports it.
+ */
+class ProjectSearch {
+public:
+  struct Hit {
+    std::string path; // The root joined with the file's path below it
+    int line;         // 0-based
+    int column;       // Byte of the match in the line
+    std::string text; // The line, cut to Edit::SEARCH_LINE_BYTES
+  };
+
+  ProjectSearch();
+  ~ProjectSearch();
+
+  ProjectSearch(const ProjectSearch &) = delete;
+  ProjectSearch &operator=(const ProjectSearch &) = delete;
+
+  /**
+   * @brief Search the files under root for pattern in the background.
+   * @param threads Workers; 0 sizes the pool to the machine.
+   */
+  void Start(const std::string &root, const std::string &pattern,
+             unsigned threads = 0);
+
+  /**
+   * @brief Stop searching (hits found so far are kept).
+   */
+  void Cancel();
+
+  /**
+   * @brief Append the hits found since the last call to hits.
+   * @return How many were appended.
+   */
+  size_t Take(std::vector<Hit> &hits);
+
+  /**
+   * @brief Block until there are hits to take, the search ended or
+   * milliseconds passed.
+   */
+  void Wait(int milliseconds);
+
+  /**
+   * @brief Every file has been searched (or the search was cancelled).
+   */
+  bool Done() const { return m_done; }
+
+  /**
+   * @brief The hit limit was reached and the search stopped early.
+   */
+  bool Capped() const { return m_capped; }
+
+  /**
+   * @brief Files searched and bytes scanned so far.
+   */
+  size_t Files() const { return m_files; }
+  size_t Bytes() const { return m_bytes; }
+
+private:
+  std::thread m_worker;
+  std::atomic<bool> m_cancel;
+  std::atomic<bool> m_done;
+  std::atomic<bool> m_capped;
+  std::atomic<size_t> m_files;
+  std::atomic<size_t> m_bytes;
+  std::atomic<size_t> m_found; // Hits produced, taken or not
+
+  std::mutex m_mutex;
+  std::condition_variable m_ready;
+  std::vector<Hit> m_pending; // Found, not taken yet
+
+  void Search(const std::string &path, const std::string &pattern);
+  void Deliver(std::vector<Hit> &hits);
+};
+
+#endif // PROJECTSEARCH_HPP
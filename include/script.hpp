@@ -0,0 +1,88 @@
+/**
+ * @file script.hpp
+ * @brief Script class declaration for headless batch editing.
+ * @author rahuldangeofficial
+ */
+
+#ifndef SCRIPT_HPP
+#define SCRIPT_HPP
+
+#include "buffer.hpp"
+#include "lineops.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * @class Script
+ * @brief A list of buffer operations applied to many files without a UI.
+ *
+ * Script syntax, one operation per line ('#' starts a comment):
+ *
+ *     goto LINE [COL]      1-based; LINE may be '$' for the last line
+ *     insert TEXT          at the cursor, which moves past the text
+ *     delete COUNT         characters forward (a line break counts as one)
+ *     replace OLD NEW      every occurrence, on every line
+ *     sort [numeric]       every line, stably (see LineOps)
+ *     unique               drop repeated lines, keeping the first
+ *     keep TEXT            drop lines not containing TEXT
+ *     drop TEXT            drop lines containing TEXT
+ *     reverse              every line
+ *
+ * TEXT, OLD and NEW are single words or "double-quoted" strings with
+ * \n, \t, \" and \\ escapes. Columns count characters, not bytes.
+ *
+ * Responsibilities:
+ * - Parse and validate a script once, up front.
+ * - Apply it through the same Buffer API the editor uses.
+ * - Run it over a file list on a worker pool, saving changed files with
+ *   Buffer::Save (atomic).
+ *
+ * Safety:
+ * - A failing file is reported and skipped; others are unaffected.
+ * - Unchanged files are never rewritten.
+ */
+class Script {
+public:
+  /// Totals reported after a batch run.
+  struct Result {
+    size_t files = 0;   // Processed (changed, unchanged or failed)
+    size_t changed = 0; // Saved with modifications
+    size_t failed = 0;
+    double seconds = 0;
+  };
+
+  /**
+   * @brief Read and parse a script file.
+   * @throws std::runtime_error with the offending line on syntax errors.
+   */
+  void Load(const std::string &path);
+
+  /**
+   * @brief Apply every operation to the buffer, starting at line 1.
+   */
+  void Apply(Buffer &buffer) const;
+
+  /**
+   * @brief Load, apply and save each file in parallel.
+   * @param threads Worker count; 0 uses the shared pool.
+   * @param errors Receives one "path: reason" line per failed file.
+   */
+  Result Run(const std::vector<std::string> &files, unsigned threads,
+             std::vector<std::string> &errors) const;
+
+private:
+  enum class OpType { Goto, Insert, Delete, Replace, Lines };
+
+  struct Op {
+    OpType type;
+    int line;         // Goto: 1-based, or -1 for '$'
+    int count;        // Goto: column; Delete: characters
+    std::string text; // Insert text, or Replace needle
+    std::string with; // Replace substitute
+    LineOps::Op lines; // Lines: the operation; text holds its pattern
+  };
+
+  std::vector<Op> m_ops;
+};
+
+#endif // SCRIPT_HPP
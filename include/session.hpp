@@ -0,0 +1,54 @@
+/**
+ * @file session.hpp
+ * @brief Session class declaration for per-file view state kept between
+ * runs.
+ * @author rahuldangeofficial
+ */
+
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * @class Session
+ * @brief Where the user was in a file when the editor last closed it.
+ *
+ * Responsibilities:
+ * - Remember, per file, the cursor, the scroll offsets and the answers
+ *   given to the line filter prompt, under $XDG_CACHE_HOME/edit/session/.
+ * - Hand them back on the next run, before the file is loaded, so the
+ *   first frame is drawn where the last one was.
+ *
+ * Notes:
+ * - Records are keyed like the line index sidecar (IndexCache::EntryPath)
+ *   and written with the same temp + rename dance; a missing or damaged
+ *   record simply means "start at the top".
+ * - Set EDIT_NO_SESSION=1 to disable reading and writing records.
+ */
+class Session {
+public:
+  struct State {
+    int cy = 0; // Cursor line
+    int cx = 0; // Cursor byte in the line
+    int rowOff = 0;
+    int colOff = 0;
+    std::vector<std::string> history; // Prompt answers, oldest first
+  };
+
+  /**
+   * @brief Read the record for path.
+   * @return false if there is none, or it is damaged (negative
+   * positions); state is then untouched.
+   */
+  static bool Read(const std::string &path, State &state);
+
+  /**
+   * @brief Atomically write the record for path (best effort; errors are
+   * ignored). A state with nothing to restore deletes the record instead.
+   */
+  static void Write(const std::string &path, const State &state);
+};
+
+#endif // SESSION_HPP
@@ -0,0 +1,97 @@
+/**
+ * @file structure.hpp
+ * @brief StructureIndex class declaration: bracket depth and indentation
+ * checkpoints for bracket matching and folding.
+ * @author rahuldangeofficial
+ */
+
+#ifndef STRUCTURE_HPP
+#define STRUCTURE_HPP
+
+#include "buffer.hpp"
+#include "lineblocks.hpp"
+#include <climits>
+
+/**
+ * @class StructureIndex
+ * @brief Per-block summaries of bracket nesting and indentation.
+ *
+ * Responsibilities:
+ * - Split the buffer into blocks of about BLOCK_LINES lines and keep, for
+ *   each, the net bracket depth change, the lowest depth reached inside it
+ *   and the smallest indentation of its non-blank lines.
+ * - Find the partner of a bracket by skipping whole blocks that cannot
+ *   contain it, so a match 200k lines away visits a few hundred summaries
+ *   and two or three blocks of text.
+ * - Find the extent of a foldable region (bracket pair or indented block).
+ *
+ * Notes:
+ * - Blocks are summarised lazily on first use and re-summarised only when
+ *   an edit touches them; nothing is scanned at load time.
+ * - (), [] and {} share one depth, and brackets inside strings and
+ *   comments count too: the index is language-agnostic.
+ * - Only used from the UI thread.
+ */
+class StructureIndex {
+public:
+  StructureIndex();
+
+  /**
+   * @brief Forget everything; the buffer now has lineCount lines.
+   */
+  void Reset(int lineCount);
+
+  /**
+   * @brief Lines changed (from Buffer::TakeLineEdit or a reload).
+   */
+  void Edited(const Buffer::LineEdit &edit);
+
+  /**
+   * @brief Find the bracket matching the one at the cursor (or just
+   * before it).
+   * @param pair Receives the bracket (from) and its partner (to).
+   * @param scanLimit Give up rather than summarise more lines than this.
+   * @return false if there is no bracket or no partner.
+   */
+  bool FindMatch(const Buffer &buffer, Buffer::Position cursor,
+                 Buffer::Range &pair, int scanLimit = INT_MAX);
+
+  /**
+   * @brief Last line of the region that folds under line y: up to the line
+   * before the partner of the line's last unclosed bracket, otherwise the
+   * following lines indented deeper than y.
+   * @return y if there is nothing to fold.
+   */
+  int FoldEnd(const Buffer &buffer, int y);
+
+  /**
+   * @brief Heap bytes of the block summaries.
+   */
+  size_t MemoryBytes() const { return m_blocks.MemoryBytes(); }
+
+private:
+  /// Bracket and indentation facts about a line or a block of lines.
+  struct Summary {
+    int delta;     // Openers minus closers
+    int minPrefix; // Lowest running depth, counting the empty prefix (<= 0)
+    int minIndent; // Smallest indentation of a non-blank line, or INT_MAX
+  };
+
+  struct Scan {
+    bool scanned = false; // summary is valid
+    Summary summary = {};
+  };
+
+  LineBlocks<Scan> m_blocks;
+
+  static Summary Measure(std::string_view line);
+  const Summary *Summarize(const Buffer &buffer, size_t b, int blockFirst,
+                           int &budget);
+  void Sync(const Buffer &buffer);
+  bool MatchForward(const Buffer &buffer, Buffer::Position from,
+                    Buffer::Position &match, int budget);
+  bool MatchBackward(const Buffer &buffer, Buffer::Position from,
+                     Buffer::Position &match, int budget);
+};
+
+#endif // STRUCTURE_HPP
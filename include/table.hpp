@@ -0,0 +1,139 @@
+/**
+ * @file table.hpp
+ * @brief Table class declaration: delimiter detection, field splitting and
+ * sampled column widths behind the table view of CSV/TSV files.
+ * @author rahuldangeofficial
+ */
+
+#ifndef TABLE_HPP
+#define TABLE_HPP
+
+#include "buffer.hpp"
+#include "textutils.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class Table
+ * @brief Delimited text (CSV, TSV, ...) seen as columns.
+ *
+ * Responsibilities:
+ * - Guess the delimiter (comma, tab, semicolon or pipe) from the first
+ *   lines of the buffer.
+ * - Split a line into fields, honouring double-quoted fields that contain
+ *   the delimiter.
+ * - Measure column widths on a background thread from a bounded sample of
+ *   rows: the head of the file plus short runs spread evenly through it,
+ *   read from the file on disk. Widths are published as they grow, so the
+ *   first frame never waits for them.
+ *
+ * Notes:
+ * - However big the file, at most Edit::TABLE_SAMPLE_ROWS rows are read;
+ *   the Display widens columns further for the rows it actually draws.
+ * - Quoted fields spanning lines are not joined: each line is a row.
+ * - A compressed file is not sampled (its bytes on disk are not the
+ *   text); its columns come from the rows drawn only.
+ */
+class Table {
+public:
+  /// Column widths in cells, first column first.
+  using Widths = std::vector<int>;
+
+  /// A field's bytes in its line: [start, end), delimiter excluded.
+  struct Field {
+    size_t start;
+    size_t end;
+  };
+
+  Table();
+  ~Table();
+
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+
+  /**
+   * @brief Delimiter the first lines of the buffer agree on.
+   * @return 0 if the text does not look like delimited columns.
+   */
+  static char Detect(const Buffer &buffer);
+
+  /**
+   * @brief The file name suggests delimited text (.csv, .tsv, .tab, .psv,
+   * also compressed), so the view starts as a table.
+   */
+  static bool Suggested(const std::string &path);
+
+  /**
+   * @brief Human name of a delimiter ("comma", "tab", ...).
+   */
+  static const char *Name(char delimiter);
+
+  /**
+   * @brief Split line into fields at delimiter (reusing fields' storage).
+   * There is always at least one field.
+   */
+  static void Split(std::string_view line, char delimiter,
+                    std::vector<Field> &fields);
+
+  /**
+   * @brief Start of the field after the one at byte x (the end of the
+   * line from the last field).
+   */
+  static size_t NextField(std::string_view line, char delimiter, size_t x);
+
+  /**
+   * @brief Start of the field at byte x, or of the one before if x is
+   * already there.
+   */
+  static size_t PrevField(std::string_view line, char delimiter, size_t x);
+
+  /**
+   * @brief Split line and widen widths to fit its fields, each counted up
+   * to Edit::TABLE_COLUMN_WIDTH cells.
+   */
+  static void Widen(std::string_view line, char delimiter,
+                    const TextUtils::Kernels &text, std::vector<Field> &fields,
+                    Widths &widths);
+
+  /**
+   * @brief Show the file at path as columns split at delimiter, and start
+   * sampling its widths in the background.
+   */
+  void Start(const std::string &path, char delimiter,
+             TextUtils::Encoding encoding);
+
+  /**
+   * @brief Back to plain text.
+   */
+  void Stop();
+
+  /**
+   * @brief The delimiter in use, 0 when the table view is off.
+   */
+  char Delimiter() const { return m_delimiter; }
+
+  /**
+   * @brief Widths measured so far (never null; empty until the first
+   * sample batch lands).
+   */
+  std::shared_ptr<const Widths> Published() const;
+
+private:
+  char m_delimiter;
+
+  // Background sampler
+  std::thread m_sampler;
+  std::atomic<bool> m_cancel;
+  mutable std::mutex m_mutex;
+  std::shared_ptr<const Widths> m_published;
+
+  void Cancel();
+  void Publish(const Widths &widths);
+};
+
+#endif // TABLE_HPP
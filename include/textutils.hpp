@@ -8,148 +8,421 @@
 #ifndef TEXTUTILS_HPP
 #define TEXTUTILS_HPP
 
+#include "constants.hpp"
+#include <algorithm>
 #include <clocale>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <wchar.h>
 
 namespace TextUtils {
 
-/// Calculate visual width of a string, accounting for multi-column characters.
-inline int VisualWidth(const std::string &str) {
-  // Locale must be set in main() for mbtowc to work correctly.
-  // std::setlocale(LC_ALL, "");
+/// True for bytes rendered in caret notation (^@ .. ^_, ^?).
+inline bool IsControlByte(unsigned char c) { return c < 32 || c == 127; }
 
-  int width = 0;
-  size_t i = 0;
-  while (i < str.size()) {
-    wchar_t wc;
-    int len = mbtowc(&wc, &str[i], str.size() - i);
-
-    if (len < 0) {
-      // Invalid UTF-8 sequence, treat as 1-byte, 1-column error char
-      mbtowc(NULL, NULL, 0); // reset state
-      width += 1;
-      i++;
-    } else if (len == 0) {
-      break; // null terminator
+/// Byte-level summary gathered while scanning text for UTF-8 validity.
+struct Utf8Stats {
+  size_t nonAscii = 0; // Bytes >= 0x80
+  size_t valid = 0;    // Well-formed multi-byte sequences
+  size_t invalid = 0;  // Bytes that do not start a well-formed sequence
+
+  void Merge(const Utf8Stats &o) {
+    nonAscii += o.nonAscii;
+    valid += o.valid;
+    invalid += o.invalid;
+  }
+};
+
+/// Text encoding classes a buffer can fall into.
+enum class Encoding {
+  Ascii,  // 7-bit only
+  Utf8,   // Valid UTF-8 with at least one multi-byte sequence
+  Legacy, // High bytes but no valid UTF-8 sequence (Latin-1 and friends)
+  Mixed   // Both valid UTF-8 sequences and stray high bytes
+};
+
+/// Length of the well-formed UTF-8 sequence at p[0..n), or 0 if invalid.
+inline int ValidSequenceLength(const unsigned char *p, size_t n) {
+  unsigned char c = p[0];
+  int len;
+  unsigned char lo = 0x80, hi = 0xBF; // Allowed range for the second byte
+  if (c >= 0xC2 && c <= 0xDF) {
+    len = 2;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    len = 3;
+    if (c == 0xE0)
+      lo = 0xA0; // Overlong
+    if (c == 0xED)
+      hi = 0x9F; // Surrogates
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    len = 4;
+    if (c == 0xF0)
+      lo = 0x90; // Overlong
+    if (c == 0xF4)
+      hi = 0x8F; // Above U+10FFFF
+  } else {
+    return 0;
+  }
+
+  if ((size_t)len > n || p[1] < lo || p[1] > hi)
+    return 0;
+  for (int k = 2; k < len; ++k) {
+    if ((p[k] & 0xC0) != 0x80)
+      return 0;
+  }
+  return len;
+}
+
+/// Decode the well-formed UTF-8 sequence of `len` bytes at p.
+inline wchar_t DecodeSequence(const unsigned char *p, int len) {
+  static const unsigned char LEAD_MASK[5] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+  wchar_t wc = p[0] & LEAD_MASK[len];
+  for (int k = 1; k < len; ++k)
+    wc = (wc << 6) | (p[k] & 0x3F);
+  return wc;
+}
+
+/// Cursor and rendering kernels for text of one encoding class. The
+/// buffer classifies its text once (Buffer::GetEncoding) and callers pick
+/// the instantiation through KernelsFor, so no per-character check of the
+/// encoding is left:
+/// - Ascii: one byte per character; plain index arithmetic.
+/// - Legacy: one byte per character; high bytes are one column wide.
+/// - Utf8: sequences are decoded in place, no mbtowc.
+/// - Mixed: anything; mbtowc decides, invalid bytes count as one column.
+template <Encoding E> struct Kernel {
+  static constexpr bool SINGLE_BYTE =
+      E == Encoding::Ascii || E == Encoding::Legacy;
+
+  /// Byte length of the character starting at s[i].
+  static int CharBytesAt(std::string_view s, size_t i) {
+    if constexpr (SINGLE_BYTE) {
+      (void)s;
+      (void)i;
+      return 1;
+    } else if constexpr (E == Encoding::Utf8) {
+      const unsigned char *p =
+          reinterpret_cast<const unsigned char *>(s.data()) + i;
+      if (p[0] < 0x80)
+        return 1;
+      return std::max(1, ValidSequenceLength(p, s.size() - i));
     } else {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      if (c < 0x80)
+        return 1;
+      if ((c & 0xE0) == 0xC0)
+        return 2;
+      if ((c & 0xF0) == 0xE0)
+        return 3;
+      if ((c & 0xF8) == 0xF0)
+        return 4;
+      return 1; // Fallback for invalid or continuation bytes treated strictly
+    }
+  }
+
+  /// Column width of the character at s[i] when drawn at visual column
+  /// `col`; stores its byte length in `len`. Tabs advance to the next tab
+  /// stop and control bytes take two columns ("^X"); the buffer itself
+  /// keeps both verbatim.
+  static int CellWidthAt(std::string_view s, size_t i, int col, int &len) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    len = 1;
+    if (c == '\t')
+      return Edit::TAB_STOP - (col % Edit::TAB_STOP);
+    if (IsControlByte(c))
+      return 2;
+    if (SINGLE_BYTE || c < 0x80)
+      return 1;
+
+    if constexpr (E == Encoding::Utf8) {
+      const unsigned char *p =
+          reinterpret_cast<const unsigned char *>(s.data()) + i;
+      int n = ValidSequenceLength(p, s.size() - i);
+      if (n == 0)
+        return 1; // Cut by an edit: one error column, as below
+      len = n;
+      int w = wcwidth(DecodeSequence(p, n));
+      return (w >= 0 ? w : 1);
+    } else {
+      // Locale must be set in main() for mbtowc to work correctly.
+      wchar_t wc;
+      len = mbtowc(&wc, s.data() + i, s.size() - i);
+      if (len <= 0) {
+        // Invalid UTF-8 sequence, treat as 1-byte, 1-column error char
+        mbtowc(NULL, NULL, 0); // reset state
+        len = 1;
+        return 1;
+      }
       int w = wcwidth(wc);
-      width += (w >= 0 ? w : 1); // treat unprintable as size 1 for safety
+      return (w >= 0 ? w : 1); // treat unprintable as size 1 for safety
+    }
+  }
+
+  /// Visual width of a string, accounting for multi-column characters.
+  static int VisualWidth(std::string_view str) {
+    int width = 0;
+    size_t i = 0;
+    while (i < str.size()) {
+      int len;
+      width += CellWidthAt(str, i, width, len);
       i += len;
     }
+    return width;
   }
-  return width;
-}
 
-/// Get byte length of the UTF-8 character starting at s[i].
-inline int CharBytesAt(const std::string &s, size_t i) {
-  unsigned char c = static_cast<unsigned char>(s[i]);
-  if (c < 0x80)
-    return 1;
-  if ((c & 0xE0) == 0xC0)
-    return 2;
-  if ((c & 0xF0) == 0xE0)
-    return 3;
-  if ((c & 0xF8) == 0xF0)
-    return 4;
-  return 1; // Fallback for invalid or continuation bytes treated strictly
-}
+  /// Move index forward by one character.
+  static size_t NextCharIdx(std::string_view s, size_t i) {
+    if (i >= s.size())
+      return s.size();
+    if constexpr (E != Encoding::Mixed) {
+      return i + CharBytesAt(s, i);
+    } else {
+      // Skip continuation bytes (0b10xxxxxx) so a malformed sequence
+      // never leaves the index inside it
+      size_t next = i + CharBytesAt(s, i);
+      while (next < s.size()) {
+        unsigned char c = static_cast<unsigned char>(s[next]);
+        if ((c & 0xC0) != 0x80)
+          break; // Not a continuation byte
+        next++;
+      }
+      return (next > s.size()) ? s.size() : next;
+    }
+  }
 
-/// Move index forward by one UTF-8 code point.
-inline size_t NextCharIdx(const std::string &s, size_t i) {
-  if (i >= s.size())
-    return s.size();
+  /// Move index backward by one character.
+  static size_t PrevCharIdx(std::string_view s, size_t i) {
+    if (i == 0)
+      return 0;
+    if constexpr (SINGLE_BYTE) {
+      return std::min(i, s.size()) - 1;
+    } else {
+      // Step back until we find a non-continuation byte
+      size_t prev = i - 1;
+      while (prev > 0) {
+        unsigned char c = static_cast<unsigned char>(s[prev]);
+        if ((c & 0xC0) != 0x80)
+          break; // Found start of char
+        prev--;
+      }
+      return prev;
+    }
+  }
 
-  // Move forward at least 1 byte
-  int len = CharBytesAt(s, i);
-  // Standard UTF-8 validation could go here, but for now trusting structure
-  // or falling back to safe increments.
+  /// Byte index of the character covering visual column `visualX`.
+  static size_t ByteIdxForVisual(std::string_view s, int visualX) {
+    size_t i = 0;
+    int col = 0;
+    while (i < s.size() && col < visualX) {
+      int len;
+      col += CellWidthAt(s, i, col, len);
+      i += len;
+    }
+    return i;
+  }
+
+  /// Printable form of `s` starting at visual column colOff, fitting within
+  /// maxCols. Tabs become spaces and control bytes become caret notation so
+  /// the result can be handed straight to ncurses. Written to `result`,
+  /// whose capacity is reused: redrawing a row does not allocate.
+  static void TrimToVisual(std::string_view s, int colOff, int maxCols,
+                           std::string &result) {
+    result.clear();
+    int currentVisual = 0;
+    size_t i = 0;
+
+    // 1. Advance until colOff visual width is reached
+    while (i < s.size() && currentVisual < colOff) {
+      int len;
+      currentVisual += CellWidthAt(s, i, currentVisual, len);
+      i += len;
+    }
 
-  // Ensure we don't land in the middle of a sequence if the string is malformed
-  // A primitive loop to skip continuation bytes (0b10xxxxxx)
-  size_t next = i + len;
-  while (next < s.size()) {
-    unsigned char c = static_cast<unsigned char>(s[next]);
-    if ((c & 0xC0) != 0x80)
-      break; // Not a continuation byte
-    next++;
+    // A tab or wide character straddling the left edge leaves blank columns
+    // so everything after it stays aligned with the cursor math.
+    int printedVisual = 0;
+    if (currentVisual > colOff) {
+      printedVisual = std::min(currentVisual - colOff, maxCols);
+      result.append(printedVisual, ' ');
+    }
+
+    // 2. Extract substring fitting within maxCols
+    while (i < s.size() && printedVisual < maxCols) {
+      int len;
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      int w = CellWidthAt(s, i, colOff + printedVisual, len);
+
+      if (printedVisual + w > maxCols) {
+        if (c != '\t')
+          break; // Don't cut halfway
+        w = maxCols - printedVisual;
+      }
+
+      if (c == '\t') {
+        result.append(w, ' ');
+      } else if (IsControlByte(c)) {
+        result += '^';
+        result += (char)(c ^ 0x40);
+      } else if (len == 1) {
+        result += (char)c;
+      } else {
+        result.append(s.data() + i, len);
+      }
+      printedVisual += w;
+      i += len;
+    }
   }
+};
 
-  // If strict length calculation was correct, next should already be correct.
-  // But let's be robust:
-  return (next > s.size()) ? s.size() : next;
-}
+/// Entry points of one Kernel instantiation, for callers that learn the
+/// encoding at run time: look the table up once, then call through it.
+struct Kernels {
+  int (*VisualWidth)(std::string_view);
+  size_t (*NextCharIdx)(std::string_view, size_t);
+  size_t (*PrevCharIdx)(std::string_view, size_t);
+  size_t (*ByteIdxForVisual)(std::string_view, int);
+  void (*TrimToVisual)(std::string_view, int, int, std::string &);
+};
 
-/// Move index backward by one UTF-8 code point.
-inline size_t PrevCharIdx(const std::string &s, size_t i) {
-  if (i == 0)
-    return 0;
+template <Encoding E>
+inline constexpr Kernels KERNELS = {
+    Kernel<E>::VisualWidth, Kernel<E>::NextCharIdx, Kernel<E>::PrevCharIdx,
+    Kernel<E>::ByteIdxForVisual, Kernel<E>::TrimToVisual};
 
-  // Step back until we find a non-continuation byte
-  size_t prev = i - 1;
-  while (prev > 0) {
-    unsigned char c = static_cast<unsigned char>(s[prev]);
-    if ((c & 0xC0) != 0x80)
-      break; // Found start of char
-    prev--;
+/// Kernels for text of the given encoding class.
+inline const Kernels &KernelsFor(Encoding e) {
+  switch (e) {
+  case Encoding::Ascii:
+    return KERNELS<Encoding::Ascii>;
+  case Encoding::Utf8:
+    return KERNELS<Encoding::Utf8>;
+  case Encoding::Legacy:
+    return KERNELS<Encoding::Legacy>;
+  default:
+    return KERNELS<Encoding::Mixed>;
   }
-  return prev;
 }
 
-/// Extract substring starting at visual column offset, fitting within maxCols.
-inline std::string TrimToVisual(const std::string &s, int colOff, int maxCols) {
-  std::string result;
-  int currentVisual = 0;
-  size_t i = 0;
+// Encoding-agnostic forms, for text of unknown class (prompts, scripts)
 
-  // 1. Advance until colOff visual width is reached
-  while (i < s.size() && currentVisual < colOff) {
-    wchar_t wc;
-    int len = mbtowc(&wc, &s[i], s.size() - i);
-    if (len <= 0) {
-      i++;
-      currentVisual++;
-      continue;
-    }
+inline int CellWidthAt(std::string_view s, size_t i, int col, int &len) {
+  return Kernel<Encoding::Mixed>::CellWidthAt(s, i, col, len);
+}
 
-    int w = wcwidth(wc);
-    if (w < 0)
-      w = 1; // Treat unprintable characters as width 1
+inline int VisualWidth(std::string_view str) {
+  return Kernel<Encoding::Mixed>::VisualWidth(str);
+}
 
-    currentVisual += w;
-    i += len;
-  }
+inline int CharBytesAt(std::string_view s, size_t i) {
+  return Kernel<Encoding::Mixed>::CharBytesAt(s, i);
+}
 
-  // If split occurs in the middle of a wide character, render from current
-  // position.
+inline size_t NextCharIdx(std::string_view s, size_t i) {
+  return Kernel<Encoding::Mixed>::NextCharIdx(s, i);
+}
 
-  // 2. Extract substring fitting within maxCols
+inline size_t PrevCharIdx(std::string_view s, size_t i) {
+  return Kernel<Encoding::Mixed>::PrevCharIdx(s, i);
+}
+
+inline size_t ByteIdxForVisual(std::string_view s, int visualX) {
+  return Kernel<Encoding::Mixed>::ByteIdxForVisual(s, visualX);
+}
+
+inline std::string TrimToVisual(std::string_view s, int colOff, int maxCols) {
+  std::string result;
+  Kernel<Encoding::Mixed>::TrimToVisual(s, colOff, maxCols, result);
+  return result;
+}
 
-  int printedVisual = 0;
-  while (i < s.size() && printedVisual < maxCols) {
-    wchar_t wc;
-    int len = mbtowc(&wc, &s[i], s.size() - i);
-    if (len <= 0) {
-      result += s[i];
+/// Accumulate UTF-8 statistics for `s`, skipping ASCII runs a word at a time.
+inline void ScanUtf8(std::string_view s, Utf8Stats &stats) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(s.data());
+  size_t n = s.size();
+  size_t i = 0;
+  while (i < n) {
+    while (i + 8 <= n) {
+      uint64_t word;
+      memcpy(&word, p + i, sizeof(word));
+      if (word & 0x8080808080808080ULL)
+        break;
+      i += 8;
+    }
+    if (i >= n)
+      break;
+
+    if (p[i] < 0x80) {
       i++;
-      printedVisual++;
       continue;
     }
 
-    int w = wcwidth(wc);
-    if (w < 0)
-      w = 1;
+    int len = ValidSequenceLength(p + i, n - i);
+    if (len > 0) {
+      stats.valid++;
+      stats.nonAscii += len;
+      i += len;
+    } else {
+      stats.invalid++;
+      stats.nonAscii++;
+      i++;
+    }
+  }
+}
+
+/// Map scan statistics to an encoding class.
+inline Encoding Classify(const Utf8Stats &stats) {
+  if (stats.nonAscii == 0)
+    return Encoding::Ascii;
+  if (stats.invalid == 0)
+    return Encoding::Utf8;
+  if (stats.valid == 0)
+    return Encoding::Legacy;
+  return Encoding::Mixed;
+}
 
-    if (printedVisual + w > maxCols)
-      break; // Don't cut halfway
+/// Whether a sample of a file looks binary: it holds a NUL byte, or more
+/// than 1 in 10 of its bytes are invalid UTF-8 or control bytes that text
+/// does not use. NULs are found a word at a time.
+inline bool LooksBinary(std::string_view sample) {
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(sample.data());
+  size_t n = sample.size();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof(word));
+    if ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL)
+      return true;
+  }
+  for (; i < n; ++i) {
+    if (p[i] == 0)
+      return true;
+  }
 
-    result.append(s, i, len);
-    printedVisual += w;
-    i += len;
+  Utf8Stats stats;
+  ScanUtf8(sample, stats);
+  size_t odd = stats.invalid;
+  for (unsigned char c : sample) {
+    // Tab, line and page breaks, backspace and escape all occur in text
+    if (IsControlByte(c) && c != '\t' && c != '\n' && c != '\r' &&
+        c != '\f' && c != '\v' && c != '\b' && c != 0x1b)
+      odd++;
   }
+  return odd * 10 > n;
+}
 
-  return result;
+/// Encoding class of text made of two parts with the given classes.
+/// Conservative: removing text never narrows the class.
+inline Encoding Combine(Encoding a, Encoding b) {
+  if (a == b || b == Encoding::Ascii)
+    return a;
+  if (a == Encoding::Ascii)
+    return b;
+  return Encoding::Mixed;
 }
 
 /// Convert a Unicode code point to its UTF-8 encoded string representation.
@@ -173,6 +446,99 @@ inline std::string CodePointToUtf8(int cp) {
   return result;
 }
 
+/// Word-byte classes: ASCII letters, digits and '_', plus every byte of a
+/// multi-byte sequence so that UTF-8 letters stay inside words.
+struct WordBytes {
+  bool word[256];
+  constexpr WordBytes() : word() {
+    for (int c = 0; c < 256; ++c)
+      word[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+  }
+};
+inline constexpr WordBytes WORD_BYTES{};
+
+/// True for bytes that belong to a word (one table lookup).
+inline bool IsWordByte(unsigned char c) { return WORD_BYTES.word[c]; }
+
+/// Index just past the next word end at or after i.
+inline size_t NextWordEnd(std::string_view s, size_t i) {
+  while (i < s.size() && !IsWordByte(static_cast<unsigned char>(s[i])))
+    i++;
+  while (i < s.size() && IsWordByte(static_cast<unsigned char>(s[i])))
+    i++;
+  return i;
+}
+
+/// Start of the word ending at or before i.
+inline size_t PrevWordStart(std::string_view s, size_t i) {
+  i = std::min(i, s.size());
+  while (i > 0 && !IsWordByte(static_cast<unsigned char>(s[i - 1])))
+    i--;
+  while (i > 0 && IsWordByte(static_cast<unsigned char>(s[i - 1])))
+    i--;
+  return i;
+}
+
+/// Call f(start, length) for each maximal run of word bytes in s.
+template <typename F> inline void ForEachWord(std::string_view s, F f) {
+  size_t i = 0;
+  for (;;) {
+    while (i < s.size() && !IsWordByte(static_cast<unsigned char>(s[i])))
+      i++;
+    if (i >= s.size())
+      return;
+    size_t start = i;
+    while (i < s.size() && IsWordByte(static_cast<unsigned char>(s[i])))
+      i++;
+    f(start, i - start);
+  }
+}
+
+/// Offset of the first occurrence of needle in s at or after from, or npos.
+/// The one literal matcher behind matches, line filters and file search:
+/// libc's memchr/memmem scan a vector register at a time, several times
+/// faster than a byte loop over a whole mapped file.
+inline size_t Find(std::string_view s, std::string_view needle,
+                   size_t from = 0) {
+  if (from > s.size() || needle.size() > s.size() - from)
+    return std::string_view::npos;
+  if (needle.empty())
+    return from;
+  const void *hit =
+      needle.size() == 1
+          ? memchr(s.data() + from, needle[0], s.size() - from)
+          : memmem(s.data() + from, s.size() - from, needle.data(),
+                   needle.size());
+  return hit ? (size_t)(static_cast<const char *>(hit) - s.data())
+             : std::string_view::npos;
+}
+
+/// Byte count for a status line: "512 B", "1.5 KB", "16.0 MB", "2.3 GB".
+inline std::string FormatBytes(size_t bytes) {
+  static const char *const UNITS[] = {"B", "KB", "MB", "GB", "TB"};
+  double value = (double)bytes;
+  int unit = 0;
+  while (value >= 1024 && unit < 4) {
+    value /= 1024;
+    unit++;
+  }
+  char text[32];
+  snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value,
+           UNITS[unit]);
+  return text;
+}
+
+/// 64-bit FNV-1a: cheap, and good enough to tell lines (or file tails) apart.
+inline uint64_t Hash(std::string_view s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
 } // namespace TextUtils
 
 #endif // TEXTUTILS_HPP
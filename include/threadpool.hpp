@@ -0,0 +1,100 @@
+/**
+ * @file threadpool.hpp
+ * @brief Fixed-size worker pool used by the parallel load pipeline.
+ * @author rahuldangeofficial
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Runs queued tasks on a fixed set of worker threads.
+ *
+ * Responsibilities:
+ * - Own the worker threads for the lifetime of the pool.
+ * - Execute submitted tasks in FIFO order.
+ * - Provide a blocking ParallelFor for data-parallel phases.
+ *
+ * Safety:
+ * - The destructor drains the queue and joins every worker.
+ * - ParallelFor rethrows the first exception fn threw; a task passed to
+ *   Submit must not throw.
+ * - ParallelFor called from one of the pool's own workers runs inline:
+ *   helpers queued behind the blocked caller could never start.
+ */
+class ThreadPool {
+public:
+  /**
+   * @brief Start the pool.
+   * @param threads Worker count; 0 selects std::thread::hardware_concurrency.
+   */
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Number of worker threads.
+   */
+  unsigned Size() const { return (unsigned)m_workers.size(); }
+
+  /**
+   * @brief Queue a task for execution.
+   */
+  void Submit(std::function<void()> task);
+
+  /**
+   * @brief Run fn(0) .. fn(n - 1) across the pool and wait for completion.
+   * @note The calling thread participates, so this is safe with n == 1,
+   * and returns once the work is done even if helpers never got a worker.
+   */
+  void ParallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+  /**
+   * @brief Process-wide pool sized to the machine.
+   */
+  static ThreadPool &Shared();
+
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_hasWork;
+  bool m_stopping;
+
+  void WorkerLoop();
+};
+
+/**
+ * @brief Pool for a thread count as the command line gives it (-j): 0
+ * borrows ThreadPool::Shared(), 1 runs inline (nullptr), N starts N - 1
+ * workers in local (the calling thread is the Nth).
+ */
+ThreadPool *PoolFor(unsigned threads, std::unique_ptr<ThreadPool> &local);
+
+/**
+ * @brief As PoolFor, for scans that keep their workers busy for long
+ * (project search, the lazy-index sweep): 0 starts a pool of their own
+ * sized to the machine, so the shared workers stay free for the editor.
+ */
+ThreadPool *BackgroundPoolFor(unsigned threads,
+                              std::unique_ptr<ThreadPool> &local);
+
+/**
+ * @brief Run fn over [0, n) on the pool, or inline when there is none.
+ */
+void ForEachChunk(ThreadPool *pool, size_t n,
+                  const std::function<void(size_t)> &fn);
+
+#endif // THREADPOOL_HPP
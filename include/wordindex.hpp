@@ -0,0 +1,134 @@
+/**
+ * @file wordindex.hpp
+ * @brief WordIndex class declaration: interned words of the buffer with
+ * reference counts, for completion.
+ * @author rahuldangeofficial
+ */
+
+#ifndef WORDINDEX_HPP
+#define WORDINDEX_HPP
+
+#include "buffer.hpp"
+#include "lineblocks.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class WordIndex
+ * @brief Completion candidates drawn from the words of the buffer.
+ *
+ * Responsibilities:
+ * - Intern every word (TextUtils::ForEachWord, MIN_WORD..MAX_WORD bytes)
+ *   once into an arena and count the line blocks it occurs in.
+ * - Build the index from the file on disk on a background thread after a
+ *   load; edits made meanwhile are replayed when it is adopted.
+ * - Keep it current per edit by rescanning only the blocks of lines the
+ *   edit touched.
+ * - Suggest the most used words starting with a prefix, at a cost bounded
+ *   by the candidates examined rather than the file size.
+ *
+ * Notes:
+ * - Words are kept in one sorted array plus a small unsorted tail of new
+ *   words, merged in once the tail grows.
+ * - A word whose count drops to zero stays interned (and is skipped), so
+ *   retyping it costs nothing, until such words outnumber the live ones;
+ *   then a merge compacts them away, so the prefixes interned while
+ *   typing do not pile up.
+ * - Only used from the UI thread; the builder works on its own copy.
+ */
+class WordIndex {
+public:
+  WordIndex();
+  ~WordIndex();
+
+  WordIndex(const WordIndex &) = delete;
+  WordIndex &operator=(const WordIndex &) = delete;
+
+  /**
+   * @brief The buffer was (re)loaded from path with lineCount lines;
+   * rebuild in the background.
+   * @param inflated The file's text if the buffer already inflated it
+   * (Buffer::InflatedText); the builder then leaves the disk alone.
+   */
+  void Reset(const std::string &path, int lineCount,
+             std::shared_ptr<const Buffer::TextPieces> inflated = nullptr);
+
+  /**
+   * @brief Lines changed (from Buffer::TakeLineEdit or a reload).
+   */
+  void Edited(const Buffer &buffer, const Buffer::LineEdit &edit);
+
+  /**
+   * @brief Up to `limit` indexed words starting with prefix (longer than
+   * it), most frequent first.
+   * @return Empty while the background build is still running.
+   */
+  std::vector<std::string> Suggest(const Buffer &buffer,
+                                   std::string_view prefix, size_t limit);
+
+  /**
+   * @brief The background build has not been adopted yet.
+   */
+  bool Building() const { return !m_ready && m_builder.joinable(); }
+
+  /**
+   * @brief Heap bytes of the adopted index (0 while building).
+   */
+  size_t MemoryBytes() const;
+
+private:
+  struct Entry {
+    std::string_view word; // Points into the arena
+    uint32_t refs;         // Blocks containing the word
+  };
+
+  struct Words {
+    bool dirty = true;           // Words must be rescanned from the buffer
+    std::vector<uint32_t> words; // Distinct word ids, sorted
+  };
+
+  using Blocks = LineBlocks<Words>;
+
+  /// Everything the builder produces; adopted whole by the UI thread.
+  struct Index {
+    std::vector<std::unique_ptr<char[]>> arena;
+    size_t arenaUsed = 0; // Bytes used in the last arena chunk
+    std::vector<Entry> entries;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<uint32_t> sorted;   // Entry ids in word order
+    std::vector<uint32_t> unsorted; // Interned since the last merge
+    size_t live = 0;                // Entries with refs > 0
+    Blocks blocks;
+
+    Index();
+    uint32_t Intern(std::string_view word);
+    uint32_t Store(std::string_view word, uint32_t refs);
+    void AddBlock(Blocks::Block &block, std::vector<uint32_t> words);
+    void DropBlock(Blocks::Block &block);
+    void MergeNew();
+    void Compact();
+  };
+
+  Index m_index;
+  bool m_ready; // m_index is usable (built and adopted)
+
+  // Background build
+  std::thread m_builder;
+  std::unique_ptr<Index> m_built;
+  std::atomic<bool> m_done;
+  std::atomic<bool> m_cancel;
+  std::vector<Buffer::LineEdit> m_pending; // Edits made while building
+
+  void Cancel();
+  bool Ready(const Buffer &buffer);
+  void Apply(const Buffer::LineEdit &edit);
+  void Refresh(const Buffer &buffer);
+};
+
+#endif // WORDINDEX_HPP
@@ -85,25 +85,25 @@ install_deps() {
     
     case "$DISTRO" in
         debian)
-            print_step "Installing build tools and ncurses..."
+            print_step "Installing build tools, ncurses, zlib and zstd..."
             sudo apt-get update -qq
-            sudo apt-get install -y -qq build-essential libncursesw5-dev > /dev/null
+            sudo apt-get install -y -qq build-essential libncursesw5-dev zlib1g-dev libzstd-dev > /dev/null
             print_success "Dependencies installed"
             ;;
         rhel)
-            print_step "Installing build tools and ncurses..."
-            sudo dnf install -y -q gcc-c++ ncurses-devel make 2>/dev/null || \
-            sudo yum install -y -q gcc-c++ ncurses-devel make 2>/dev/null
+            print_step "Installing build tools, ncurses, zlib and zstd..."
+            sudo dnf install -y -q gcc-c++ ncurses-devel zlib-devel libzstd-devel make 2>/dev/null || \
+            sudo yum install -y -q gcc-c++ ncurses-devel zlib-devel libzstd-devel make 2>/dev/null
             print_success "Dependencies installed"
             ;;
         arch)
-            print_step "Installing build tools and ncurses..."
-            sudo pacman -Sy --noconfirm --quiet base-devel ncurses > /dev/null
+            print_step "Installing build tools, ncurses, zlib and zstd..."
+            sudo pacman -Sy --noconfirm --quiet base-devel ncurses zlib zstd > /dev/null
             print_success "Dependencies installed"
             ;;
         alpine)
-            print_step "Installing build tools and ncurses..."
-            sudo apk add --no-cache --quiet build-base ncurses-dev > /dev/null
+            print_step "Installing build tools, ncurses, zlib and zstd..."
+            sudo apk add --no-cache --quiet build-base ncurses-dev zlib-dev zstd-dev > /dev/null
             print_success "Dependencies installed"
             ;;
         macos)
@@ -116,7 +116,7 @@ install_deps() {
             print_success "Build tools available"
             ;;
         *)
-            print_warning "Please install manually: g++, make, ncurses-devel"
+            print_warning "Please install manually: g++, make, ncurses-devel, zlib-devel (zstd optional)"
             ;;
     esac
 }
@@ -6,70 +6,1046 @@
 
 #include "../include/buffer.hpp"
 #include "../include/constants.hpp"
+#include "../include/indexcache.hpp"
 #include "../include/textutils.hpp"
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <fcntl.h>
-#include <fstream>
+#include <mutex>
 #include <stdexcept>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_set>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 namespace {
-std::string Detab(const std::string &input) {
-  std::string output;
-  output.reserve(input.size());
-  for (char c : input) {
-    unsigned char uc = static_cast<unsigned char>(c);
-    if (c == '\t') {
-      output.append(Edit::TAB_STOP, ' ');
-    } else if (uc >= 32 && uc != 127) {
-      // Accept all printable ASCII and all UTF-8 bytes (>= 128)
-      output.push_back(c);
+/// Read a non-seekable stream (pipe, FIFO, unknown size) into one block.
+std::shared_ptr<const char> ReadStream(int fd, size_t &size) {
+  auto bytes = std::make_shared<std::string>();
+  char chunk[1 << 16];
+  for (;;) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("Read failed: " + std::string(strerror(errno)));
+    }
+    if (n == 0)
+      break;
+    bytes->append(chunk, (size_t)n);
+  }
+  size = bytes->size();
+  // Aliasing constructor: share ownership of the string, point at its bytes
+  return std::shared_ptr<const char>(bytes, bytes->data());
+}
+
+/// Fill [buf, buf + len) from file offset `off`, retrying short reads.
+void PreadFully(int fd, char *buf, size_t len, off_t off) {
+  while (len > 0) {
+    ssize_t n = pread(fd, buf, len, off);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("Read failed: " + std::string(strerror(errno)));
+    }
+    if (n == 0)
+      throw std::runtime_error("Read failed: file shrank while loading");
+    buf += n;
+    len -= (size_t)n;
+    off += n;
+  }
+}
+
+/// Write every iovec fully, retrying on short writes.
+void WriteVec(int fd, std::vector<struct iovec> &iov) {
+  size_t i = 0;
+  while (i < iov.size()) {
+    int count = (int)std::min(iov.size() - i, (size_t)IOV_MAX);
+    ssize_t written = writev(fd, &iov[i], count);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("Write failed: " + std::string(strerror(errno)));
+    }
+
+    // Skip fully written entries, then trim the partially written one
+    size_t left = (size_t)written;
+    while (i < iov.size() && left >= iov[i].iov_len) {
+      left -= iov[i].iov_len;
+      i++;
+    }
+    if (left > 0) {
+      iov[i].iov_base = static_cast<char *>(iov[i].iov_base) + left;
+      iov[i].iov_len -= left;
+    }
+  }
+}
+
+/// Read the whole file behind fd, one pread per chunk for regular files.
+void ReadSource(int fd, ThreadPool *pool, std::shared_ptr<const char> &out,
+                size_t &size) {
+  const size_t chunkBytes = Edit::LOAD_CHUNK_BYTES;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    size = (size_t)st.st_size;
+    std::shared_ptr<char> block(new char[size], std::default_delete<char[]>());
+    char *base = block.get();
+    ForEachChunk(pool, (size + chunkBytes - 1) / chunkBytes, [&](size_t k) {
+      size_t off = k * chunkBytes;
+      PreadFully(fd, base + off, std::min(chunkBytes, size - off), (off_t)off);
+    });
+    out = std::move(block);
+  } else {
+    out = ReadStream(fd, size);
+  }
+}
+
+/// Inflate the whole compressed file behind fd into one block.
+std::shared_ptr<const char> InflateStream(int fd, Compression::Format format,
+                                          size_t &size) {
+  Compression::Decoder decoder(fd, format);
+  auto bytes = std::make_shared<std::string>();
+  const size_t step = Compression::CheckpointBytes();
+  for (;;) {
+    size_t at = bytes->size();
+    bytes->resize(at + step);
+    size_t n = decoder.Read(&(*bytes)[at], step);
+    bytes->resize(at + n);
+    if (n == 0)
+      break;
+  }
+  size = bytes->size();
+  return std::shared_ptr<const char>(bytes, bytes->data());
+}
+
+Buffer::DiskState FromStat(const struct stat &st) {
+  Buffer::DiskState disk;
+  disk.exists = true;
+  disk.dev = (uint64_t)st.st_dev;
+  disk.ino = (uint64_t)st.st_ino;
+  disk.size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+  disk.mtimeNs = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL +
+                 st.st_mtimespec.tv_nsec;
+#else
+  disk.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+  return disk;
+}
+
+Buffer::DiskState StatFd(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return Buffer::DiskState();
+  return FromStat(st);
+}
+
+Buffer::DiskState StatPath(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return Buffer::DiskState();
+  return FromStat(st);
+}
+
+/// Call emit(offset, length, term) for each line in [start, stop).
+/// Content excludes "\n" and a "\r" directly before it; a final line
+/// without terminator gets term 0.
+template <typename Emit>
+void SplitLines(const char *data, size_t start, size_t stop, Emit emit) {
+  while (start < stop) {
+    const void *hit = memchr(data + start, '\n', stop - start);
+    if (!hit) {
+      emit(start, stop - start, 0);
+      return;
     }
+
+    size_t nl = (size_t)(static_cast<const char *>(hit) - data);
+    bool crlf = nl > start && data[nl - 1] == '\r';
+    emit(start, nl - start - (crlf ? 1 : 0), crlf ? 2 : 1);
+    start = nl + 1;
   }
-  return output;
+}
+
+bool BytesEqual(const char *p, std::string_view expected) {
+  return expected.empty() || memcmp(p, expected.data(), expected.size()) == 0;
+}
+
+/// Whether dropping a span's source terminator (term 0) writes the same bytes.
+bool IsDefaultEol(int term, Buffer::LineEnding fallback) {
+  return term == 0 || (term == 2) == (fallback == Buffer::LineEnding::CRLF);
+}
+
+const char *EolBytes(int term, Buffer::LineEnding fallback) {
+  if (term == 2)
+    return "\r\n";
+  if (term == 1)
+    return "\n";
+  return fallback == Buffer::LineEnding::CRLF ? "\r\n" : "\n";
 }
 } // namespace
 
-Buffer::Buffer() : m_dirty(false) {
+/**
+ * Chunks of CHECKPOINT_LINES lines whose bytes and LineRefs are filled in
+ * on demand: by GetLine for the chunk it needs, and by a background sweep
+ * for the rest. Each chunk is claimed once (pending -> busy -> ready);
+ * anyone needing a busy chunk waits for its owner to finish. A chunk is
+ * whole LineStore blocks (Blank), so filling one touches no other.
+ */
+struct Buffer::LazyIndex {
+  enum : uint8_t { PENDING, BUSY, READY };
+
+  int fd = -1;
+  char *bytes = nullptr;        // Source block being filled in
+  LineStore *lines = nullptr;   // m_lines; not reshaped meanwhile
+  std::vector<uint64_t> starts; // Byte start of each chunk, then the end
+  size_t lineCount = 0;         // Lines covered by deferred chunks
+  std::unique_ptr<std::atomic<uint8_t>[]> state;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::atomic<bool> cancel{false};
+  std::atomic<bool> mismatch{false}; // Bytes no longer fit the sidecar
+  std::unique_ptr<ThreadPool> localPool;
+  std::thread sweeper;
+
+  size_t Chunks() const { return starts.size() - 1; }
+
+  void Ensure(size_t k) {
+    if (state[k].load(std::memory_order_acquire) == READY)
+      return;
+
+    uint8_t expected = PENDING;
+    if (state[k].compare_exchange_strong(expected, BUSY)) {
+      Fill(k);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        state[k].store(READY, std::memory_order_release);
+      }
+      ready.notify_all();
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [&] {
+      return state[k].load(std::memory_order_acquire) == READY;
+    });
+  }
+
+  void Fill(size_t k) {
+    const size_t per = Edit::CHECKPOINT_LINES;
+    size_t begin = (size_t)starts[k];
+    size_t end = (size_t)starts[k + 1];
+    size_t first = k * per;
+    size_t expect = std::min(lineCount - first, per);
+
+    std::vector<LineRef> refs;
+    refs.reserve(expect);
+    size_t n = 0;
+    try {
+      PreadFully(fd, bytes + begin, end - begin, (off_t)begin);
+      SplitLines(bytes, begin, end, [&](size_t off, size_t len, int term) {
+        if (n < expect)
+          refs.push_back({off, len, -1, (uint8_t)term});
+        n++;
+      });
+    } catch (const std::exception &) {
+      n = 0; // Shrank underneath us; FinishLoading starts over
+      refs.clear();
+    }
+
+    // Never leave garbage refs behind, even when the counts disagree
+    if (n != expect) {
+      mismatch = true;
+      refs.resize(expect, {begin, 0, -1, 1});
+    }
+    if (!lines->Fill((int)first, refs.data(), refs.size()))
+      mismatch = true;
+  }
+};
+
+/**
+ * A compressed file being inflated by a worker thread. The worker cuts the
+ * text into blocks of about Compression::CheckpointBytes(), each ending at
+ * a line end (a longer line grows its block), indexes each block and
+ * queues it; the buffer's owner adopts queued blocks in order
+ * (AdoptInflated), so lines are only ever appended on the owner's thread.
+ */
+struct Buffer::Inflow {
+  struct Block {
+    std::shared_ptr<const char> bytes;
+    size_t size;
+    LineStore lines; // Offsets relative to bytes
+    ScanSummary scan;
+  };
+
+  int fd = -1;
+  std::unique_ptr<Compression::Decoder> decoder;
+  ScanSummary seen;   // Merged summary of the adopted blocks
+  TextPieces pieces;  // Their bytes, for InflatedText
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Block> blocks; // Indexed, waiting to be adopted
+  bool done = false;        // No more blocks will be queued
+  std::string error;        // Why the stream ended early, if it did
+  std::atomic<bool> cancel{false};
+  std::thread worker;
+
+  void Run() {
+    const size_t step = Compression::CheckpointBytes();
+    std::string failure;
+    try {
+      std::string carry; // Partial last line of the previous block
+      bool end = false;
+      while (!end && !cancel.load(std::memory_order_relaxed)) {
+        auto text = std::make_shared<std::string>(std::move(carry));
+        carry.clear();
+        size_t cut = 0;
+        while (!cancel.load(std::memory_order_relaxed)) {
+          // Damage ends the text; what came before it is still shown
+          size_t at = text->size();
+          size_t n = 0;
+          text->resize(at + step);
+          try {
+            n = decoder->Read(&(*text)[at], step);
+          } catch (const std::exception &e) {
+            failure = e.what();
+          }
+          text->resize(at + n);
+          end = n == 0;
+          if (end) {
+            cut = text->size();
+            text->shrink_to_fit();
+            break;
+          }
+          size_t nl = text->rfind('\n');
+          if (nl != std::string::npos) {
+            cut = nl + 1;
+            break;
+          }
+        }
+        if (cut < text->size()) {
+          carry.assign(*text, cut, std::string::npos);
+          text->resize(cut);
+        }
+        if (text->empty())
+          continue;
+
+        Block block;
+        block.size = text->size();
+        IndexLines(text->data(), 0, block.size, nullptr, block.lines,
+                   block.scan);
+        block.bytes = std::shared_ptr<const char>(text, text->data());
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          blocks.push_back(std::move(block));
+        }
+        ready.notify_all();
+      }
+    } catch (const std::exception &e) {
+      failure = e.what();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      error = failure;
+      done = true;
+    }
+    ready.notify_all();
+  }
+};
+
+Buffer::Buffer()
+    : m_sourceEnd(0), m_eol(LineEnding::LF),
+      m_encoding(TextUtils::Encoding::Ascii), m_longestLine(0),
+      m_finalNewline(false), m_dirty(false), m_stale(false),
+      m_compression(Compression::Format::None), m_streaming(false),
+      m_streamLines(0), m_reportedLines(0), m_undoDepth(0),
+      m_groupOpen(false), m_replaying(false), m_batches(0),
+      m_lineEdit{0, 0, 0}, m_lineEdited(false) {
   // Always start with at least one empty line
-  m_lines.push_back("");
+  ResetSource(std::make_shared<const char>('\0'), 0);
+  EnsureLine();
+}
+
+Buffer::~Buffer() {
+  DropLazy();
+  DropInflow();
+}
+
+void Buffer::ResetSource(std::shared_ptr<const char> bytes, size_t size) {
+  m_blocks.clear();
+  m_blocks.push_back({0, size, std::move(bytes)});
+  m_sourceEnd = size;
+}
+
+const char *Buffer::SourceAt(size_t offset) const {
+  if (m_blocks.size() == 1)
+    return m_blocks[0].bytes.get() + offset;
+  const SourceBlock &block = BlockAt(offset);
+  return block.bytes.get() + (offset - block.base);
+}
+
+const Buffer::SourceBlock &Buffer::BlockAt(size_t offset) const {
+  if (m_blocks.size() == 1)
+    return m_blocks[0];
+
+  // Last block whose base is <= offset
+  auto it = std::upper_bound(
+      m_blocks.begin(), m_blocks.end(), offset,
+      [](size_t off, const SourceBlock &b) { return off < b.base; });
+  --it;
+  return *it;
+}
+
+size_t Buffer::AdoptBlock(const std::shared_ptr<const char> &bytes,
+                          size_t size) {
+  for (const SourceBlock &block : m_blocks) {
+    if (block.bytes.get() == bytes.get())
+      return block.base;
+  }
+  size_t base = m_sourceEnd;
+  m_blocks.push_back({base, size, bytes});
+  m_sourceEnd += size;
+  return base;
+}
+
+std::string_view Buffer::Text(const LineRef &ref) const {
+  if (ref.slot >= 0)
+    return m_edits[ref.slot];
+  return std::string_view(SourceAt(ref.offset), ref.length);
 }
 
 void Buffer::EnsureLine() {
-  if (m_lines.empty()) {
-    m_lines.push_back("");
+  if (m_lines.Count() == 0) {
+    m_lines.Push({0, 0, -1, 0});
   }
 }
 
-void Buffer::Load(const std::string &path) {
+void Buffer::Load(const std::string &path, unsigned threads,
+                  bool background) {
+  DropLazy();
+  DropInflow();
+  ClearHistory();
+  m_lineEdited = false;
   m_filename = path;
-  m_lines.clear();
+  m_lines.Clear();
+  m_edits.clear();
+  m_freeSlots.clear();
+  ResetSource(std::make_shared<const char>('\0'), 0);
+  m_eol = LineEnding::LF;
+  m_encoding = TextUtils::Encoding::Ascii;
+  m_longestLine = 0;
+  m_finalNewline = false;
+  m_disk = DiskState();
+  m_stale = false;
+  m_compression = Compression::Format::None;
+  m_streaming = false;
+  m_streamLines = 0;
+  m_reportedLines = 0;
+  m_streamError.clear();
+  m_inflated.reset();
 
-  std::ifstream file(path);
-  if (!file.is_open()) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      throw std::runtime_error("Cannot open " + path + ": " +
+                               std::string(strerror(errno)));
+    }
     // New file context, not an error.
     EnsureLine();
     m_dirty = false;
     return;
   }
 
-  std::string line;
-  while (std::getline(file, line)) {
-    m_lines.push_back(Detab(line));
+  Compression::Format format = Compression::Sniff(fd);
+  if (format != Compression::Format::None) {
+    m_disk = StatFd(fd);
+    m_compression = format;
+    LoadCompressed(fd, background);
+    return;
+  }
+
+  std::shared_ptr<const char> source;
+  size_t size = 0;
+  ScanSummary scan;
+  try {
+    m_disk = StatFd(fd);
+    bool cacheable = IndexCache::Enabled(m_disk.size);
+    if (cacheable) {
+      IndexCache cache;
+      IndexCache::Match match = cache.Open(path, m_disk, fd);
+      if (match != IndexCache::Match::None &&
+          LoadIndexed(fd, cache, match == IndexCache::Match::Appended,
+                      threads)) {
+        m_dirty = false;
+        return; // fd now belongs to m_lazy
+      }
+    }
+
+    std::unique_ptr<ThreadPool> localPool;
+    ThreadPool *pool = PoolFor(threads, localPool);
+    ReadSource(fd, pool, source, size);
+    IndexLines(source.get(), 0, size, pool, m_lines, scan);
+
+    if (cacheable) {
+      IndexCache::Summary summary;
+      summary.size = size;
+      summary.lineCount = (uint64_t)m_lines.Count();
+      summary.longestLine = scan.longestLine;
+      summary.utf8 = scan.utf8;
+      summary.firstTerm = scan.firstTerm;
+      summary.finalNewline = size > 0 && source.get()[size - 1] == '\n';
+
+      std::vector<uint64_t> checkpoints;
+      for (int i = 0; i < m_lines.Count(); i += (int)Edit::CHECKPOINT_LINES)
+        checkpoints.push_back(m_lines.Get(i).offset);
+      IndexCache::Store(path, m_disk, summary, checkpoints, fd);
+    }
+  } catch (...) {
+    close(fd);
+    throw;
   }
+  close(fd);
+
+  const char *data = source.get();
+  ResetSource(std::move(source), size);
+
+  m_eol = scan.firstTerm == 2 ? LineEnding::CRLF : LineEnding::LF;
+  m_encoding = TextUtils::Classify(scan.utf8);
+  m_longestLine = scan.longestLine;
+  m_finalNewline = size > 0 && data[size - 1] == '\n';
+
+  // Handle case where file might be empty
+  EnsureLine();
+  m_dirty = false;
+}
+
+bool Buffer::LoadIndexed(int fd, const IndexCache &cache, bool appended,
+                         unsigned threads) {
+  const size_t per = Edit::CHECKPOINT_LINES;
+  const IndexCache::Summary &cached = cache.GetSummary();
+  const uint64_t *checkpoints = cache.Checkpoints();
+  size_t size = (size_t)m_disk.size;
+
+  // After an append the last checkpointed chunk may end in a partial line;
+  // it is indexed eagerly together with the new bytes.
+  size_t chunks = cache.CheckpointCount() - (appended ? 1 : 0);
+  uint64_t deferredLines = appended ? (uint64_t)chunks * per : cached.lineCount;
+  uint64_t deferredEnd = appended ? checkpoints[chunks] : size;
+  if (chunks == 0 || checkpoints[0] != 0 ||
+      deferredLines > (uint64_t)chunks * per ||
+      deferredLines <= (uint64_t)(chunks - 1) * per)
+    return false;
+  for (size_t k = 1; k < chunks; ++k) {
+    if (checkpoints[k] <= checkpoints[k - 1] || checkpoints[k] >= deferredEnd)
+      return false;
+  }
+  // A chunk's lines share LineStore blocks, whose spans stay within 4 GB
+  for (size_t k = 0; k < chunks; ++k) {
+    uint64_t end = k + 1 < chunks ? checkpoints[k + 1] : deferredEnd;
+    if (end - checkpoints[k] > UINT32_MAX)
+      return false;
+  }
+
+  // The sweep outlives this call: it gets workers of its own
+  auto lazy = std::unique_ptr<LazyIndex>(new LazyIndex());
+  ThreadPool *pool = BackgroundPoolFor(threads, lazy->localPool);
+  std::shared_ptr<char> block(new char[size], std::default_delete<char[]>());
+
+  static_assert(Edit::CHECKPOINT_LINES % LineStore::BLOCK_LINES == 0,
+                "a lazy chunk must be whole LineStore blocks");
+  LineStore lines;
+  lines.Blank((int)deferredLines);
+  ScanSummary scan;
+  if (appended) {
+    PreadFully(fd, block.get() + deferredEnd, size - (size_t)deferredEnd,
+               (off_t)deferredEnd);
+    IndexLines(block.get(), (size_t)deferredEnd, size, pool, lines, scan);
+
+    IndexCache::Summary summary = cached;
+    summary.size = size;
+    summary.lineCount = (uint64_t)lines.Count();
+    summary.longestLine = std::max((size_t)cached.longestLine,
+                                   scan.longestLine);
+    summary.utf8.Merge(scan.utf8);
+    if (summary.firstTerm == 0)
+      summary.firstTerm = scan.firstTerm;
+    summary.finalNewline = block.get()[size - 1] == '\n';
+
+    std::vector<uint64_t> stored(checkpoints, checkpoints + chunks);
+    for (size_t i = chunks * per; i < (size_t)lines.Count(); i += per)
+      stored.push_back(lines.Get((int)i).offset);
+    IndexCache::Store(m_filename, m_disk, summary, stored, fd);
+  }
+
+  scan.utf8.Merge(cached.utf8);
+  if (cached.firstTerm != 0)
+    scan.firstTerm = cached.firstTerm;
+  scan.longestLine = std::max(scan.longestLine, (size_t)cached.longestLine);
+
+  m_lines = std::move(lines);
+  m_eol = scan.firstTerm == 2 ? LineEnding::CRLF : LineEnding::LF;
+  m_encoding = TextUtils::Classify(scan.utf8);
+  m_longestLine = scan.longestLine;
+  m_finalNewline = appended ? block.get()[size - 1] == '\n'
+                            : cached.finalNewline;
+
+  lazy->fd = fd;
+  lazy->bytes = block.get();
+  lazy->lines = &m_lines;
+  lazy->starts.assign(checkpoints, checkpoints + chunks);
+  lazy->starts.push_back(deferredEnd);
+  lazy->lineCount = (size_t)deferredLines;
+  lazy->state.reset(new std::atomic<uint8_t>[chunks]);
+  for (size_t k = 0; k < chunks; ++k)
+    lazy->state[k] = LazyIndex::PENDING;
+  ResetSource(std::move(block), size);
+
+  LazyIndex *sweep = lazy.get();
+  m_lazy = std::move(lazy);
+  m_lazy->sweeper = std::thread([sweep, pool] {
+    ForEachChunk(pool, sweep->Chunks(), [sweep](size_t k) {
+      if (!sweep->cancel.load(std::memory_order_relaxed))
+        sweep->Ensure(k);
+    });
+  });
+  return true;
+}
+
+void Buffer::FinishLoading() {
+  if (m_inflow)
+    AdoptInflated(SIZE_MAX);
+  if (!m_lazy)
+    return;
+  m_lazy->sweeper.join();
+  bool stale = m_lazy->mismatch;
+  close(m_lazy->fd);
+  m_lazy.reset();
+
+  // The sidecar lied (or the file changed mid-load). Reloading here would
+  // reshape m_lines under the edit that called us; the placeholder lines
+  // keep every index valid until the owner reloads (see Stale)
+  if (stale) {
+    IndexCache::Discard(m_filename);
+    m_stale = true;
+  }
+}
+
+bool Buffer::Stale() const {
+  return m_stale || (m_lazy && m_lazy->mismatch);
+}
+
+void Buffer::DropLazy() {
+  if (!m_lazy)
+    return;
+  m_lazy->cancel = true;
+  m_lazy->sweeper.join();
+  close(m_lazy->fd);
+  m_lazy.reset();
+}
+
+void Buffer::LoadCompressed(int fd, bool background) {
+  auto inflow = std::unique_ptr<Inflow>(new Inflow());
+  try {
+    inflow->decoder.reset(new Compression::Decoder(fd, m_compression));
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  inflow->fd = fd;
+  Inflow *run = inflow.get();
+  m_inflow = std::move(inflow);
+  m_inflow->worker = std::thread([run] { run->Run(); });
+
+  AdoptInflated(background ? 1 : SIZE_MAX);
+  if (m_lines.Count() == 0 && !m_streamError.empty())
+    throw std::runtime_error(m_filename + ": " + m_streamError);
 
-  // Handle case where file might be empty or ended with newline
   EnsureLine();
+  m_reportedLines = m_streamLines;
+  m_streaming = m_inflow != nullptr;
   m_dirty = false;
 }
 
+void Buffer::AdoptInflated(size_t minimum) {
+  Inflow &in = *m_inflow;
+  size_t adopted = 0;
+  for (;;) {
+    std::deque<Inflow::Block> blocks;
+    bool done;
+    {
+      std::unique_lock<std::mutex> lock(in.mutex);
+      if (adopted < minimum)
+        in.ready.wait(lock, [&] { return in.done || !in.blocks.empty(); });
+      blocks.swap(in.blocks);
+      done = in.done;
+    }
+
+    for (Inflow::Block &block : blocks) {
+      size_t base = 0;
+      if (m_sourceEnd == 0)
+        ResetSource(block.bytes, block.size);
+      else
+        base = AdoptBlock(block.bytes, block.size);
+      int added = block.lines.Count();
+      block.lines.Shift(base);
+      m_lines.Append(std::move(block.lines));
+      m_finalNewline = block.bytes.get()[block.size - 1] == '\n';
+      m_streamLines += added;
+      in.seen.Merge(block.scan);
+      in.pieces.push_back({block.bytes, block.size});
+    }
+    adopted += blocks.size();
+    m_eol = in.seen.firstTerm == 2 ? LineEnding::CRLF : LineEnding::LF;
+    m_encoding = TextUtils::Classify(in.seen.utf8);
+    m_longestLine = in.seen.longestLine;
+
+    if (done) {
+      in.worker.join();
+      close(in.fd);
+      m_streamError = in.error;
+      m_inflated = std::make_shared<const TextPieces>(std::move(in.pieces));
+      m_inflow.reset();
+      return;
+    }
+    if (adopted >= minimum)
+      return;
+  }
+}
+
+void Buffer::DropInflow() {
+  if (!m_inflow)
+    return;
+  m_inflow->cancel = true;
+  m_inflow->worker.join();
+  close(m_inflow->fd);
+  m_inflow.reset();
+}
+
+bool Buffer::Pump(LineEdit &appended, int line) {
+  if (!m_streaming)
+    return false;
+  if (m_inflow)
+    AdoptInflated(0);
+  while (m_inflow && m_streamLines <= line)
+    AdoptInflated(1);
+
+  appended = {m_reportedLines, 0, m_streamLines - m_reportedLines};
+  m_reportedLines = m_streamLines;
+  m_streaming = m_inflow != nullptr;
+  return appended.added > 0 || !m_streaming;
+}
+
+void Buffer::IndexLines(const char *data, size_t begin, size_t end,
+                        ThreadPool *pool, LineStore &out,
+                        ScanSummary &summary) {
+  const size_t chunkBytes = Edit::LOAD_CHUNK_BYTES;
+
+  // Cut chunks at newline boundaries so no line or UTF-8 sequence
+  // straddles two workers
+  std::vector<size_t> cuts = {begin};
+  for (size_t target = begin + chunkBytes; target < end; target += chunkBytes) {
+    if (target < cuts.back())
+      continue;
+    const void *hit = memchr(data + target, '\n', end - target);
+    if (!hit)
+      break;
+    size_t cut = (size_t)(static_cast<const char *>(hit) - data) + 1;
+    if (cut < end)
+      cuts.push_back(cut);
+  }
+  cuts.push_back(end);
+
+  // Index lines and classify bytes per chunk in parallel, each chunk into
+  // blocks of its own (a line too long for LineStore throws here)
+  struct ChunkResult {
+    LineStore lines;
+    ScanSummary summary;
+  };
+  std::vector<ChunkResult> results(cuts.size() - 1);
+
+  ForEachChunk(pool, results.size(), [&](size_t k) {
+    ChunkResult &chunk = results[k];
+    size_t start = cuts[k];
+    size_t stop = cuts[k + 1];
+    TextUtils::ScanUtf8(std::string_view(data + start, stop - start),
+                        chunk.summary.utf8);
+
+    SplitLines(data, start, stop, [&](size_t off, size_t len, int term) {
+      chunk.summary.Note(len, term);
+      chunk.lines.Push({off, len, -1, (uint8_t)term});
+    });
+  });
+
+  // Stitch the chunks' blocks together in file order
+  for (ChunkResult &chunk : results) {
+    summary.Merge(chunk.summary);
+    out.Append(std::move(chunk.lines));
+  }
+}
+
+bool Buffer::ExternallyModified() const {
+  if (m_filename.empty())
+    return false;
+  if (Stale())
+    return true; // What was indexed is not what is on disk
+  return !(StatPath(m_filename) == m_disk);
+}
+
+Buffer::ReloadResult Buffer::Reload(unsigned threads) {
+  ReloadResult result = {0, 0, 0};
+  FinishLoading();
+
+  int fd = open(m_filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open " + m_filename + ": " +
+                             std::string(strerror(errno)));
+  }
+
+  std::unique_ptr<ThreadPool> localPool;
+  ThreadPool *pool = PoolFor(threads, localPool);
+
+  std::shared_ptr<const char> source;
+  size_t size = 0;
+  DiskState disk;
+  Compression::Format format = Compression::Format::None;
+  try {
+    disk = StatFd(fd);
+    format = Compression::Sniff(fd);
+    if (format != Compression::Format::None)
+      source = InflateStream(fd, format, size);
+    else
+      ReadSource(fd, pool, source, size);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  const char *data = source.get();
+
+  // Match the current content (as Save would write it) against the new
+  // bytes from both ends; only the differing middle gets re-indexed.
+  int count = m_lines.Count();
+  LineStore lines;
+  size_t pos = 0;
+  int prefix = 0;
+  for (; prefix < count; ++prefix) {
+    std::string_view text = GetLine(prefix);
+    std::string_view eol = Terminator(prefix);
+    size_t need = text.size() + eol.size();
+    if (size - pos < need || !BytesEqual(data + pos, text) ||
+        !BytesEqual(data + pos + text.size(), eol))
+      break;
+    // An unterminated line only matches if it is the non-empty tail
+    if (eol.empty() && (text.empty() || pos + need != size))
+      break;
+    lines.Push({pos, text.size(), -1, (uint8_t)eol.size()});
+    pos += need;
+  }
+
+  int suffix = 0;
+  size_t end = size;
+  for (int i = count - 1; i >= prefix; --i) {
+    std::string_view text = GetLine(i);
+    std::string_view eol = Terminator(i);
+    size_t need = text.size() + eol.size();
+    if (end - pos < need)
+      break;
+    size_t start = end - need;
+    if (!BytesEqual(data + start, text) ||
+        !BytesEqual(data + start + text.size(), eol))
+      break;
+    if (eol.empty() && text.empty())
+      break;
+    // Must begin on a line boundary in the new bytes
+    if (start > 0 && data[start - 1] != '\n')
+      break;
+    suffix++;
+    end = start;
+  }
+
+  ScanSummary scan;
+  IndexLines(data, pos, end, pool, lines, scan);
+
+  result.firstLine = prefix;
+  result.oldLines = count - prefix - suffix;
+  result.newLines = lines.Count() - prefix;
+
+  // The matched tail, in order now that the middle is in
+  for (int i = count - suffix; i < count; ++i) {
+    std::string_view text = GetLine(i);
+    std::string_view eol = Terminator(i);
+    lines.Push({end, text.size(), -1, (uint8_t)eol.size()});
+    end += text.size() + eol.size();
+  }
+
+  // Everything is source-backed again, so the edit slots can go
+  ClearHistory();
+  m_lines = std::move(lines);
+  m_edits.clear();
+  m_freeSlots.clear();
+  m_inflated.reset();
+  if (format != Compression::Format::None)
+    m_inflated = std::make_shared<const TextPieces>(
+        TextPieces{{source, size}});
+  ResetSource(std::move(source), size);
+  m_disk = disk;
+  m_stale = false;
+  m_compression = format;
+  m_streamError.clear();
+  m_encoding = TextUtils::Combine(m_encoding, TextUtils::Classify(scan.utf8));
+  m_longestLine = std::max(m_longestLine, scan.longestLine);
+  m_finalNewline = size > 0 && data[size - 1] == '\n';
+
+  if (m_lines.Count() == 0) {
+    EnsureLine();
+    result.newLines = 1;
+  }
+  m_dirty = false;
+  return result;
+}
+
+Buffer::IngestResult Buffer::Ingest(unsigned threads) {
+  if (m_dirty || m_filename.empty())
+    return IngestResult::Unchanged;
+  FinishLoading();
+  if (m_stale) {
+    Load(m_filename, threads);
+    return IngestResult::Reset;
+  }
+
+  int fd = open(m_filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return IngestResult::Unchanged; // Mid-rotation: wait for the new file
+
+  DiskState disk = StatFd(fd);
+  if (m_compression != Compression::Format::None) {
+    // New compressed bytes cannot be inflated on their own: start over
+    close(fd);
+    if (disk == m_disk)
+      return IngestResult::Unchanged;
+    Load(m_filename, threads);
+    return IngestResult::Reset;
+  }
+
+  bool replaced = m_disk.exists && (disk.dev != m_disk.dev ||
+                                    disk.ino != m_disk.ino);
+
+  // Same inode and not shorter can still be a truncate-and-rewrite; the
+  // bytes just before the old end must still be our last line.
+  if (!replaced && disk.size >= m_disk.size && m_disk.size > 0 &&
+      !(disk == m_disk)) {
+    int last = m_lines.Count() - 1;
+    std::string expect(GetLine(last));
+    expect.append(Terminator(last).data(), Terminator(last).size());
+    size_t n = std::min(expect.size(), (size_t)64);
+    std::string found(n, '\0');
+    if (n > 0 && (pread(fd, &found[0], n, (off_t)(m_disk.size - n)) !=
+                      (ssize_t)n ||
+                  found.compare(0, n, expect, expect.size() - n, n) != 0))
+      replaced = true;
+  }
+
+  if (replaced || disk.size < m_disk.size) {
+    // Rotated or truncated: the old content is gone, start over
+    close(fd);
+    Load(m_filename, threads);
+    return IngestResult::Reset;
+  }
+  if (disk.size == m_disk.size) {
+    close(fd);
+    m_disk = disk;
+    return IngestResult::Unchanged;
+  }
+
+  // An unterminated last line may be continued by the new bytes, so it is
+  // carried into the new block and re-indexed with them.
+  int last = m_lines.Count() - 1;
+  std::string_view partial =
+      m_finalNewline ? std::string_view() : GetLine(last);
+  size_t appended = (size_t)(disk.size - m_disk.size);
+  size_t size = partial.size() + appended;
+
+  std::shared_ptr<char> block(new char[size], std::default_delete<char[]>());
+  if (!partial.empty())
+    memcpy(block.get(), partial.data(), partial.size());
+  try {
+    PreadFully(fd, block.get() + partial.size(), appended,
+               (off_t)m_disk.size);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  if (!m_finalNewline) {
+    ReleaseSlot(m_lines.Get(last).slot);
+    m_lines.Replace(last, 1, nullptr, 0);
+  }
+
+  std::unique_ptr<ThreadPool> localPool;
+  ThreadPool *pool = PoolFor(threads, localPool);
+
+  size_t base = m_sourceEnd;
+  LineStore added;
+  ScanSummary scan;
+  IndexLines(block.get(), 0, size, pool, added, scan);
+  added.Shift(base);
+  m_lines.Append(std::move(added));
+
+  const char *data = block.get();
+  m_blocks.push_back({base, size, std::move(block)});
+  m_sourceEnd += size;
+  m_encoding = TextUtils::Combine(m_encoding, TextUtils::Classify(scan.utf8));
+  m_longestLine = std::max(m_longestLine, scan.longestLine);
+  m_finalNewline = data[size - 1] == '\n';
+  m_disk = disk;
+
+  EnsureLine();
+  return IngestResult::Appended;
+}
+
+std::string_view Buffer::Terminator(int y) const {
+  bool wantTerm = (y + 1 < m_lines.Count()) || m_finalNewline;
+  if (!wantTerm)
+    return std::string_view();
+  return EolBytes(m_lines.Get(y).term, m_eol);
+}
+
 void Buffer::Save() {
   if (m_filename.empty()) {
     throw std::runtime_error("No filename specified");
   }
 
+  FinishLoading();
+  if (!m_streamError.empty())
+    throw std::runtime_error("Not saved: " + m_streamError +
+                             " - the text after the damage is missing");
+  m_disk = WriteAtomic(m_filename);
+  m_dirty = false;
+}
+
+void Buffer::SaveCopy(const std::string &path) {
+  if (path.empty()) {
+    throw std::runtime_error("No filename specified");
+  }
+  FinishLoading();
+  WriteAtomic(path);
+}
+
+Buffer::DiskState Buffer::WriteAtomic(const std::string &path) const {
   // 1. Create temp file
-  std::string tempPath = m_filename + Edit::TEMP_EXTENSION;
+  std::string tempPath = path + Edit::TEMP_EXTENSION;
 
   // O_CREAT | O_WRONLY | O_TRUNC, 0644 (Owner RW, Group R, Other R)
   int fd = open(tempPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
@@ -80,127 +1056,889 @@ void Buffer::Save() {
 
   // 2. Write content
   try {
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-      const auto &line = m_lines[i];
-      ssize_t written = write(fd, line.c_str(), line.size());
-      if (written != (ssize_t)line.size()) {
-        throw std::runtime_error("Write failed (incomplete)");
+    // Coalesce adjacent source spans so untouched regions go out verbatim
+    std::vector<struct iovec> iov;
+    const char *srcRunEnd = nullptr;
+
+    auto push = [&](const char *p, size_t n, bool fromSource) {
+      if (n == 0)
+        return;
+      if (fromSource && p == srcRunEnd) {
+        iov.back().iov_len += n;
+      } else {
+        iov.push_back({const_cast<char *>(p), n});
       }
+      srcRunEnd = fromSource ? p + n : nullptr;
+    };
+
+    int i = 0, count = m_lines.Count();
+    m_lines.ForEach([&](const LineRef &ref) {
+      bool wantTerm = (++i < count) || m_finalNewline;
 
-      if (i < m_lines.size() - 1) {
-        if (write(fd, "\n", 1) != 1)
-          throw std::runtime_error("Write newline failed");
+      if (ref.slot < 0) {
+        size_t n = ref.length;
+        if (wantTerm && ref.term > 0) {
+          n += ref.term;
+          wantTerm = false;
+        }
+        push(SourceAt(ref.offset), n, true);
+      } else {
+        const std::string &text = m_edits[ref.slot];
+        push(text.data(), text.size(), false);
       }
-    }
+
+      if (wantTerm) {
+        const char *eol = EolBytes(ref.term, m_eol);
+        push(eol, strlen(eol), false);
+      }
+    });
+
+    if (m_compression != Compression::Format::None)
+      Compression::Write(fd, m_compression, iov);
+    else
+      WriteVec(fd, iov);
 
     // 3. Sync to disk
     if (fsync(fd) != 0) {
       throw std::runtime_error("Disk sync failed: " +
                                std::string(strerror(errno)));
     }
+    DiskState written = StatFd(fd); // Survives the rename below
 
     if (close(fd) != 0) {
+      fd = -1;
       throw std::runtime_error("Close failed: " + std::string(strerror(errno)));
     }
+    fd = -1;
 
     // 4. Atomic Rename
-    if (rename(tempPath.c_str(), m_filename.c_str()) != 0) {
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
       throw std::runtime_error("Atomic rename failed: " +
                                std::string(strerror(errno)));
     }
 
-    m_dirty = false;
+    return written;
 
   } catch (...) {
     // Cleanup temp file on any failure
-    close(fd); // Safe to call even if closed, though errno might be EBADF
+    if (fd >= 0)
+      close(fd);
     unlink(tempPath.c_str());
     throw; // Re-throw to UI
   }
 }
 
-const std::string &Buffer::GetLine(int y) const {
-  static const std::string empty = "";
-  if (y < 0 || y >= (int)m_lines.size())
-    return empty;
-  return m_lines[y];
+std::string_view Buffer::GetLine(int y) const {
+  if (y < 0 || y >= m_lines.Count())
+    return std::string_view();
+  if (m_lazy && (size_t)y < m_lazy->lineCount)
+    m_lazy->Ensure((size_t)y / Edit::CHECKPOINT_LINES);
+  return Text(m_lines.Get(y));
 }
 
-int Buffer::LineCount() const { return (int)m_lines.size(); }
+int Buffer::LineCount() const { return m_lines.Count(); }
 
 bool Buffer::IsDirty() const { return m_dirty; }
 
+int32_t Buffer::AllocSlot(std::string text) {
+  if (!m_freeSlots.empty()) {
+    int32_t slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    m_edits[slot] = std::move(text);
+    return slot;
+  }
+  m_edits.push_back(std::move(text));
+  return (int32_t)m_edits.size() - 1;
+}
+
+std::string &Buffer::Mutable(int y) {
+  LineRef ref = m_lines.Get(y);
+  if (ref.slot < 0) {
+    ref.slot = AllocSlot(std::string(SourceAt(ref.offset), ref.length));
+    m_lines.Set(y, ref);
+  }
+  return m_edits[ref.slot];
+}
+
+void Buffer::NoteText(std::string_view text) {
+  TextUtils::Utf8Stats utf8;
+  TextUtils::ScanUtf8(text, utf8);
+  m_encoding = TextUtils::Combine(m_encoding, TextUtils::Classify(utf8));
+}
+
+void Buffer::ReleaseSlot(int32_t slot) {
+  if (slot < 0)
+    return;
+  std::string().swap(m_edits[slot]);
+  m_freeSlots.push_back(slot);
+}
+
 void Buffer::InsertChar(int y, int x, int c) {
-  if (y < 0 || y >= (int)m_lines.size())
+  FinishLoading();
+  if (y < 0 || y >= m_lines.Count())
     return;
 
   // Bounds check x
+  int len = (int)GetLine(y).size();
   if (x < 0)
     x = 0;
-  if (x > (int)m_lines[y].size())
-    x = (int)m_lines[y].size();
+  if (x > len)
+    x = len;
 
-  m_lines[y].insert(x, 1, (char)c);
+  char byte = (char)c;
+  Mutable(y).insert(x, 1, byte);
+  NoteText(std::string_view(&byte, 1));
+  NoteLineEdit(y, 1, 1);
   m_dirty = true;
+  if (!m_replaying)
+    Record({{y, x}, {y, x}, {y, x + 1}, Clip(), Copy({y, x}, {y, x + 1})});
 }
 
 void Buffer::InsertString(int y, int x, const std::string &str) {
-  if (y < 0 || y >= (int)m_lines.size())
+  FinishLoading();
+  if (y < 0 || y >= m_lines.Count())
     return;
 
   // Bounds check x
+  int len = (int)GetLine(y).size();
   if (x < 0)
     x = 0;
-  if (x > (int)m_lines[y].size())
-    x = (int)m_lines[y].size();
+  if (x > len)
+    x = len;
 
-  m_lines[y].insert(x, str);
+  Mutable(y).insert(x, str);
+  NoteText(str);
+  NoteLineEdit(y, 1, 1);
   m_dirty = true;
+  if (!m_replaying) {
+    Position end = {y, x + (int)str.size()};
+    Record({{y, x}, {y, x}, end, Clip(), Copy({y, x}, end)});
+  }
 }
 
 void Buffer::InsertNewLine(int y, int x) {
-  if (y < 0 || y >= (int)m_lines.size())
+  FinishLoading();
+  if (y < 0 || y >= m_lines.Count())
     return;
 
+  int len = (int)GetLine(y).size();
   if (x < 0)
     x = 0;
-  if (x > (int)m_lines[y].size())
-    x = (int)m_lines[y].size();
+  if (x > len)
+    x = len;
 
-  // Split current line
-  std::string current = m_lines[y];
-  std::string nextLineContent = current.substr(x);
+  LineRef head = m_lines.Get(y);
+  LineRef tail = {0, 0, -1, head.term};
 
-  // Truncate current
-  m_lines[y] = current.substr(0, x);
+  if (x == len && IsDefaultEol(head.term, m_eol)) {
+    // Enter at end of line: current line stays untouched on disk
+    tail.term = 0;
+  } else if (x == len) {
+    // A foreign terminator moves down with the split, as in the cases below,
+    // so that joining the lines again restores it
+    head.term = 0;
+    tail.slot = AllocSlot(std::string());
+  } else if (head.slot < 0) {
+    // Split a source span without copying either half
+    tail.offset = head.offset + x;
+    tail.length = head.length - x;
+    head.length = x;
+    head.term = 0;
+  } else {
+    std::string &text = m_edits[head.slot];
+    std::string rest = text.substr(x);
+    text.resize(x);
+    head.term = 0;
+    tail.slot = AllocSlot(std::move(rest));
+  }
 
-  // Insert new line after
-  m_lines.insert(m_lines.begin() + y + 1, nextLineContent);
+  LineRef both[] = {head, tail};
+  m_lines.Replace(y, 1, both, 2);
 
+  NoteLineEdit(y, 1, 2);
   m_dirty = true;
+  if (!m_replaying)
+    Record({{y, x}, {y, x}, {y + 1, 0}, Clip(), Copy({y, x}, {y + 1, 0})});
 }
 
 void Buffer::DeleteChar(int y, int x) {
-  if (y < 0 || y >= (int)m_lines.size())
+  FinishLoading();
+  if (y < 0 || y >= m_lines.Count())
     return;
 
   // Case 1: Standard character deletion (backspace within line)
   if (x > 0) {
-    size_t prevIdx = TextUtils::PrevCharIdx(m_lines[y], x);
+    std::string_view line = GetLine(y);
+    if (x > (int)line.size())
+      return;
+    size_t prevIdx = TextUtils::KernelsFor(m_encoding).PrevCharIdx(line, x);
     size_t count = x - prevIdx;
 
-    if (prevIdx < m_lines[y].size()) {
-      m_lines[y].erase(prevIdx, count);
-      m_dirty = true;
-    }
+    Position from = {y, (int)prevIdx};
+    if (!m_replaying)
+      Record({from, {y, x}, from, Copy(from, {y, x}), Clip()});
+    Mutable(y).erase(prevIdx, count);
+    NoteLineEdit(y, 1, 1);
+    m_dirty = true;
   }
   // Case 2: Line merge (backspace at start of line)
   else if (y > 0) {
-    std::string current = m_lines[y];
-    std::string prev = m_lines[y - 1];
+    Position from = {y - 1, (int)GetLine(y - 1).size()};
+    if (!m_replaying)
+      Record({from, {y, 0}, from, Copy(from, {y, 0}), Clip()});
+
+    // Materialize the target first: it may grow m_edits and move slots
+    std::string &prev = Mutable(y - 1);
+    std::string_view current = GetLine(y);
+    prev.append(current.data(), current.size());
 
-    m_lines[y - 1] = prev + current;
-    m_lines.erase(m_lines.begin() + y);
+    LineRef joined = m_lines.Get(y - 1);
+    LineRef gone = m_lines.Get(y);
+    joined.term = gone.term;
+    ReleaseSlot(gone.slot);
+    m_lines.Replace(y - 1, 2, &joined, 1);
+    NoteLineEdit(y - 1, 2, 1);
     m_dirty = true;
   }
 }
+
+size_t Buffer::Clip::Size() const {
+  size_t total = 0;
+  for (const Piece &piece : pieces)
+    total += piece.length;
+  return total;
+}
+
+Buffer::Clip Buffer::Copy(Position from, Position to) const {
+  Clip clip;
+  if (to < from)
+    std::swap(from, to);
+  int count = m_lines.Count();
+  from.y = std::max(0, std::min(from.y, count - 1));
+  to.y = std::max(0, std::min(to.y, count - 1));
+
+  // Edited text is gathered here and flushed as one owned piece
+  std::string owned;
+  auto flushOwned = [&] {
+    if (owned.empty())
+      return;
+    auto bytes = std::make_shared<std::string>(std::move(owned));
+    owned.clear();
+    clip.pieces.push_back({std::shared_ptr<const char>(bytes, bytes->data()),
+                           bytes->size(), 0, bytes->size()});
+  };
+
+  // Source spans extend the previous piece when they continue it
+  auto pushSource = [&](size_t offset, size_t length) {
+    if (length == 0)
+      return;
+    flushOwned();
+    const SourceBlock &block = BlockAt(offset);
+    size_t local = offset - block.base;
+    if (!clip.pieces.empty()) {
+      Clip::Piece &last = clip.pieces.back();
+      if (last.block.get() == block.bytes.get() &&
+          last.offset + last.length == local) {
+        last.length += length;
+        return;
+      }
+    }
+    clip.pieces.push_back({block.bytes, block.size, local, length});
+  };
+
+  for (int y = from.y; y <= to.y; ++y) {
+    std::string_view text = GetLine(y);
+    size_t sx = y == from.y ? (size_t)std::max(0, from.x) : 0;
+    size_t ex = y == to.y ? (size_t)std::max(0, to.x) : text.size();
+    ex = std::min(ex, text.size());
+    sx = std::min(sx, ex);
+    bool withTerm = y < to.y;
+
+    LineRef ref = m_lines.Get(y);
+    if (ref.slot < 0) {
+      // A terminator still in the source rides along with the span
+      bool termInSource = withTerm && ref.term > 0;
+      pushSource(ref.offset + sx, ex - sx + (termInSource ? ref.term : 0));
+      if (withTerm && !termInSource) {
+        std::string_view eol = Terminator(y);
+        owned.append(eol.data(), eol.size());
+      }
+    } else {
+      owned.append(text.data() + sx, ex - sx);
+      if (withTerm) {
+        std::string_view eol = Terminator(y);
+        owned.append(eol.data(), eol.size());
+      }
+    }
+  }
+  flushOwned();
+  return clip;
+}
+
+Buffer::Position Buffer::DeleteRange(Position from, Position to) {
+  FinishLoading();
+  if (to < from)
+    std::swap(from, to);
+  int count = m_lines.Count();
+  if (from.y < 0)
+    from = {0, 0};
+  if (from.y >= count)
+    return {count - 1, (int)GetLine(count - 1).size()};
+  if (to.y >= count)
+    to = {count - 1, (int)GetLine(count - 1).size()};
+
+  size_t sx = std::min((size_t)std::max(0, from.x), GetLine(from.y).size());
+  size_t ex = std::min((size_t)std::max(0, to.x), GetLine(to.y).size());
+  from.x = (int)sx;
+  to.x = (int)ex;
+  if (!(from < to))
+    return from;
+  if (!m_replaying)
+    Record({from, to, from, Copy(from, to), Clip()});
+
+  if (from.y == to.y) {
+    LineRef ref = m_lines.Get(from.y);
+    if (ref.slot < 0 && sx == 0) {
+      // Dropping a prefix or suffix of a span needs no copy
+      ref.offset += ex;
+      ref.length -= ex;
+      m_lines.Set(from.y, ref);
+    } else if (ref.slot < 0 && ex == ref.length &&
+               IsDefaultEol(ref.term, m_eol)) {
+      ref.length = sx;
+      ref.term = 0; // The source bytes after it are no longer a terminator
+      m_lines.Set(from.y, ref);
+    } else {
+      Mutable(from.y).erase(sx, ex - sx);
+    }
+    NoteLineEdit(from.y, 1, 1);
+    m_dirty = true;
+    return from;
+  }
+
+  // Join the head of the first line with the tail of the last one
+  LineRef last = m_lines.Get(to.y);
+  LineRef head;
+  if (sx == 0 && last.slot < 0) {
+    ReleaseSlot(m_lines.Get(from.y).slot);
+    head = {last.offset + ex, last.length - ex, -1, last.term};
+  } else {
+    std::string &text = Mutable(from.y);
+    text.resize(sx);
+    std::string_view rest = Text(last).substr(ex);
+    text.append(rest.data(), rest.size());
+    head = m_lines.Get(from.y);
+    head.term = last.term;
+  }
+
+  for (int y = from.y + 1; y <= to.y; ++y)
+    ReleaseSlot(m_lines.Get(y).slot);
+  m_lines.Replace(from.y, to.y - from.y + 1, &head, 1);
+  NoteLineEdit(from.y, to.y - from.y + 1, 1);
+  m_dirty = true;
+  return from;
+}
+
+Buffer::Position Buffer::InsertClip(Position at, const Clip &clip) {
+  FinishLoading();
+  if (at.y < 0 || at.y >= m_lines.Count())
+    return at;
+  at.x = (int)std::min((size_t)std::max(0, at.x), GetLine(at.y).size());
+
+  // Index the clip into lines of this buffer's source space. All but the
+  // last are terminated; the last is the (possibly empty) fragment that
+  // joins the text after the insertion point.
+  std::vector<LineRef> lines;
+  LineStore pieceLines;
+  ScanSummary scan;
+  bool open = false; // lines.back() is an unterminated fragment
+  for (const Clip::Piece &piece : clip.pieces) {
+    if (piece.length == 0)
+      continue;
+    size_t base = AdoptBlock(piece.block, piece.blockSize);
+    pieceLines.Clear();
+    IndexLines(piece.block.get(), piece.offset, piece.offset + piece.length,
+               &ThreadPool::Shared(), pieceLines, scan);
+    pieceLines.Shift(base);
+
+    // A line split across two pieces is joined in an edit slot
+    size_t skip = 0;
+    if (open) {
+      LineRef &head = lines.back();
+      std::string text(Text(head));
+      LineRef join = pieceLines.Get(0);
+      std::string_view more = Text(join);
+      text.append(more.data(), more.size());
+      ReleaseSlot(head.slot);
+      uint8_t term = join.term;
+      size_t length = text.size();
+      head = {0, length, AllocSlot(std::move(text)), term};
+      skip = 1;
+    }
+    pieceLines.ForEach([&](const LineRef &ref) {
+      if (skip > 0)
+        skip--;
+      else
+        lines.push_back(ref);
+    });
+    open = piece.block.get()[piece.offset + piece.length - 1] != '\n';
+  }
+  if (!open)
+    lines.push_back({0, 0, -1, 0});
+
+  if (lines.size() == 1) {
+    // No line break: a plain insertion into the current line
+    std::string text(Text(lines[0]));
+    ReleaseSlot(lines[0].slot);
+    if (text.empty())
+      return at;
+    Mutable(at.y).insert(at.x, text);
+    m_encoding =
+        TextUtils::Combine(m_encoding, TextUtils::Classify(scan.utf8));
+    NoteLineEdit(at.y, 1, 1);
+    m_dirty = true;
+    Position end = {at.y, at.x + (int)text.size()};
+    if (!m_replaying)
+      Record({at, at, end, Clip(), clip});
+    return end;
+  }
+
+  LineRef orig = m_lines.Get(at.y);
+  LineRef &first = lines.front();
+  LineRef &last = lines.back();
+  int endX = (int)Text(last).size();
+
+  // Copy out what the boundary lines need before slots move around
+  size_t origLength = Text(orig).size();
+  std::string before(at.x > 0 ? Text(orig).substr(0, at.x) : "");
+  bool keepTail = last.slot < 0 && last.length == 0 && orig.slot < 0;
+  std::string after(keepTail ? "" : Text(orig).substr(at.x));
+
+  // First line: text before the insertion point, then the clip's first line
+  if (at.x > 0) {
+    std::string_view head = Text(first);
+    before.append(head.data(), head.size());
+    ReleaseSlot(first.slot);
+    uint8_t term = first.term;
+    size_t length = before.size();
+    first = {0, length, AllocSlot(std::move(before)), term};
+  }
+
+  // Last line: the clip's fragment, then the rest of the original line
+  if (keepTail) {
+    last = {orig.offset + at.x, origLength - at.x, -1, orig.term};
+  } else if (after.empty() && last.slot < 0 && IsDefaultEol(orig.term, m_eol)) {
+    last.term = 0; // Span ends mid-source; Save supplies the terminator
+  } else {
+    std::string text(Text(last));
+    text += after;
+    ReleaseSlot(last.slot);
+    size_t length = text.size();
+    last = {0, length, AllocSlot(std::move(text)), orig.term};
+  }
+
+  ReleaseSlot(orig.slot);
+  m_lines.Replace(at.y, 1, lines);
+
+  m_encoding = TextUtils::Combine(m_encoding, TextUtils::Classify(scan.utf8));
+  m_longestLine = std::max(m_longestLine, scan.longestLine);
+  NoteLineEdit(at.y, 1, (int)lines.size());
+  m_dirty = true;
+  Position end = {at.y + (int)lines.size() - 1, endX};
+  if (!m_replaying)
+    Record({at, at, end, Clip(), clip});
+  return end;
+}
+
+std::vector<Buffer::Position>
+Buffer::ReplaceRanges(const std::vector<Range> &ranges, std::string_view text) {
+  Clip clip = ClipFromText(text);
+  return Splice(ranges, std::vector<const Clip *>(ranges.size(), &clip));
+}
+
+std::vector<Buffer::Position>
+Buffer::Splice(const std::vector<Range> &ranges,
+               const std::vector<const Clip *> &clips) {
+  std::vector<Position> ends;
+  if (ranges.empty())
+    return ends;
+  FinishLoading();
+
+  // Clamp into the text; callers guarantee order and no overlap
+  int count = m_lines.Count();
+  std::vector<Range> rs(ranges);
+  for (Range &r : rs) {
+    for (Position *p : {&r.from, &r.to}) {
+      p->y = std::max(0, std::min(p->y, count - 1));
+      p->x = (int)std::min((size_t)std::max(0, p->x), GetLine(p->y).size());
+    }
+  }
+
+  // Journal what goes away before anything moves; the batch is one step
+  BeginUndoGroup();
+  std::vector<Clip> removed(rs.size());
+  uint32_t batch = 0;
+  if (!m_replaying) {
+    for (size_t i = 0; i < rs.size(); ++i) {
+      if (rs[i].from < rs[i].to)
+        removed[i] = Copy(rs[i].from, rs[i].to);
+    }
+    batch = ++m_batches;
+  }
+
+  // Rebuild lines [first, last] in one pass. Lines no range touches keep
+  // their references; assembled lines go to fresh edit slots.
+  const int first = rs.front().from.y;
+  std::vector<LineRef> out;
+  std::vector<int32_t> consumed; // Slots of replaced lines, freed at the end
+  std::string cur;               // Output line being assembled
+  int py = first;                // Next unconsumed original text
+  size_t px = 0;
+  size_t longest = 0;
+  out.reserve((size_t)(rs.back().to.y - first + 1));
+
+  auto emit = [&](uint8_t term) {
+    size_t length = cur.size();
+    longest = std::max(longest, length);
+    out.push_back({0, length, AllocSlot(std::move(cur)), term});
+    cur.clear();
+  };
+  // Finish original line py from px, as is when nothing changed
+  auto finishLine = [&] {
+    LineRef ref = m_lines.Get(py);
+    if (px == 0 && cur.empty()) {
+      out.push_back(ref);
+      return;
+    }
+    std::string_view rest = Text(ref).substr(px);
+    cur.append(rest.data(), rest.size());
+    consumed.push_back(ref.slot);
+    emit(ref.term);
+  };
+  // Append clip bytes, ending a line at each "\n" or "\r\n"
+  auto append = [&](const Clip &clip) {
+    size_t mark = cur.size(); // A '\r' before this is not the clip's
+    for (const Clip::Piece &piece : clip.pieces) {
+      const char *p = piece.block.get() + piece.offset;
+      const char *end = p + piece.length;
+      while (p < end) {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!nl) {
+          cur.append(p, end - p);
+          break;
+        }
+        cur.append(p, nl - p);
+        uint8_t term = 1;
+        if (cur.size() > mark && cur.back() == '\r') {
+          cur.pop_back();
+          term = 2;
+        }
+        emit(term);
+        mark = 0;
+        p = nl + 1;
+      }
+    }
+  };
+
+  ends.reserve(rs.size());
+  for (size_t i = 0; i < rs.size(); ++i) {
+    const Range &r = rs[i];
+    for (; py < r.from.y; ++py, px = 0)
+      finishLine();
+    std::string_view head = Text(m_lines.Get(py));
+    cur.append(head.data() + px, (size_t)r.from.x - px);
+
+    Position at = {first + (int)out.size(), (int)cur.size()};
+    append(*clips[i]);
+    Position end = {first + (int)out.size(), (int)cur.size()};
+    ends.push_back(end);
+
+    if (!m_replaying && (r.from != r.to || !clips[i]->Empty())) {
+      Position removedEnd =
+          r.from.y == r.to.y
+              ? Position{at.y, at.x + (r.to.x - r.from.x)}
+              : Position{at.y + (r.to.y - r.from.y), r.to.x};
+      Record({at, removedEnd, end, std::move(removed[i]), *clips[i], batch,
+              r});
+    }
+
+    for (int y = r.from.y; y < r.to.y; ++y)
+      consumed.push_back(m_lines.Get(y).slot);
+    py = r.to.y;
+    px = (size_t)r.to.x;
+  }
+  finishLine();
+
+  EndUndoGroup();
+
+  m_lines.Replace(first, py - first + 1, out);
+  for (int32_t slot : consumed)
+    ReleaseSlot(slot);
+  NoteLineEdit(first, py - first + 1, (int)out.size());
+
+  // Runs of ranges usually share one clip; scan each distinct clip once
+  TextUtils::Utf8Stats utf8;
+  for (size_t i = 0; i < clips.size(); ++i) {
+    if (i > 0 && clips[i] == clips[i - 1])
+      continue;
+    for (const Clip::Piece &piece : clips[i]->pieces) {
+      TextUtils::ScanUtf8(
+          std::string_view(piece.block.get() + piece.offset, piece.length),
+          utf8);
+    }
+  }
+  m_encoding = TextUtils::Combine(m_encoding, TextUtils::Classify(utf8));
+  m_longestLine = std::max(m_longestLine, longest);
+  m_dirty = true;
+  return ends;
+}
+
+Buffer::Position Buffer::ReorderLines(int first, int count,
+                                      const std::vector<uint32_t> &order) {
+  FinishLoading();
+  int total = m_lines.Count();
+  first = std::max(0, std::min(first, total - 1));
+  count = std::max(0, std::min(count, total - first));
+  Position at = {first, 0};
+  if (count == 0)
+    return at;
+
+  int last = first + count - 1;
+  if (order.empty()) {
+    // Nothing kept: delete the lines along with one line break
+    if (last + 1 < total)
+      DeleteRange(at, {last + 1, 0});
+    else if (first > 0)
+      DeleteRange({first - 1, (int)GetLine(first - 1).size()},
+                  {last, (int)GetLine(last).size()});
+    else
+      DeleteRange(at, {last, (int)GetLine(last).size()});
+    return {std::min(first, m_lines.Count() - 1), 0};
+  }
+
+  Position removedEnd = {last, (int)GetLine(last).size()};
+  Clip removed;
+  if (!m_replaying)
+    removed = Copy(at, removedEnd);
+
+  std::vector<LineRef> lines;
+  std::vector<bool> kept((size_t)count, false);
+  lines.reserve(order.size());
+  for (uint32_t i : order) {
+    if (i >= (uint32_t)count || kept[i])
+      continue;
+    kept[i] = true;
+    lines.push_back(m_lines.Get(first + i));
+  }
+  for (int i = 0; i < count; ++i) {
+    if (!kept[(size_t)i])
+      ReleaseSlot(m_lines.Get(first + i).slot);
+  }
+
+  m_lines.Replace(first, count, lines);
+  NoteLineEdit(first, count, (int)lines.size());
+  m_dirty = true;
+
+  if (!m_replaying) {
+    int end = first + (int)lines.size() - 1;
+    Change change = {at, removedEnd, {end, (int)GetLine(end).size()},
+                     std::move(removed), Clip()};
+    change.order = std::make_shared<const std::vector<uint32_t>>(order);
+    Record(std::move(change));
+  }
+  return at;
+}
+
+Buffer::Clip Buffer::ClipFromText(std::string_view text) const {
+  Clip clip;
+  if (text.empty())
+    return clip;
+
+  const char *eol = EolBytes(0, m_eol);
+  auto bytes = std::make_shared<std::string>();
+  for (char c : text) {
+    if (c == '\n')
+      bytes->append(eol);
+    else
+      bytes->push_back(c);
+  }
+  clip.pieces.push_back({std::shared_ptr<const char>(bytes, bytes->data()),
+                         bytes->size(), 0, bytes->size()});
+  return clip;
+}
+
+void Buffer::Record(Change change) {
+  if (m_replaying)
+    return;
+  m_redo.clear();
+  if (m_undoDepth == 0 || !m_groupOpen) {
+    if (m_undo.size() >= Edit::UNDO_LIMIT)
+      m_undo.pop_front();
+    m_undo.emplace_back();
+    m_groupOpen = m_undoDepth > 0;
+  }
+  m_undo.back().push_back(std::move(change));
+}
+
+void Buffer::ClearHistory() {
+  m_undo.clear();
+  m_redo.clear();
+  m_groupOpen = false;
+}
+
+void Buffer::NoteLineEdit(int first, int removed, int added) {
+  if (!m_lineEdited) {
+    m_lineEdit = {first, removed, added};
+    m_lineEdited = true;
+    return;
+  }
+
+  // Cover both ranges; lines between them count as replaced by themselves
+  LineEdit &e = m_lineEdit;
+  int lo = std::min(e.first, first);
+  int hi = std::max(e.first + e.added, first + removed);
+  e = {lo, hi - lo - e.added + e.removed, hi - lo - removed + added};
+}
+
+bool Buffer::TakeLineEdit(LineEdit &edit) {
+  if (!m_lineEdited)
+    return false;
+  edit = m_lineEdit;
+  m_lineEdited = false;
+  return true;
+}
+
+Buffer::MemoryUsage Buffer::Memory() const {
+  MemoryUsage usage = {0, 0, 0, 0};
+  std::unordered_set<const char *> held;
+  for (const SourceBlock &block : m_blocks) {
+    usage.text += block.size;
+    held.insert(block.bytes.get());
+  }
+  usage.text += m_blocks.capacity() * sizeof(SourceBlock);
+
+  usage.lines = m_lines.MemoryBytes();
+  if (m_lazy)
+    usage.lines += m_lazy->starts.capacity() * sizeof(uint64_t) +
+                   m_lazy->Chunks() * sizeof(std::atomic<uint8_t>);
+
+  const size_t inlineCapacity = std::string().capacity(); // SSO
+  usage.edits = m_edits.capacity() * sizeof(std::string) +
+                m_freeSlots.capacity() * sizeof(int32_t);
+  for (const std::string &text : m_edits) {
+    if (text.capacity() > inlineCapacity)
+      usage.edits += text.capacity() + 1;
+  }
+
+  // Clips mostly point into source blocks; count other blocks once
+  auto clip = [&](const Clip &c) {
+    usage.undo += c.pieces.capacity() * sizeof(Clip::Piece);
+    for (const Clip::Piece &piece : c.pieces) {
+      if (held.insert(piece.block.get()).second)
+        usage.undo += piece.blockSize;
+    }
+  };
+  for (const auto *history : {&m_undo, &m_redo}) {
+    usage.undo += history->size() * sizeof(std::vector<Change>);
+    for (const std::vector<Change> &group : *history) {
+      usage.undo += group.capacity() * sizeof(Change);
+      for (const Change &change : group) {
+        clip(change.removed);
+        clip(change.inserted);
+        if (change.order)
+          usage.undo += change.order->capacity() * sizeof(uint32_t);
+      }
+    }
+  }
+  return usage;
+}
+
+void Buffer::BeginUndoGroup() {
+  if (m_undoDepth++ == 0)
+    m_groupOpen = false;
+}
+
+void Buffer::EndUndoGroup() {
+  if (m_undoDepth > 0 && --m_undoDepth == 0)
+    m_groupOpen = false;
+}
+
+bool Buffer::Undo(Position &cursor) {
+  if (m_undo.empty())
+    return false;
+  FinishLoading();
+
+  std::vector<Change> group = std::move(m_undo.back());
+  m_undo.pop_back();
+  m_groupOpen = false;
+
+  // Later changes were made on top of earlier ones: unwind in reverse, a
+  // batch at a time
+  m_replaying = true;
+  for (size_t end = group.size(); end > 0;) {
+    size_t begin = end - 1;
+    uint32_t batch = group[begin].batch;
+    if (batch == 0) {
+      DeleteRange(group[begin].at, group[begin].insertedEnd);
+      InsertClip(group[begin].at, group[begin].removed);
+      end = begin;
+      continue;
+    }
+    while (begin > 0 && group[begin - 1].batch == batch)
+      begin--;
+    std::vector<Range> ranges;
+    std::vector<const Clip *> clips;
+    for (size_t i = begin; i < end; ++i) {
+      ranges.push_back({group[i].at, group[i].insertedEnd});
+      clips.push_back(&group[i].removed);
+    }
+    Splice(ranges, clips);
+    end = begin;
+  }
+  m_replaying = false;
+
+  cursor = group.front().batch != 0 ? group.front().before.from
+                                    : group.front().at;
+  m_redo.push_back(std::move(group));
+  m_dirty = true;
+  return true;
+}
+
+bool Buffer::Redo(Position &cursor) {
+  if (m_redo.empty())
+    return false;
+  FinishLoading();
+
+  std::vector<Change> group = std::move(m_redo.back());
+  m_redo.pop_back();
+  m_groupOpen = false;
+
+  m_replaying = true;
+  for (size_t begin = 0; begin < group.size();) {
+    uint32_t batch = group[begin].batch;
+    if (group[begin].order) {
+      const Change &c = group[begin++];
+      ReorderLines(c.at.y, c.removedEnd.y - c.at.y + 1, *c.order);
+      continue;
+    }
+    if (batch == 0) {
+      DeleteRange(group[begin].at, group[begin].removedEnd);
+      InsertClip(group[begin].at, group[begin].inserted);
+      begin++;
+      continue;
+    }
+    std::vector<Range> ranges;
+    std::vector<const Clip *> clips;
+    for (; begin < group.size() && group[begin].batch == batch; ++begin) {
+      ranges.push_back(group[begin].before);
+      clips.push_back(&group[begin].inserted);
+    }
+    Splice(ranges, clips);
+  }
+  m_replaying = false;
+
+  cursor = group.back().insertedEnd;
+  m_undo.push_back(std::move(group));
+  m_dirty = true;
+  return true;
+}
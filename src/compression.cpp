@@ -0,0 +1,395 @@
+/**
+ * @file compression.cpp
+ * @brief Compression implementation: format sniffing, streaming inflate
+ * and recompression through zlib (and libzstd when built in).
+ * @author rahuldangeofficial
+ */
+
+#include "../include/compression.hpp"
+#include "../include/constants.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef EDIT_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+/// Compressed bytes read (and written) per system call.
+const size_t IO_BYTES = 256 * 1024;
+
+// EDIT_INFLATE_CHECKPOINT outside these bounds is ignored
+const size_t MIN_CHECKPOINT_BYTES = 64 * 1024;
+const size_t MAX_CHECKPOINT_BYTES = 1024 * 1024 * 1024;
+
+const unsigned char GZIP_MAGIC[3] = {0x1f, 0x8b, 0x08}; // deflate method
+const unsigned char ZSTD_MAGIC[4] = {0x28, 0xb5, 0x2f, 0xfd};
+
+/// Write all n bytes, retrying short writes.
+void WriteAll(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t written = write(fd, p, n);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("Write failed: " + std::string(strerror(errno)));
+    }
+    p += written;
+    n -= (size_t)written;
+  }
+}
+
+void WriteGzip(int fd, const std::vector<iovec> &iov) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  // 15 + 16: largest window, with a gzip header and trailer
+  if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    throw std::runtime_error("Cannot start gzip compression");
+
+  std::unique_ptr<char[]> out(new char[IO_BYTES]);
+  auto pump = [&](const char *p, size_t n, int flush) {
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(p));
+    z.avail_in = (uInt)n;
+    int rc;
+    do {
+      z.next_out = reinterpret_cast<Bytef *>(out.get());
+      z.avail_out = (uInt)IO_BYTES;
+      rc = deflate(&z, flush);
+      if (rc == Z_STREAM_ERROR)
+        throw std::runtime_error("gzip compression failed");
+      WriteAll(fd, out.get(), IO_BYTES - z.avail_out);
+    } while (z.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+  };
+
+  try {
+    for (const iovec &v : iov) {
+      // avail_in is 32 bits wide; feed huge runs in pieces
+      const char *p = static_cast<const char *>(v.iov_base);
+      for (size_t left = v.iov_len; left > 0;) {
+        size_t n = std::min(left, (size_t)1 << 30);
+        pump(p, n, Z_NO_FLUSH);
+        p += n;
+        left -= n;
+      }
+    }
+    pump(nullptr, 0, Z_FINISH);
+  } catch (...) {
+    deflateEnd(&z);
+    throw;
+  }
+  deflateEnd(&z);
+}
+
+#ifdef EDIT_ZSTD
+void WriteZstd(int fd, const std::vector<iovec> &iov) {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  if (!cctx)
+    throw std::runtime_error("Cannot start zstd compression");
+
+  std::unique_ptr<char[]> out(new char[IO_BYTES]);
+  auto pump = [&](const char *p, size_t n, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer in = {p, n, 0};
+    size_t left;
+    do {
+      ZSTD_outBuffer ob = {out.get(), IO_BYTES, 0};
+      left = ZSTD_compressStream2(cctx, &ob, &in, mode);
+      if (ZSTD_isError(left))
+        throw std::runtime_error(std::string("zstd compression failed: ") +
+                                 ZSTD_getErrorName(left));
+      WriteAll(fd, out.get(), ob.pos);
+    } while (mode == ZSTD_e_end ? left != 0 : in.pos < in.size);
+  };
+
+  try {
+    for (const iovec &v : iov)
+      pump(static_cast<const char *>(v.iov_base), v.iov_len, ZSTD_e_continue);
+    pump(nullptr, 0, ZSTD_e_end);
+  } catch (...) {
+    ZSTD_freeCCtx(cctx);
+    throw;
+  }
+  ZSTD_freeCCtx(cctx);
+}
+#endif
+} // namespace
+
+Compression::Format Compression::Detect(const char *head, size_t n) {
+  if (n >= sizeof(GZIP_MAGIC) &&
+      memcmp(head, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0)
+    return Format::Gzip;
+  if (n >= sizeof(ZSTD_MAGIC) &&
+      memcmp(head, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0)
+    return Format::Zstd;
+  return Format::None;
+}
+
+Compression::Format Compression::Sniff(int fd) {
+  char head[4];
+  ssize_t n;
+  do {
+    n = pread(fd, head, sizeof(head), 0);
+  } while (n < 0 && errno == EINTR);
+  return n > 0 ? Detect(head, (size_t)n) : Format::None;
+}
+
+Compression::Format Compression::Probe(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return Format::None;
+  Format format = Sniff(fd);
+  close(fd);
+  return format;
+}
+
+bool Compression::Supported(Format format) {
+#ifdef EDIT_ZSTD
+  return format != Format::None;
+#else
+  return format == Format::Gzip;
+#endif
+}
+
+const char *Compression::Name(Format format) {
+  switch (format) {
+  case Format::Gzip:
+    return "gzip";
+  case Format::Zstd:
+    return "zstd";
+  case Format::None:
+    break;
+  }
+  return "plain";
+}
+
+size_t Compression::CheckpointBytes() {
+  static const size_t bytes = [] {
+    const char *text = getenv("EDIT_INFLATE_CHECKPOINT");
+    if (!text || text[0] == '\0')
+      return Edit::INFLATE_CHECKPOINT_BYTES;
+    char *end = nullptr;
+    unsigned long long n = strtoull(text, &end, 10);
+    unsigned long long scale = 1;
+    if (end != text && (*end == 'K' || *end == 'k')) {
+      scale = 1024;
+      end++;
+    } else if (end != text && (*end == 'M' || *end == 'm')) {
+      scale = 1024 * 1024;
+      end++;
+    }
+    if (end == text || *end != '\0' || n > MAX_CHECKPOINT_BYTES / scale ||
+        n * scale < MIN_CHECKPOINT_BYTES)
+      return Edit::INFLATE_CHECKPOINT_BYTES;
+    return (size_t)(n * scale);
+  }();
+  return bytes;
+}
+
+bool Compression::InflateFile(const std::string &path, std::string &text) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  try {
+    Format format = Sniff(fd);
+    if (format == Format::None) {
+      close(fd);
+      return false;
+    }
+    Decoder decoder(fd, format);
+    text.clear();
+    for (;;) {
+      size_t at = text.size();
+      text.resize(at + IO_BYTES * 4);
+      size_t n = decoder.Read(&text[at], IO_BYTES * 4);
+      text.resize(at + n);
+      if (n == 0)
+        break;
+    }
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  return true;
+}
+
+void Compression::Write(int fd, Format format, const std::vector<iovec> &iov) {
+  switch (format) {
+  case Format::Gzip:
+    WriteGzip(fd, iov);
+    return;
+  case Format::Zstd:
+#ifdef EDIT_ZSTD
+    WriteZstd(fd, iov);
+    return;
+#else
+    break;
+#endif
+  case Format::None:
+    break;
+  }
+  throw std::runtime_error(std::string("Cannot write ") + Name(format) +
+                           " files in this build");
+}
+
+/**
+ * Input is read in IO_BYTES pieces and handed to whichever library the
+ * format needs. A gzip member or zstd frame ending is not the end of the
+ * text: another may follow (concatenated files, rotated logs joined by
+ * cat). Bytes after the last gzip member that are not another member are
+ * ignored, as gunzip does with trailing padding.
+ */
+struct Compression::Decoder::State {
+  int fd;
+  Format format;
+  uint64_t offset = 0; // Next file offset to read
+  std::unique_ptr<unsigned char[]> in{new unsigned char[IO_BYTES]};
+  size_t inPos = 0;
+  size_t inLen = 0;
+  bool eof = false;
+  bool finished = false; // Nothing more will be produced
+  bool inUnit = false;   // Inside a gzip member or zstd frame
+  std::string error;     // Raised by the Read after the one that met it
+
+  z_stream z;
+#ifdef EDIT_ZSTD
+  ZSTD_DStream *zstd = nullptr;
+#endif
+
+  // Refill the input buffer once it is used up
+  void Fill() {
+    if (inPos < inLen || eof)
+      return;
+    ssize_t n;
+    do {
+      n = pread(fd, in.get(), IO_BYTES, (off_t)offset);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      throw std::runtime_error("Read failed: " +
+                               std::string(strerror(errno)));
+    inPos = 0;
+    inLen = (size_t)n;
+    offset += (uint64_t)n;
+    eof = n == 0;
+  }
+
+  void ReadGzip(char *out, size_t n, size_t &produced) {
+    while (produced < n && !finished) {
+      Fill();
+      if (inPos == inLen) {
+        if (inUnit)
+          throw std::runtime_error("gzip data is truncated");
+        finished = true;
+        break;
+      }
+      // Between members: only another gzip header continues the text
+      if (!inUnit && in[inPos] != GZIP_MAGIC[0]) {
+        finished = true;
+        break;
+      }
+
+      z.next_in = in.get() + inPos;
+      z.avail_in = (uInt)(inLen - inPos);
+      z.next_out = reinterpret_cast<Bytef *>(out + produced);
+      z.avail_out = (uInt)std::min(n - produced, (size_t)1 << 30);
+      uInt room = z.avail_out;
+      int rc = inflate(&z, Z_NO_FLUSH);
+      inPos = inLen - z.avail_in;
+      produced += room - z.avail_out;
+      inUnit = true;
+
+      if (rc == Z_STREAM_END) {
+        inflateReset(&z);
+        inUnit = false;
+      } else if (rc == Z_BUF_ERROR) {
+        continue; // Needs more input; Fill supplies it
+      } else if (rc != Z_OK) {
+        throw std::runtime_error(std::string("gzip data is corrupt: ") +
+                                 (z.msg ? z.msg : "unknown error"));
+      }
+    }
+  }
+
+#ifdef EDIT_ZSTD
+  void ReadZstd(char *out, size_t n, size_t &produced) {
+    ZSTD_outBuffer ob = {out, n, produced};
+    while (ob.pos < ob.size && !finished) {
+      Fill();
+      if (inPos == inLen) {
+        if (inUnit)
+          throw std::runtime_error("zstd data is truncated");
+        finished = true;
+        break;
+      }
+      ZSTD_inBuffer ib = {in.get(), inLen, inPos};
+      size_t rc = ZSTD_decompressStream(zstd, &ob, &ib);
+      if (ZSTD_isError(rc))
+        throw std::runtime_error(std::string("zstd data is corrupt: ") +
+                                 ZSTD_getErrorName(rc));
+      inPos = ib.pos;
+      produced = ob.pos;
+      inUnit = rc != 0; // 0: a frame just ended
+    }
+  }
+#endif
+};
+
+Compression::Decoder::Decoder(int fd, Format format) : m_state(new State) {
+  m_state->fd = fd;
+  m_state->format = format;
+  memset(&m_state->z, 0, sizeof(m_state->z));
+
+  if (format == Format::Gzip) {
+    if (inflateInit2(&m_state->z, 15 + 16) != Z_OK) // gzip wrapper only
+      throw std::runtime_error("Cannot start gzip decompression");
+    return;
+  }
+#ifdef EDIT_ZSTD
+  if (format == Format::Zstd) {
+    m_state->zstd = ZSTD_createDStream();
+    if (!m_state->zstd)
+      throw std::runtime_error("Cannot start zstd decompression");
+    return;
+  }
+#endif
+  throw std::runtime_error(std::string("Cannot read ") + Name(format) +
+                           " files in this build");
+}
+
+Compression::Decoder::~Decoder() {
+  if (m_state->format == Format::Gzip)
+    inflateEnd(&m_state->z);
+#ifdef EDIT_ZSTD
+  if (m_state->zstd)
+    ZSTD_freeDStream(m_state->zstd);
+#endif
+}
+
+size_t Compression::Decoder::Read(char *out, size_t n) {
+  if (!m_state->error.empty())
+    throw std::runtime_error(m_state->error);
+
+  // Text before damage is still text: hand it out, fail on the next call
+  size_t produced = 0;
+  try {
+#ifdef EDIT_ZSTD
+    if (m_state->format == Format::Zstd) {
+      m_state->ReadZstd(out, n, produced);
+      return produced;
+    }
+#endif
+    m_state->ReadGzip(out, n, produced);
+  } catch (const std::exception &e) {
+    if (produced == 0)
+      throw;
+    m_state->error = e.what();
+  }
+  return produced;
+}
@@ -0,0 +1,518 @@
+/**
+ * @file diffindex.cpp
+ * @brief DiffIndex implementation: base hashing, incremental re-diff and
+ * publication.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/diffindex.hpp"
+#include "../include/filetext.hpp"
+#include "../include/textutils.hpp"
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+// Myers gives up past this many inserted + deleted lines in one stretch
+const int MAX_EDITS = 1024;
+
+// Stretches longer than this (both sides together) are anchored first
+const int ANCHOR_LINES = 512;
+
+// Lines per block of the current text; an edit rewrites the blocks it
+// touched
+const int CURRENT_BLOCK_LINES = 4096;
+
+// Edited ranges at least this long are hashed on the shared pool
+const int PARALLEL_HASH_LINES = 65536;
+
+void Diff(const uint64_t *a, int n, const uint64_t *b, int m, int bOff,
+          int *match);
+
+/// Myers' greedy O(ND) diff; matched a[i] == b[j] set match[i] = bOff + j.
+/// Leaves everything unmatched if more than MAX_EDITS edits are needed.
+void Myers(const uint64_t *a, int n, const uint64_t *b, int m, int bOff,
+           int *match) {
+  const int maxD = std::min(n + m, MAX_EDITS);
+  const int off = maxD + 1;
+  std::vector<int> v(2 * (size_t)maxD + 3, 0);
+  std::vector<int> trace;    // v[-d .. d] as it was before step d
+  std::vector<size_t> start; // Where step d's band begins in trace
+
+  int d = 0, k = 0;
+  bool done = false;
+  for (; d <= maxD && !done; ++d) {
+    start.push_back(trace.size());
+    trace.insert(trace.end(), v.begin() + off - d, v.begin() + off + d + 1);
+    for (k = -d; k <= d; k += 2) {
+      int x = (k == -d || (k != d && v[off + k - 1] < v[off + k + 1]))
+                  ? v[off + k + 1]
+                  : v[off + k - 1] + 1;
+      int y = x - k;
+      while (x < n && y < m && a[x] == b[y]) {
+        x++;
+        y++;
+      }
+      v[off + k] = x;
+      if (x >= n && y >= m) {
+        done = true;
+        break;
+      }
+    }
+  }
+  if (!done)
+    return;
+
+  // Walk the edit path back from (n, m), recording the diagonal runs
+  int x = n, y = m;
+  for (d = d - 1; d > 0; --d) {
+    const int *band = trace.data() + start[d] + d; // band[k], k in [-d, d]
+    k = x - y;
+    int prevK =
+        (k == -d || (k != d && band[k - 1] < band[k + 1])) ? k + 1 : k - 1;
+    int prevX = band[prevK];
+    int prevY = prevX - prevK;
+    while (x > prevX && y > prevY) {
+      x--;
+      y--;
+      match[x] = bOff + y;
+    }
+    x = prevX;
+    y = prevY;
+  }
+  while (x > 0 && y > 0) {
+    x--;
+    y--;
+    match[x] = bOff + y;
+  }
+}
+
+/// Split at lines that occur exactly once on each side, keeping the
+/// longest run of them that is in the same order on both, and diff the
+/// pieces between. Returns false if there is no such line.
+bool Anchor(const uint64_t *a, int n, const uint64_t *b, int m, int bOff,
+            int *match) {
+  struct Count {
+    int inA = 0, inB = 0;
+    int atB = 0;
+  };
+  std::unordered_map<uint64_t, Count> counts;
+  counts.reserve((size_t)n);
+  for (int i = 0; i < n; ++i)
+    counts[a[i]].inA++;
+  for (int j = 0; j < m; ++j) {
+    auto it = counts.find(b[j]);
+    if (it != counts.end()) {
+      it->second.inB++;
+      it->second.atB = j;
+    }
+  }
+
+  std::vector<std::pair<int, int>> pairs; // (i, j), ascending in i
+  for (int i = 0; i < n; ++i) {
+    const Count &c = counts[a[i]];
+    if (c.inA == 1 && c.inB == 1)
+      pairs.push_back({i, c.atB});
+  }
+  if (pairs.empty())
+    return false;
+
+  // Longest increasing run of j (patience sorting)
+  std::vector<size_t> tails; // Per length, the pair ending the best run
+  std::vector<size_t> prev(pairs.size());
+  for (size_t p = 0; p < pairs.size(); ++p) {
+    auto pos = std::lower_bound(
+        tails.begin(), tails.end(), pairs[p].second,
+        [&](size_t t, int j) { return pairs[t].second < j; });
+    prev[p] = pos == tails.begin() ? SIZE_MAX : *(pos - 1);
+    if (pos == tails.end())
+      tails.push_back(p);
+    else
+      *pos = p;
+  }
+  std::vector<std::pair<int, int>> anchors;
+  for (size_t p = tails.back(); p != SIZE_MAX; p = prev[p])
+    anchors.push_back(pairs[p]);
+  std::reverse(anchors.begin(), anchors.end());
+
+  int pa = 0, pb = 0;
+  for (const auto &anchor : anchors) {
+    Diff(a + pa, anchor.first - pa, b + pb, anchor.second - pb, bOff + pb,
+         match + pa);
+    match[anchor.first] = bOff + anchor.second;
+    pa = anchor.first + 1;
+    pb = anchor.second + 1;
+  }
+  Diff(a + pa, n - pa, b + pb, m - pb, bOff + pb, match + pa);
+  return true;
+}
+
+/// Match the lines of a (current) against b (base): trim, anchor, Myers.
+void Diff(const uint64_t *a, int n, const uint64_t *b, int m, int bOff,
+          int *match) {
+  int head = 0;
+  while (head < n && head < m && a[head] == b[head]) {
+    match[head] = bOff + head;
+    head++;
+  }
+  int tail = 0;
+  while (tail < n - head && tail < m - head &&
+         a[n - 1 - tail] == b[m - 1 - tail]) {
+    match[n - 1 - tail] = bOff + m - 1 - tail;
+    tail++;
+  }
+  a += head;
+  b += head;
+  match += head;
+  bOff += head;
+  n -= head + tail;
+  m -= head + tail;
+  if (n == 0 || m == 0)
+    return;
+
+  if (n + m > ANCHOR_LINES && Anchor(a, n, b, m, bOff, match))
+    return;
+  Myers(a, n, b, m, bOff, match);
+}
+
+std::vector<uint64_t> HashLines(const Buffer &buffer, int first, int count) {
+  std::vector<uint64_t> hashes((size_t)std::max(count, 0));
+  auto hash = [&](size_t chunk) {
+    size_t begin = chunk * PARALLEL_HASH_LINES;
+    size_t end = std::min(hashes.size(), begin + PARALLEL_HASH_LINES);
+    for (size_t i = begin; i < end; ++i)
+      hashes[i] = TextUtils::Hash(buffer.GetLine(first + (int)i));
+  };
+
+  size_t chunks = (hashes.size() + PARALLEL_HASH_LINES - 1) /
+                  PARALLEL_HASH_LINES;
+  if (chunks > 1) {
+    ThreadPool::Shared().ParallelFor(chunks, hash);
+  } else if (chunks == 1) {
+    hash(0);
+  }
+  return hashes;
+}
+
+/// Hashes of the lines of a file (see FileText for inflated). A missing
+/// file reads as the single empty line of a new buffer.
+std::vector<uint64_t>
+HashFile(const std::string &path,
+         std::shared_ptr<const Buffer::TextPieces> inflated) {
+  FileText file(path, std::move(inflated));
+  std::vector<uint64_t> hashes;
+  for (size_t pos = 0; pos < file.Size();)
+    hashes.push_back(TextUtils::Hash(file.Line(pos)));
+  if (hashes.empty())
+    hashes.push_back(TextUtils::Hash(""));
+  return hashes;
+}
+} // namespace
+
+DiffIndex::DiffIndex()
+    : m_stop(false), m_published(std::make_shared<Hunks>()), m_workBytes(0),
+      m_current(CURRENT_BLOCK_LINES), m_valid(false), m_same(true) {
+  m_worker = std::thread([this] { Work(); });
+}
+
+DiffIndex::~DiffIndex() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_one();
+  m_worker.join();
+}
+
+void DiffIndex::Reset(const std::string &path, int lineCount,
+                      std::shared_ptr<const Buffer::TextPieces> inflated) {
+  Queue({Job::Type::Reset, path, 0, 0, lineCount, {}, std::move(inflated)});
+}
+
+void DiffIndex::Edited(const Buffer &buffer, const Buffer::LineEdit &edit) {
+  Queue({Job::Type::Edited, "", edit.first, edit.removed, 0,
+         HashLines(buffer, edit.first, edit.added), nullptr});
+}
+
+void DiffIndex::Synced(const Buffer &buffer, const Buffer::LineEdit &edit) {
+  Queue({Job::Type::Synced, "", edit.first, edit.removed, 0,
+         HashLines(buffer, edit.first, edit.added), nullptr});
+}
+
+void DiffIndex::Saved() { Queue({Job::Type::Saved, "", 0, 0, 0, {}, nullptr}); }
+
+std::shared_ptr<const DiffIndex::Hunks> DiffIndex::Published() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_published;
+}
+
+size_t DiffIndex::MemoryBytes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_workBytes + m_published->capacity() * sizeof(Hunk);
+}
+
+void DiffIndex::Queue(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_wake.notify_one();
+}
+
+void DiffIndex::Work() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+    if (m_stop)
+      return;
+
+    // Take everything queued; typing faster than we diff just batches up
+    std::deque<Job> jobs;
+    jobs.swap(m_jobs);
+    lock.unlock();
+    for (Job &job : jobs) {
+      try {
+        Apply(job);
+      } catch (const std::exception &) {
+        m_valid = false; // Out of memory: no markers until the next reset
+      }
+    }
+    Publish();
+    lock.lock();
+  }
+}
+
+void DiffIndex::Apply(Job &job) {
+  switch (job.type) {
+  case Job::Type::Reset:
+    m_base = HashFile(job.path, std::move(job.inflated));
+    // Changed again since the buffer read it: wait for the reload
+    m_valid = (int)m_base.size() == job.expected;
+    SetSame();
+    return;
+
+  case Job::Type::Saved:
+    if (!m_same)
+      m_base = Flatten();
+    SetSame();
+    return;
+
+  case Job::Type::Edited:
+  case Job::Type::Synced:
+    break;
+  }
+
+  int first = job.first;
+  int removed = job.removed;
+  int added = (int)job.hashes.size();
+  int size = m_same ? (int)m_base.size() : m_current.LineCount();
+  if (!m_valid || first < 0 || removed < 0 || first + removed > size) {
+    m_valid = false;
+    return;
+  }
+
+  if (m_same && job.type == Job::Type::Synced) {
+    // Only for a clean buffer: it was the base before and still is
+    m_base.erase(m_base.begin() + first, m_base.begin() + first + removed);
+    m_base.insert(m_base.begin() + first, job.hashes.begin(),
+                  job.hashes.end());
+    return;
+  }
+
+  // First edit since the base: now the two can differ
+  if (m_same)
+    Split();
+  Splice(first, removed, job.hashes);
+  if (job.type == Job::Type::Synced) {
+    m_base = Flatten();
+    SetSame();
+    return;
+  }
+  Rediff(first, added, added - removed);
+}
+
+void DiffIndex::SetSame() {
+  m_current.Reset(0);
+  m_hunks.clear();
+  m_same = true;
+}
+
+void DiffIndex::Split() {
+  m_current.Reset((int)m_base.size());
+  int y = 0;
+  for (LineBlocks<Rows>::Block &block : m_current) {
+    Rows &rows = block.data;
+    rows.hashes.assign(m_base.begin() + y, m_base.begin() + y + block.lines);
+    rows.match.resize((size_t)block.lines);
+    for (int &m : rows.match)
+      m = y++;
+  }
+  m_hunks.clear();
+  m_same = false;
+}
+
+std::vector<uint64_t> DiffIndex::Flatten() {
+  std::vector<uint64_t> lines;
+  lines.reserve((size_t)m_current.LineCount());
+  for (const LineBlocks<Rows>::Block &block : m_current)
+    lines.insert(lines.end(), block.data.hashes.begin(),
+                 block.data.hashes.end());
+  return lines;
+}
+
+void DiffIndex::Splice(int first, int removed,
+                       const std::vector<uint64_t> &hashes) {
+  // Gather the run of blocks the edit re-splits, edit it and deal it back
+  Rows run;
+  size_t b = m_current.Edited(
+      {first, removed, (int)hashes.size()},
+      [&](LineBlocks<Rows>::Block &block) {
+        Rows &rows = block.data;
+        run.hashes.insert(run.hashes.end(), rows.hashes.begin(),
+                          rows.hashes.end());
+        run.match.insert(run.match.end(), rows.match.begin(),
+                         rows.match.end());
+      });
+  if (b == m_current.Size())
+    return; // The lines removed were the whole run, and none came in
+  size_t at = (size_t)(first - m_current.First(b));
+  run.hashes.erase(run.hashes.begin() + at,
+                   run.hashes.begin() + at + removed);
+  run.hashes.insert(run.hashes.begin() + at, hashes.begin(), hashes.end());
+  run.match.erase(run.match.begin() + at, run.match.begin() + at + removed);
+  run.match.insert(run.match.begin() + at, hashes.size(), -1);
+
+  for (size_t taken = 0; taken < run.hashes.size(); ++b) {
+    LineBlocks<Rows>::Block &block = m_current[b];
+    size_t end = taken + (size_t)block.lines;
+    block.data.hashes.assign(run.hashes.begin() + taken,
+                             run.hashes.begin() + end);
+    block.data.match.assign(run.match.begin() + taken,
+                            run.match.begin() + end);
+    taken = end;
+  }
+}
+
+int DiffIndex::Match(int y) {
+  int blockFirst;
+  size_t b = m_current.Locate(y, blockFirst);
+  return m_current[b].data.match[(size_t)(y - blockFirst)];
+}
+
+int DiffIndex::PrevMatched(int y) {
+  if (y <= 0)
+    return -1;
+  int blockFirst;
+  size_t b = m_current.Locate(y - 1, blockFirst);
+  int i = y - 1 - blockFirst;
+  for (;;) {
+    const std::vector<int> &match = m_current[b].data.match;
+    for (; i >= 0; --i) {
+      if (match[(size_t)i] >= 0)
+        return blockFirst + i;
+    }
+    if (b == 0)
+      return -1;
+    blockFirst -= m_current[--b].lines;
+    i = m_current[b].lines - 1;
+  }
+}
+
+int DiffIndex::NextMatched(int y) {
+  int blockFirst;
+  for (size_t b = m_current.Locate(y, blockFirst); b < m_current.Size();
+       ++b) {
+    const std::vector<int> &match = m_current[b].data.match;
+    for (int i = y - blockFirst; i < m_current[b].lines; ++i) {
+      if (match[(size_t)i] >= 0)
+        return blockFirst + i;
+    }
+    blockFirst += m_current[b].lines;
+    y = blockFirst;
+  }
+  return m_current.LineCount();
+}
+
+void DiffIndex::Rediff(int first, int count, int delta) {
+  // Widen to the unchanged lines around the edit: they pin down which base
+  // lines the stretch between them can match
+  int size = m_current.LineCount();
+  int lo = PrevMatched(first) + 1;
+  int hi = NextMatched(first + count);
+  int baseLo = lo > 0 ? Match(lo - 1) + 1 : 0;
+  int baseHi = hi < size ? Match(hi) : (int)m_base.size();
+
+  // Every line of the stretch is unmatched: copy it out, diff, copy back
+  int n = hi - lo;
+  std::vector<uint64_t> lines;
+  lines.reserve((size_t)n);
+  int blockFirst;
+  for (size_t b = m_current.Locate(lo, blockFirst); (int)lines.size() < n;
+       ++b) {
+    const std::vector<uint64_t> &hashes = m_current[b].data.hashes;
+    size_t from = lines.empty() ? (size_t)(lo - blockFirst) : 0;
+    size_t take = std::min(hashes.size() - from, (size_t)n - lines.size());
+    lines.insert(lines.end(), hashes.begin() + from,
+                 hashes.begin() + from + take);
+  }
+  std::vector<int> match((size_t)n, -1);
+  Diff(lines.data(), n, m_base.data() + baseLo, baseHi - baseLo, baseLo,
+       match.data());
+  size_t done = 0;
+  for (size_t b = m_current.Locate(lo, blockFirst); done < match.size();
+       ++b) {
+    std::vector<int> &rows = m_current[b].data.match;
+    size_t from = done == 0 ? (size_t)(lo - blockFirst) : 0;
+    size_t take = std::min(rows.size() - from, match.size() - done);
+    std::copy(match.begin() + done, match.begin() + done + take,
+              rows.begin() + from);
+    done += take;
+  }
+
+  // Base lines are fixed, so the stretch's old hunks are those starting
+  // in [baseLo, baseHi]; replace them and shift the ones after
+  Hunks hunks;
+  int i = 0, j = baseLo;
+  while (i < n || j < baseHi) {
+    if (i < n && match[(size_t)i] == j) {
+      i++;
+      j++;
+      continue;
+    }
+    Hunk hunk = {lo + i, 0, j, 0};
+    while (i < n && match[(size_t)i] < 0)
+      i++;
+    int next = i < n ? match[(size_t)i] : baseHi;
+    hunk.count = lo + i - hunk.first;
+    hunk.baseCount = next - j;
+    j = next;
+    hunks.push_back(hunk);
+  }
+  auto begin = std::lower_bound(
+      m_hunks.begin(), m_hunks.end(), baseLo,
+      [](const Hunk &h, int base) { return h.baseFirst < base; });
+  auto end = std::upper_bound(
+      begin, m_hunks.end(), baseHi,
+      [](int base, const Hunk &h) { return base < h.baseFirst; });
+  for (auto it = end; it != m_hunks.end(); ++it)
+    it->first += delta;
+  size_t at = (size_t)(begin - m_hunks.begin());
+  m_hunks.erase(begin, end);
+  m_hunks.insert(m_hunks.begin() + at, hunks.begin(), hunks.end());
+}
+
+void DiffIndex::Publish() {
+  auto hunks = std::make_shared<Hunks>();
+  if (m_valid && !m_same)
+    *hunks = m_hunks;
+
+  // Block vectors are sized to their lines, so this is close enough
+  size_t workBytes = m_base.capacity() * sizeof(uint64_t) +
+                     (size_t)m_current.LineCount() *
+                         (sizeof(uint64_t) + sizeof(int)) +
+                     m_current.MemoryBytes() +
+                     m_hunks.capacity() * sizeof(Hunk);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_published = std::move(hunks);
+  m_workBytes = workBytes;
+}
@@ -5,16 +5,48 @@
  */
 
 #include "../include/display.hpp"
+#include "../include/constants.hpp"
 #include "../include/textutils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <ncurses.h>
 #include <stdexcept>
 #include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
-Display::Display() : m_rowOff(0), m_colOff(0), m_gutterWidth(4) {
+// xterm: report motion while a button is held (mouse drag)
+static const char *const MOUSE_DRAG_ON = "\033[?1002h";
+static const char *const MOUSE_DRAG_OFF = "\033[?1002l";
+
+// Resize signals received; Display::Resize compares it with what it applied
+static volatile sig_atomic_t g_resizes = 0;
+
+static void ResizeHandler(int) { g_resizes = g_resizes + 1; }
+
+// Table view: drawn between columns, and the cells it takes
+static const char *const TABLE_SEPARATOR = " | ";
+static const int TABLE_GAP = 3;
+
+Display::Display()
+    : m_resizes(0), m_rowOff(0), m_colOff(0), m_detached(false),
+      m_gutterWidth(5),
+      m_text(&TextUtils::KernelsFor(TextUtils::Encoding::Mixed)),
+      m_delimiter(0), m_pinned(0), m_hitTop(0), m_hexTop(0), m_hexDigits(8) {
   // Reduce ESC delay to 25ms for better responsiveness
   setenv("ESCDELAY", "25", 1);
 
+  // Installed before initscr so ncurses keeps out of resizing; no
+  // SA_RESTART, so the signal also wakes a pending key read
+  struct sigaction winch = {};
+  winch.sa_handler = ResizeHandler;
+  sigemptyset(&winch.sa_mask);
+  sigaction(SIGWINCH, &winch, &m_oldWinch);
+  m_resizes = g_resizes;
+
   if (initscr() == NULL) {
+    sigaction(SIGWINCH, &m_oldWinch, nullptr);
     throw std::runtime_error("Failed to initialize ncurses");
   }
 
@@ -22,19 +54,54 @@ Display::Display() : m_rowOff(0), m_colOff(0), m_gutterWidth(4) {
   noecho();             // Don't echo input
   keypad(stdscr, TRUE); // Enable arrow keys
   timeout(100);         // Non-blocking read (100ms) for signal check
-  mousemask(BUTTON1_CLICKED, NULL); // Enable left-click
+  // Scrolled rows move by scroll region instead of being sent again
+  idlok(stdscr, TRUE);
+  // Press, drag and release of the left button (click and select), and
+  // the wheel (buttons 4 and 5)
+  mousemask(BUTTON1_PRESSED | BUTTON1_RELEASED | REPORT_MOUSE_POSITION |
+                BUTTON4_PRESSED | BUTTON5_PRESSED,
+            NULL);
+  mouseinterval(0); // Deliver presses immediately instead of as clicks
+  putp(MOUSE_DRAG_ON);
+  fflush(stdout);
 
   getmaxyx(stdscr, m_screenRows, m_screenCols);
 
   if (m_screenRows <= 0 || m_screenCols <= 0) {
     endwin();
+    sigaction(SIGWINCH, &m_oldWinch, nullptr);
     throw std::runtime_error("Terminal too small");
   }
+  m_row.reserve((size_t)m_screenCols * 4); // A row of 4-byte characters
 }
 
 Display::~Display() {
   // RAII: Always clean up terminal state
+  putp(MOUSE_DRAG_OFF);
+  fflush(stdout);
   endwin();
+  sigaction(SIGWINCH, &m_oldWinch, nullptr);
+}
+
+bool Display::Resize() {
+  if (g_resizes == m_resizes)
+    return false;
+
+  // A window drag sends a burst of signals: relayout once it pauses
+  do {
+    m_resizes = g_resizes;
+    napms(Edit::RESIZE_SETTLE_MS);
+  } while (g_resizes != m_resizes);
+
+  struct winsize size;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 &&
+      size.ws_col > 0) {
+    resize_term(size.ws_row, size.ws_col);
+    clearok(curscr, TRUE); // The terminal reflowed the old frame
+  }
+  getmaxyx(stdscr, m_screenRows, m_screenCols);
+  m_row.reserve((size_t)m_screenCols * 4);
+  return true;
 }
 
 int Display::Rows() const { return m_screenRows; }
@@ -42,49 +109,324 @@ int Display::Cols() const { return m_screenCols; }
 int Display::GetRowOff() const { return m_rowOff; }
 int Display::GetColOff() const { return m_colOff; }
 int Display::GetGutterWidth() const { return m_gutterWidth; }
+void Display::SetRowOff(int rowOff) { m_rowOff = rowOff < 0 ? 0 : rowOff; }
+void Display::SetColOff(int colOff) { m_colOff = colOff < 0 ? 0 : colOff; }
+
+void Display::SetMessage(const std::string &message) {
+  if (message != m_message) {
+    m_message = message;
+    m_status.stale = true;
+  }
+}
+
+void Display::SetMode(const std::string &mode) {
+  m_mode = mode;
+  m_status.stale = true;
+}
+
+void Display::SetSelections(std::vector<Buffer::Range> ranges) {
+  m_selections = std::move(ranges);
+}
+
+void Display::SetCursors(std::vector<Buffer::Position> cursors) {
+  m_cursors = std::move(cursors);
+}
+
+void Display::SetChanges(std::shared_ptr<const DiffIndex::Hunks> changes) {
+  m_changes = std::move(changes);
+}
+
+void Display::SetBrackets(std::vector<Buffer::Position> brackets) {
+  m_brackets = std::move(brackets);
+}
+
+void Display::SetFolds(const FoldSet &folds) { m_folds = folds; }
+
+void Display::SetTable(char delimiter,
+                       std::shared_ptr<const Table::Widths> widths) {
+  if (delimiter != m_delimiter)
+    m_columns.clear(); // Another layout: start from the sample again
+  m_delimiter = delimiter;
+  m_sampled = std::move(widths);
+}
+
+size_t Display::ByteAtX(std::string_view line, int screenX) {
+  int x = std::max(screenX - m_gutterWidth, 0);
+  int visualX = x < m_pinned ? x : x + m_colOff;
+  if (!m_delimiter)
+    return m_text->ByteIdxForVisual(line, visualX);
+
+  // A click on a separator (or a cut field's hidden tail) lands at the
+  // end of the field before it
+  Table::Split(line, m_delimiter, m_fields);
+  int at = 0;
+  for (size_t i = 0;; ++i) {
+    const Table::Field &f = m_fields[i];
+    int width = ColumnWidth(i);
+    if (visualX < at + width + TABLE_GAP || i + 1 == m_fields.size()) {
+      if (visualX - at >= width)
+        return f.end;
+      std::string_view field = line.substr(f.start, f.end - f.start);
+      return f.start + m_text->ByteIdxForVisual(field, visualX - at);
+    }
+    at += width + TABLE_GAP;
+  }
+}
+
+int Display::LineAtRow(int screenY, int lineCount) const {
+  return m_folds.Down(m_rowOff, std::max(screenY, 0), lineCount);
+}
+
+int Display::HexColumns() const {
+  // Offset, two spaces, "xx " per byte plus a gap mid-row, then |ascii|
+  for (int bytes = 16; bytes > 1; bytes /= 2) {
+    if (m_hexDigits + 2 + bytes * 4 + 1 + 2 <= m_screenCols)
+      return bytes;
+  }
+  return 1;
+}
+
+void Display::ScrollHex(const HexFile &file, uint64_t cursor) {
+  Resize();
+  m_hexDigits = 8;
+  for (uint64_t n = file.Size() >> 32; n > 0; n >>= 4)
+    m_hexDigits++;
+
+  uint64_t columns = (uint64_t)HexColumns();
+  uint64_t rows = (uint64_t)std::max(1, m_screenRows - 1);
+  uint64_t row = cursor / columns;
+  m_hexTop = m_hexTop / columns * columns; // Width may have changed
+  if (row < m_hexTop / columns)
+    m_hexTop = row * columns;
+  if (row >= m_hexTop / columns + rows)
+    m_hexTop = (row - rows + 1) * columns;
+}
+
+void Display::RenderHex(const HexFile &file, uint64_t cursor, bool asciiPane,
+                        bool lowNibble) {
+  erase();
+  int columns = HexColumns();
+  int hexStart = m_hexDigits + 2;
+  int asciiStart = hexStart + columns * 3 + 1 + 1;
+  auto hexCol = [&](int i) {
+    return hexStart + i * 3 + (i >= columns / 2 && columns > 1 ? 1 : 0);
+  };
+
+  std::vector<uint8_t> bytes((size_t)columns);
+  for (int y = 0; y < m_screenRows - 1; ++y) {
+    uint64_t offset = m_hexTop + (uint64_t)y * (uint64_t)columns;
+    size_t n = file.Read(offset, bytes.data(), bytes.size());
+    if (n == 0)
+      break;
+
+    attron(A_DIM);
+    mvprintw(y, 0, "%0*llx", m_hexDigits, (unsigned long long)offset);
+    mvaddch(y, asciiStart - 1, '|');
+    mvaddch(y, asciiStart + (int)n, '|');
+    attroff(A_DIM);
+
+    for (int i = 0; i < (int)n; ++i) {
+      unsigned attr = file.IsPatched(offset + (uint64_t)i) ? A_BOLD : 0;
+      if (offset + (uint64_t)i == cursor)
+        attr |= A_UNDERLINE; // The cursor's byte in the other column
+      attron(attr);
+      mvprintw(y, hexCol(i), "%02x", bytes[(size_t)i]);
+      unsigned char c = bytes[(size_t)i];
+      mvaddch(y, asciiStart + i, c >= 32 && c < 127 ? c : '.');
+      attroff(attr);
+    }
+  }
+
+  std::string filename = file.GetFileName();
+  std::string left =
+      m_message.empty()
+          ? "edit v2.0.0 by @rahuldangeofficial | " + filename + " - " +
+                std::to_string(file.Size()) + " bytes" +
+                (file.IsDirty() ? " (Modified)" : "") + " [HEX]"
+          : m_message;
+  char right[64];
+  snprintf(right, sizeof(right), "0x%llx (%llu) ",
+           (unsigned long long)cursor, (unsigned long long)cursor);
+  DrawStatusLine(left, right);
+
+  int cursorRow = (int)((cursor - m_hexTop) / (uint64_t)columns);
+  int i = (int)(cursor % (uint64_t)columns);
+  move(cursorRow, asciiPane ? asciiStart + i : hexCol(i) + (lowNibble ? 1 : 0));
+  refresh();
+}
+
+void Display::RenderHits(const std::vector<ProjectSearch::Hit> &hits,
+                         size_t selected, size_t matchBytes,
+                         const std::string &status) {
+  Resize();
+  erase();
+  // Lines come from any file: measure them as the Mixed kernel does
+  const TextUtils::Kernels &text =
+      TextUtils::KernelsFor(TextUtils::Encoding::Mixed);
+  size_t rows = (size_t)std::max(1, m_screenRows - 1);
+  if (selected < m_hitTop)
+    m_hitTop = selected;
+  if (selected >= m_hitTop + rows)
+    m_hitTop = selected - rows + 1;
+
+  for (size_t y = 0; y < rows && m_hitTop + y < hits.size(); ++y) {
+    const ProjectSearch::Hit &hit = hits[m_hitTop + y];
+    char number[24];
+    int n = snprintf(number, sizeof(number), ":%d: ", hit.line + 1);
+    m_layout.assign(hit.path);
+    m_layout.append(number, (size_t)n);
+    size_t prefix = m_layout.size();
+    m_layout += hit.text;
+    text.TrimToVisual(m_layout, 0, m_screenCols, m_row);
+    mvaddnstr((int)y, 0, m_row.data(), (int)m_row.size());
+
+    // Location dimmed, the match underlined, as far as they are on screen
+    std::string_view row(m_layout);
+    int location = text.VisualWidth(row.substr(0, prefix));
+    mvchgat((int)y, 0, std::min(location, m_screenCols), A_DIM, 0, NULL);
+    size_t from = prefix + std::min((size_t)hit.column, hit.text.size());
+    size_t to = std::min(from + matchBytes, row.size());
+    int start = text.VisualWidth(row.substr(0, from));
+    int end = std::min(text.VisualWidth(row.substr(0, to)), m_screenCols);
+    if (end > start)
+      mvchgat((int)y, start, end - start, A_BOLD | A_UNDERLINE, 0, NULL);
+    if (m_hitTop + y == selected)
+      mvchgat((int)y, 0, -1, A_REVERSE, 0, NULL);
+  }
+
+  char right[48] = "";
+  if (!hits.empty())
+    snprintf(right, sizeof(right), "%zu/%zu ", selected + 1, hits.size());
+  DrawStatusLine(status, right);
+  curs_set(0);
+  refresh();
+}
 
 void Display::Scroll(const Buffer &buffer, int cursorY, int cursorX) {
-  m_screenRows = getmaxy(stdscr);
-  m_screenCols = getmaxx(stdscr);
+  Resize();
+  m_text = &TextUtils::KernelsFor(buffer.GetEncoding());
 
   // Update gutter width based on line count
   UpdateGutterWidth(buffer.LineCount());
 
-  // Vertical Scroll
+  // Vertical Scroll, counting a fold as its header row
+  m_rowOff = m_folds.Header(m_rowOff);
+  if (m_detached) {
+    m_rowOff = std::min(m_rowOff, std::max(buffer.LineCount() - 1, 0));
+    FitColumns(buffer);
+    return; // The wheel moved the view; the cursor may be off screen
+  }
   if (cursorY < m_rowOff) {
     m_rowOff = cursorY;
   }
-  if (cursorY >= m_rowOff + m_screenRows - 1) { // -1 for status bar
-    m_rowOff = cursorY - m_screenRows + 2;
+  if (m_folds.Rows(m_rowOff, cursorY) >= m_screenRows - 1) { // Status bar
+    m_rowOff = m_folds.Up(cursorY, m_screenRows - 2);
   }
+  FitColumns(buffer);
 
   // Horizontal Scroll
   // Convert cursor byte index to visual column
-  std::string line = buffer.GetLine(cursorY);
-  std::string upToCursor = line.substr(0, cursorX);
-  int visualX = TextUtils::VisualWidth(upToCursor);
+  std::string_view line = buffer.GetLine(cursorY);
+  int visualX = Column(line, cursorX);
 
+  // Only what is right of the pinned table column scrolls
   int textAreaWidth = m_screenCols - m_gutterWidth;
-  if (visualX < m_colOff) {
-    m_colOff = visualX;
+  if (visualX >= m_pinned) {
+    if (visualX - m_colOff < m_pinned) {
+      m_colOff = visualX - m_pinned;
+    }
+    if (visualX - m_colOff >= textAreaWidth) {
+      m_colOff = visualX - textAreaWidth + 1;
+    }
   }
-  if (visualX >= m_colOff + textAreaWidth) {
-    m_colOff = visualX - textAreaWidth + 1;
+}
+
+void Display::FitColumns(const Buffer &buffer) {
+  m_pinned = 0;
+  if (!m_delimiter)
+    return;
+
+  // The sample, widened by the rows on screen; columns never narrow, so
+  // scrolling does not make the layout jump back and forth
+  if (m_sampled) {
+    if (m_columns.size() < m_sampled->size())
+      m_columns.resize(m_sampled->size(), 0);
+    for (size_t i = 0; i < m_sampled->size(); ++i)
+      m_columns[i] = std::max(m_columns[i], (*m_sampled)[i]);
+  }
+  int fileRow = m_rowOff;
+  for (int y = 0; y < m_screenRows - 1 && fileRow < buffer.LineCount();
+       y++, fileRow++) {
+    Table::Widen(buffer.GetLine(fileRow), m_delimiter, *m_text, m_fields,
+                 m_columns);
+    if (const FoldSet::Fold *fold = m_folds.Find(fileRow))
+      fileRow = fold->last;
+  }
+
+  // Pin the first column where that leaves most of the width to scroll
+  int textAreaWidth = m_screenCols - m_gutterWidth;
+  if (m_columns.size() > 1 && (m_columns[0] + TABLE_GAP) * 2 <= textAreaWidth)
+    m_pinned = m_columns[0] + TABLE_GAP;
+}
+
+int Display::ColumnWidth(size_t field) const {
+  return field < m_columns.size() ? m_columns[field]
+                                  : Edit::TABLE_COLUMN_WIDTH;
+}
+
+int Display::Column(std::string_view line, size_t x) {
+  if (!m_delimiter)
+    return m_text->VisualWidth(line.substr(0, x));
+
+  // Within its field, clamped to the column: a position in a cut field's
+  // hidden tail shows at the column's edge
+  Table::Split(line, m_delimiter, m_fields);
+  int at = 0;
+  for (size_t i = 0;; ++i) {
+    const Table::Field &f = m_fields[i];
+    int width = ColumnWidth(i);
+    if (x <= f.end || i + 1 == m_fields.size()) {
+      size_t to = std::min(std::max(x, f.start), f.end);
+      int inField = m_text->VisualWidth(line.substr(f.start, to - f.start));
+      return at + std::min(inField, width);
+    }
+    at += width + TABLE_GAP;
   }
 }
 
+void Display::ScrollView(int rows, int lineCount) {
+  m_detached = true;
+  int top = m_folds.Header(m_rowOff);
+  if (rows < 0) {
+    m_rowOff = m_folds.Up(top, -rows);
+    return;
+  }
+  // Stop once the last line is at the bottom of the screen
+  int last = m_folds.Header(std::max(lineCount - 1, 0));
+  int lowest = m_folds.Up(last, m_screenRows - 2);
+  int down = m_folds.Down(top, rows, lineCount);
+  m_rowOff = std::max(top, std::min(down, lowest));
+}
+
 void Display::Render(const Buffer &buffer, int cursorY, int cursorX) {
+  m_text = &TextUtils::KernelsFor(buffer.GetEncoding());
   erase();
   DrawRows(buffer);
   DrawStatusBar(buffer, cursorY, cursorX);
 
   // Map byte-index cursor to visual column
-  std::string line = buffer.GetLine(cursorY);
+  std::string_view line = buffer.GetLine(cursorY);
   // Calculate visual width up to the cursor position
-  std::string upToCursor = line.substr(0, cursorX);
-  int visualX = TextUtils::VisualWidth(upToCursor);
-
-  move(cursorY - m_rowOff, m_gutterWidth + visualX - m_colOff);
+  int visualX = Column(line, cursorX);
+  if (visualX >= m_pinned)
+    visualX -= m_colOff;
+
+  // Hidden while the view is scrolled away from it
+  int row = m_folds.Rows(m_rowOff, cursorY);
+  bool shown = cursorY >= m_rowOff && row < m_screenRows - 1;
+  curs_set(shown ? 1 : 0);
+  if (shown)
+    move(row, m_gutterWidth + visualX);
   refresh();
 }
 
@@ -92,81 +434,242 @@ void Display::DrawRows(const Buffer &buffer) {
   int maxRows = m_screenRows - 1; // Reserve 1 line for status
   int textAreaWidth = m_screenCols - m_gutterWidth;
 
-  for (int y = 0; y < maxRows; y++) {
-    int fileRow = y + m_rowOff;
-
-    // Draw gutter background for all rows
-    attron(A_DIM);
-    for (int i = 0; i < m_gutterWidth; i++) {
-      mvaddch(y, i, ' ');
+  int fileRow = m_rowOff;
+  for (int y = 0; y < maxRows; y++, fileRow++) {
+
+    // Gutter: line number right-aligned before the mark column and a
+    // space; blank beyond the end of the file
+    char gutter[16]; // Widest int plus mark and space
+    memset(gutter, ' ', (size_t)m_gutterWidth);
+    bool inFile = fileRow < buffer.LineCount();
+    if (inFile) {
+      int at = m_gutterWidth - 2;
+      for (int n = fileRow + 1; n > 0 && at > 0; n /= 10)
+        gutter[--at] = (char)('0' + n % 10);
     }
+    attron(A_DIM);
+    mvaddnstr(y, 0, gutter, m_gutterWidth);
     attroff(A_DIM);
-
-    if (fileRow >= buffer.LineCount()) {
-      // Empty line beyond file - gutter already drawn, leave text area blank
+    if (!inFile)
       continue;
+
+    if (m_changes && !m_changes->empty())
+      DrawChange(y, fileRow, buffer.LineCount());
+
+    std::string_view line = buffer.GetLine(fileRow);
+
+    if (m_delimiter) {
+      DrawTableRow(y, line);
+    } else {
+      // Trim string to visual width
+      m_text->TrimToVisual(line, m_colOff, textAreaWidth, m_row);
+      if (!m_row.empty())
+        mvaddnstr(y, m_gutterWidth, m_row.data(), (int)m_row.size());
     }
 
-    // Draw line number (right-aligned in gutter)
-    attron(A_DIM);
-    mvprintw(y, 0, "%*d ", m_gutterWidth - 1, fileRow + 1);
-    attroff(A_DIM);
+    if (!m_selections.empty())
+      DrawSelections(y, fileRow, line);
+    if (!m_cursors.empty())
+      DrawCursors(y, fileRow, line);
+    if (!m_brackets.empty())
+      DrawBrackets(y, fileRow, line);
+
+    // The next row is the line after the fold, without visiting it
+    if (const FoldSet::Fold *fold = m_folds.Find(fileRow)) {
+      DrawFold(y, *fold, line);
+      fileRow = fold->last;
+    }
+  }
+}
 
-    const std::string &line = buffer.GetLine(fileRow);
+void Display::DrawTableRow(int screenY, std::string_view line) {
+  // The whole row laid out: each field cut or padded to its column, with
+  // a separator between columns
+  Table::Split(line, m_delimiter, m_fields);
+  m_layout.clear();
+  for (size_t i = 0; i < m_fields.size(); ++i) {
+    const Table::Field &f = m_fields[i];
+    int width = ColumnWidth(i);
+    m_text->TrimToVisual(line.substr(f.start, f.end - f.start), 0, width,
+                         m_cell);
+    m_layout += m_cell;
+    m_layout.append((size_t)(width - m_text->VisualWidth(m_cell)), ' ');
+    if (i + 1 < m_fields.size())
+      m_layout += TABLE_SEPARATOR;
+  }
 
-    // Trim string to visual width
-    std::string printLine =
-        TextUtils::TrimToVisual(line, m_colOff, textAreaWidth);
+  // Then drawn in two parts: the pinned column, and the scrolled rest
+  int textAreaWidth = m_screenCols - m_gutterWidth;
+  m_text->TrimToVisual(m_layout, 0, m_pinned, m_row);
+  if (!m_row.empty())
+    mvaddnstr(screenY, m_gutterWidth, m_row.data(), (int)m_row.size());
+  m_text->TrimToVisual(m_layout, m_pinned + m_colOff,
+                       textAreaWidth - m_pinned, m_row);
+  if (!m_row.empty())
+    mvaddnstr(screenY, m_gutterWidth + m_pinned, m_row.data(),
+              (int)m_row.size());
+
+  int at = 0;
+  for (size_t i = 0; i + 1 < m_fields.size(); ++i) {
+    at += ColumnWidth(i) + TABLE_GAP;
+    Highlight(screenY, at - 2, at - 1, A_DIM);
+  }
+}
+
+void Display::DrawSelections(int screenY, int fileRow, std::string_view line) {
+  // Ranges are sorted and disjoint, so their ends are sorted too
+  auto it = std::lower_bound(
+      m_selections.begin(), m_selections.end(), fileRow,
+      [](const Buffer::Range &r, int row) { return r.to.y < row; });
+
+  for (; it != m_selections.end() && it->from.y <= fileRow; ++it) {
+    size_t from = fileRow == it->from.y ? (size_t)it->from.x : 0;
+    size_t to = fileRow == it->to.y ? (size_t)it->to.x : line.size();
+    from = std::min(from, line.size());
+    to = std::min(to, line.size());
+
+    int start = Column(line, from);
+    int end = Column(line, to);
+    if (fileRow < it->to.y)
+      end++; // The line break is selected too
+    Highlight(screenY, start, end, A_REVERSE);
+  }
+}
 
-    if (!printLine.empty()) {
-      mvaddstr(y, m_gutterWidth, printLine.c_str());
+void Display::DrawCursors(int screenY, int fileRow, std::string_view line) {
+  auto it = std::lower_bound(m_cursors.begin(), m_cursors.end(),
+                             Buffer::Position{fileRow, 0});
+
+  for (; it != m_cursors.end() && it->y == fileRow; ++it) {
+    int start = Column(line, std::min((size_t)it->x, line.size()));
+    Highlight(screenY, start, start + 1, A_REVERSE);
+  }
+}
+
+void Display::DrawBrackets(int screenY, int fileRow, std::string_view line) {
+  for (const Buffer::Position &p : m_brackets) {
+    if (p.y == fileRow && (size_t)p.x < line.size()) {
+      int start = Column(line, p.x);
+      Highlight(screenY, start, start + 1, A_BOLD | A_UNDERLINE);
     }
   }
 }
 
+void Display::DrawFold(int screenY, const FoldSet::Fold &fold,
+                       std::string_view line) {
+  // Hidden line count after the header's text, where there is room
+  char tag[48];
+  int n = snprintf(tag, sizeof(tag), " ... %d lines", fold.last - fold.first);
+  int x = Column(line, line.size());
+  x = x < m_pinned ? x : std::max(x - m_colOff, m_pinned);
+  int textAreaWidth = m_screenCols - m_gutterWidth;
+  if (x >= textAreaWidth)
+    return;
+  attron(A_DIM);
+  mvaddnstr(screenY, m_gutterWidth + x, tag, std::min(n, textAreaWidth - x));
+  attroff(A_DIM);
+}
+
+void Display::DrawChange(int screenY, int fileRow, int lineCount) {
+  // Last hunk starting at or above this row
+  auto it = std::upper_bound(
+      m_changes->begin(), m_changes->end(), fileRow,
+      [](int row, const DiffIndex::Hunk &h) { return row < h.first; });
+  const DiffIndex::Hunk &last = m_changes->back();
+
+  char mark = 0;
+  if (it != m_changes->begin()) {
+    const DiffIndex::Hunk &h = *(it - 1);
+    if (fileRow < h.first + h.count)
+      mark = h.baseCount == 0 ? '+' : '~';
+    else if (h.count == 0 && h.first == fileRow)
+      mark = '-';
+  }
+  // Lines deleted at the very end have no line of their own
+  if (!mark && fileRow == lineCount - 1 && last.count == 0 &&
+      last.first == lineCount)
+    mark = '-';
+
+  if (mark)
+    mvaddch(screenY, m_gutterWidth - 2, mark | A_BOLD);
+}
+
+void Display::Highlight(int screenY, int start, int end, unsigned attr) {
+  // Clip to the text area; columns left of m_pinned do not scroll
+  int textAreaWidth = m_screenCols - m_gutterWidth;
+  if (start < m_pinned && end > start) {
+    int pinnedEnd = std::min(end, m_pinned);
+    mvchgat(screenY, m_gutterWidth + start, pinnedEnd - start, attr, 0,
+            NULL);
+  }
+  start = std::max(std::max(start, m_pinned) - m_colOff, m_pinned);
+  end = std::min(end - m_colOff, textAreaWidth);
+  if (end > start)
+    mvchgat(screenY, m_gutterWidth + start, end - start, attr, 0, NULL);
+}
+
 void Display::UpdateGutterWidth(int lineCount) {
-  // Calculate digits needed for max line number + 1 space
+  // Calculate digits needed for max line number, mark and space
   int digits = 1;
   int n = lineCount;
   while (n >= 10) {
     n /= 10;
     digits++;
   }
-  m_gutterWidth = digits + 1; // +1 for space separator
+  m_gutterWidth = digits + 2; // +1 for the change mark, +1 for space
 }
 
 void Display::DrawStatusBar(const Buffer &buffer, int cursorY, int cursorX) {
-  attron(A_DIM);
-
-  std::string filename =
-      buffer.GetFileName().empty() ? "[No Name]" : buffer.GetFileName();
-  std::string details = " - " + std::to_string(buffer.LineCount()) + " lines" +
-                        (buffer.IsDirty() ? " (Modified)" : "");
-
-  std::string branding =
-      "edit v2.0.0 by @rahuldangeofficial | " + filename + details;
-
-  std::string rStatus = "Ln " + std::to_string(cursorY + 1) + ", Col " +
-                        std::to_string(cursorX + 1) + " ";
-
-  int len = (int)branding.size();
-  int rLen = (int)rStatus.size();
+  Status &st = m_status;
+  const std::string &file = buffer.GetFileName();
+  if (st.stale || st.lines != buffer.LineCount() ||
+      st.dirty != buffer.IsDirty() || st.file != file) {
+    st.stale = false;
+    st.lines = buffer.LineCount();
+    st.dirty = buffer.IsDirty();
+    st.file = file;
+    if (m_message.empty()) {
+      st.left = "edit v2.0.0 by @rahuldangeofficial | ";
+      st.left += file.empty() ? "[No Name]" : file;
+      st.left += " - " + std::to_string(st.lines) + " lines";
+      if (st.dirty)
+        st.left += " (Modified)";
+      if (!m_mode.empty())
+        st.left += " [" + m_mode + "]";
+    } else {
+      st.left = m_message;
+    }
+  }
 
-  // Truncate if screen is too small
-  if (len > m_screenCols)
-    len = m_screenCols;
+  size_t cursors = m_cursors.empty() ? 0 : m_cursors.size() + 1;
+  if (st.y != cursorY || st.x != cursorX || st.cursors != cursors) {
+    st.y = cursorY;
+    st.x = cursorX;
+    st.cursors = cursors;
+    if (cursors > 0)
+      snprintf(st.right, sizeof(st.right), "%zu cursors  Ln %d, Col %d ",
+               cursors, cursorY + 1, cursorX + 1);
+    else
+      snprintf(st.right, sizeof(st.right), "Ln %d, Col %d ", cursorY + 1,
+               cursorX + 1);
+  }
 
-  mvprintw(m_screenRows - 1, 0, "%s", branding.substr(0, len).c_str());
+  DrawStatusLine(st.left, st.right);
+}
 
-  // Fill the rest with whitespace
-  for (int i = len; i < m_screenCols; i++) {
-    mvaddch(m_screenRows - 1, i, ' ');
-  }
+void Display::DrawStatusLine(std::string_view left, std::string_view right) {
+  // Composed in full, padding included, and drawn with one call
+  size_t cols = (size_t)m_screenCols;
+  size_t len = std::min(left.size(), cols);
+  m_row.assign(left.data(), len);
+  m_row.append(cols - len, ' ');
 
   // Right aligned status
-  if (m_screenCols > len + rLen) {
-    mvprintw(m_screenRows - 1, m_screenCols - rLen, "%s", rStatus.c_str());
-  }
+  if (cols > len + right.size())
+    m_row.replace(cols - right.size(), right.size(), right.data(),
+                  right.size());
 
+  attron(A_DIM);
+  mvaddnstr(m_screenRows - 1, 0, m_row.data(), (int)m_row.size());
   attroff(A_DIM);
 }
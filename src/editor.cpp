@@ -5,26 +5,94 @@
  */
 
 #include "../include/editor.hpp"
+#include "../include/compression.hpp"
 #include "../include/constants.hpp"
 #include "../include/input.hpp"
+#include "../include/lineops.hpp"
 #include "../include/textutils.hpp"
+#include <algorithm>
 #include <exception>
+#include <numeric>
 #include <signal.h>
 #include <unistd.h>
 
 extern volatile sig_atomic_t g_signalStatus;
 
-Editor::Editor() : m_cy(0), m_cx(0), m_running(false) {}
+Editor::Editor()
+    : m_cy(0), m_cx(0), m_running(false), m_conflict(false), m_follow(false),
+      m_selecting(false), m_anchor{0, 0}, m_completing(false),
+      m_completeAt{0, 0}, m_completion(0), m_hit(0) {}
+
+void Editor::SetFollow(bool follow) {
+  m_follow = follow;
+  m_display.SetMode(follow ? "FOLLOW" : "");
+}
 
 void Editor::Run(const std::string &path) {
-  m_buffer.Load(path);
+  Open(path);
+  Loop();
+  Close();
+}
+
+void Editor::Grep(const std::string &root, const std::string &pattern,
+                  unsigned threads) {
+  m_searchRoot = root;
+  m_searchText = pattern;
+  m_hits.clear();
+  m_hit = 0;
+  m_search.Start(root, pattern, threads);
+  if (!PickHit())
+    return; // Nothing opened, nothing to remember
+  Loop();
+  Close();
+}
+
+void Editor::Open(const std::string &path) {
+  // Read before loading, so the first frame lands where the last one was
+  Session::State session;
+  bool restore = Session::Read(path, session);
+
+  m_buffer.Load(path, 0, true); // Compressed files paint after a checkpoint
+  FileReset();
+  if (!m_buffer.StreamError().empty()) {
+    m_display.SetMessage("Damaged after line " +
+                         std::to_string(m_buffer.LineCount()) + ": " +
+                         m_buffer.StreamError());
+  } else if (m_buffer.Streaming()) {
+    m_display.SetMessage(std::string("Inflating ") +
+                         Compression::Name(m_buffer.GetCompression()) +
+                         " file - lines keep arriving at the end");
+  }
+  // Delimited files open as a table; Ctrl+E switches to plain text
+  if (Table::Suggested(path)) {
+    if (char delimiter = Table::Detect(m_buffer))
+      m_table.Start(path, delimiter, m_buffer.GetEncoding());
+  }
+  m_watcher.Watch(path);
   m_running = true;
 
+  if (m_follow)
+    m_cy = m_buffer.LineCount() - 1;
+  else if (restore)
+    RestoreSession(session);
+}
+
+void Editor::Loop() {
   while (m_running) {
     // Check for external signal (Ctrl+C etc)
     if (g_signalStatus != 0) {
       try {
-        m_buffer.Save();
+        // Only unsaved edits are written, as in Save(): a clean buffer is
+        // already on disk, and rewriting it would drop lines appended
+        // meanwhile. Never clobber newer or damaged content unattended.
+        if (m_buffer.IsDirty()) {
+          if (!m_buffer.ExternallyModified() &&
+              m_buffer.StreamError().empty())
+            m_buffer.Save();
+          else
+            m_buffer.SaveCopy(m_buffer.GetFileName() +
+                              Edit::RECOVER_EXTENSION);
+        }
       } catch (...) {
         // Best effort save
       }
@@ -32,6 +100,9 @@ void Editor::Run(const std::string &path) {
       break;
     }
 
+    SyncEdits();
+    CheckExternalChange();
+
     if (m_cy < 0)
       m_cy = 0;
     if (m_cy >= m_buffer.LineCount())
@@ -43,42 +114,170 @@ void Editor::Run(const std::string &path) {
     if (m_cx > lineLen)
       m_cx = lineLen;
 
+    // Never leave the cursor inside a fold (search, undo, a new cursor)
+    if (m_folds.Header(m_cy) != m_cy)
+      m_folds.Remove(m_cy);
+
+    std::vector<Buffer::Range> selections;
+    std::vector<Buffer::Position> cursors;
+    Buffer::Position from, to;
+    if (GetSelection(from, to))
+      selections.push_back({from, to});
+    for (const Cursor &c : m_cursors) {
+      cursors.push_back(c.pos);
+      if (c.selecting && c.anchor != c.pos)
+        selections.push_back({std::min(c.anchor, c.pos),
+                              std::max(c.anchor, c.pos)});
+    }
+    std::sort(selections.begin(), selections.end(),
+              [](const Buffer::Range &a, const Buffer::Range &b) {
+                return a.from < b.from;
+              });
+    m_display.SetSelections(std::move(selections));
+    m_display.SetCursors(std::move(cursors));
+    m_display.SetChanges(m_diff.Published());
+    m_display.SetFolds(m_folds);
+    m_display.SetTable(m_table.Delimiter(), m_table.Published());
+
+    Buffer::Range pair;
+    if (m_structure.FindMatch(m_buffer, {m_cy, m_cx}, pair,
+                              Edit::BRACKET_SCAN_LINES))
+      m_display.SetBrackets({std::min(pair.from, pair.to),
+                             std::max(pair.from, pair.to)});
+    else
+      m_display.SetBrackets({});
+
     m_display.Scroll(m_buffer, m_cy, m_cx);
     m_display.Render(m_buffer, m_cy, m_cx);
     ProcessKey();
   }
 }
 
+void Editor::Close() {
+  Session::State session = {m_cy, m_cx, m_display.GetRowOff(),
+                           m_display.GetColOff(), m_history};
+  Session::Write(m_buffer.GetFileName(), session);
+}
+
+void Editor::RestoreSession(const Session::State &session) {
+  m_history = session.history;
+
+  // A compressed file inflates up to the saved line first; a lazily
+  // indexed one only decodes the lines the first frame shows
+  PumpStream(session.cy);
+  m_cy = std::max(0, std::min(session.cy, m_buffer.LineCount() - 1));
+  m_cx = std::max(0, session.cx); // Clamped to the line by the loop
+  m_display.SetRowOff(std::max(0, std::min(session.rowOff, m_cy)));
+  m_display.SetColOff(std::max(0, session.colOff));
+}
+
 void Editor::ProcessKey() {
   Edit::Key key = Input::ReadKey();
+  if (key.type != Edit::K_UNKNOWN)
+    m_display.SetMessage("");
+  if (key.type != Edit::K_COMPLETE && key.type != Edit::K_UNKNOWN)
+    m_completing = false;
+  // Any key but the wheel brings the view back to the cursor
+  if (key.type != Edit::K_WHEEL && key.type != Edit::K_UNKNOWN)
+    m_display.FollowCursor();
+
+  // Whatever one key does is one undo step, however many cursors it edits
+  m_buffer.BeginUndoGroup();
 
   switch (key.type) {
-  case Edit::K_QUIT:
-    // Auto-save on quit
-    try {
-      m_buffer.Save();
-    } catch (const std::exception &e) {
-      // Exceptions propagate to main for reporting
-      throw;
+  case Edit::K_ESC:
+    if (!m_cursors.empty() || m_selecting) {
+      m_cursors.clear();
+      m_selecting = false;
+      break;
     }
-    m_running = false;
+    [[fallthrough]]; // Nothing to collapse: Esc quits as before
+  case Edit::K_QUIT:
+    // Auto-save on quit; exceptions propagate to main for reporting
+    if (Save())
+      m_running = false;
     break;
 
   case Edit::K_CHAR:
-    if (key.value == '\t') {
-      for (int i = 0; i < Edit::TAB_STOP; ++i)
-        InsertChar(' ');
-    } else {
-      InsertChar(key.value);
+    // Tabs are stored verbatim and expanded only when rendered
+    if (!m_cursors.empty()) {
+      EditAll(TextUtils::CodePointToUtf8(key.value), false);
+      break;
     }
+    DeleteSelection();
+    InsertChar(key.value);
     break;
 
   case Edit::K_ENTER:
+    if (!m_cursors.empty()) {
+      EditAll("\n", false);
+      break;
+    }
+    DeleteSelection();
     InsertNewLine();
     break;
 
   case Edit::K_BACKSPACE:
-    DeleteChar();
+    if (!m_cursors.empty())
+      EditAll("", true);
+    else if (!DeleteSelection())
+      DeleteChar();
+    break;
+
+  case Edit::K_UNDO:
+    Undo(false);
+    break;
+
+  case Edit::K_REDO:
+    Undo(true);
+    break;
+
+  case Edit::K_ADD_CURSOR:
+    AddCursorBelow();
+    break;
+
+  case Edit::K_MATCHES:
+    AddCursorsAtMatches();
+    break;
+
+  case Edit::K_COLUMN:
+    ColumnSelect();
+    break;
+
+  case Edit::K_NEXT_CHANGE:
+    NextChange();
+    break;
+
+  case Edit::K_BRACKET:
+    JumpToBracket();
+    break;
+
+  case Edit::K_FOLD:
+    ToggleFold();
+    break;
+
+  case Edit::K_COMPLETE:
+    Complete();
+    break;
+
+  case Edit::K_LINES:
+    LineCommand();
+    break;
+
+  case Edit::K_MEMORY:
+    MemoryReport();
+    break;
+
+  case Edit::K_COPY:
+    Copy(false);
+    break;
+
+  case Edit::K_CUT:
+    Copy(true);
+    break;
+
+  case Edit::K_PASTE:
+    Paste();
     break;
 
   case Edit::K_ARROW_UP:
@@ -89,65 +288,619 @@ void Editor::ProcessKey() {
   case Edit::K_END:
   case Edit::K_PAGE_UP:
   case Edit::K_PAGE_DOWN:
-    MoveCursor(key.type);
+  case Edit::K_WORD_LEFT:
+  case Edit::K_WORD_RIGHT:
+    MoveCursor(key.type, key.shift);
     break;
 
   case Edit::K_MOUSE:
     HandleMouseClick(key.mouseY, key.mouseX);
     break;
 
+  case Edit::K_MOUSE_DRAG:
+    HandleMouseDrag(key.mouseY, key.mouseX);
+    break;
+
+  case Edit::K_WHEEL:
+    m_display.ScrollView(key.value, m_buffer.LineCount());
+    break;
+
+  case Edit::K_FOLLOW:
+    ToggleFollow();
+    break;
+
+  case Edit::K_TABLE:
+    ToggleTable();
+    break;
+
+  case Edit::K_FIND:
+    FindInFiles();
+    break;
+
   default:
     break;
   }
+
+  m_buffer.EndUndoGroup();
+}
+
+void Editor::MoveCursor(int keyType, bool extend) {
+  std::vector<Cursor> all = AllCursors();
+  for (Cursor &c : all) {
+    if (!extend) {
+      c.selecting = false;
+    } else if (!c.selecting) {
+      c.selecting = true;
+      c.anchor = c.pos;
+    }
+    c.pos = Step(c.pos, keyType);
+  }
+  SetCursors(all);
 }
 
-void Editor::MoveCursor(int keyType) {
-  int rowLen = (int)m_buffer.GetLine(m_cy).size();
+Buffer::Position Editor::Step(Buffer::Position pos, int keyType) const {
+  int rowLen = (int)m_buffer.GetLine(pos.y).size();
 
   switch (keyType) {
   case Edit::K_ARROW_LEFT:
-    if (m_cx > 0) {
+    if (pos.x > 0) {
       // Move to previous code point
-      m_cx = (int)TextUtils::PrevCharIdx(m_buffer.GetLine(m_cy), m_cx);
-    } else if (m_cy > 0) {
-      m_cy--;
-      m_cx = (int)m_buffer.GetLine(m_cy).size();
+      pos.x = (int)Text().PrevCharIdx(m_buffer.GetLine(pos.y), pos.x);
+    } else if (pos.y > 0) {
+      pos.y = m_folds.Up(pos.y, 1);
+      pos.x = (int)m_buffer.GetLine(pos.y).size();
     }
     break;
   case Edit::K_ARROW_RIGHT:
-    if (m_cx < rowLen) {
+    if (pos.x < rowLen) {
       // Move to next code point
-      m_cx = (int)TextUtils::NextCharIdx(m_buffer.GetLine(m_cy), m_cx);
-    } else if (m_cy < m_buffer.LineCount() - 1) {
-      m_cy++;
-      m_cx = 0;
+      pos.x = (int)Text().NextCharIdx(m_buffer.GetLine(pos.y), pos.x);
+    } else if (pos.y < m_buffer.LineCount() - 1) {
+      pos.y = m_folds.Down(pos.y, 1, m_buffer.LineCount());
+      pos.x = 0;
     }
     break;
+  case Edit::K_WORD_LEFT:
+    // In the table view: by field
+    if (pos.x > 0 && m_table.Delimiter())
+      pos.x = (int)Table::PrevField(m_buffer.GetLine(pos.y),
+                                    m_table.Delimiter(), pos.x);
+    else if (pos.x > 0)
+      pos.x = (int)TextUtils::PrevWordStart(m_buffer.GetLine(pos.y), pos.x);
+    else
+      return Step(pos, Edit::K_ARROW_LEFT);
+    break;
+  case Edit::K_WORD_RIGHT:
+    if (pos.x < rowLen && m_table.Delimiter())
+      pos.x = (int)Table::NextField(m_buffer.GetLine(pos.y),
+                                    m_table.Delimiter(), pos.x);
+    else if (pos.x < rowLen)
+      pos.x = (int)TextUtils::NextWordEnd(m_buffer.GetLine(pos.y), pos.x);
+    else
+      return Step(pos, Edit::K_ARROW_RIGHT);
+    break;
   case Edit::K_ARROW_UP:
-    if (m_cy > 0)
-      m_cy--;
+    pos.y = m_folds.Up(pos.y, 1);
     break;
   case Edit::K_ARROW_DOWN:
-    if (m_cy < m_buffer.LineCount() - 1)
-      m_cy++;
+    pos.y = m_folds.Down(pos.y, 1, m_buffer.LineCount());
     break;
   case Edit::K_HOME:
-    m_cx = 0;
+    pos.x = 0;
     break;
   case Edit::K_END:
-    m_cx = rowLen;
+    pos.x = rowLen;
     break;
   case Edit::K_PAGE_UP:
-    m_cy -= m_display.Rows();
-    if (m_cy < 0)
-      m_cy = 0;
+    pos.y = m_folds.Up(pos.y, m_display.Rows());
     break;
   case Edit::K_PAGE_DOWN:
-    m_cy += m_display.Rows();
-    if (m_cy >= m_buffer.LineCount())
-      m_cy = m_buffer.LineCount() - 1;
+    pos.y = m_folds.Down(pos.y, m_display.Rows(), m_buffer.LineCount());
     break;
   }
+
+  // Vertical moves keep the byte column; clamp it to the new line
+  pos.x = std::min(pos.x, (int)m_buffer.GetLine(pos.y).size());
+  return pos;
+}
+
+bool Editor::GetSelection(Buffer::Position &from, Buffer::Position &to) const {
+  if (!m_selecting)
+    return false;
+  Buffer::Position cursor = {m_cy, m_cx};
+  if (cursor == m_anchor)
+    return false;
+  from = cursor < m_anchor ? cursor : m_anchor;
+  to = cursor < m_anchor ? m_anchor : cursor;
+  return true;
+}
+
+bool Editor::DeleteSelection() {
+  Buffer::Position from, to;
+  bool any = GetSelection(from, to);
+  m_selecting = false;
+  if (!any)
+    return false;
+
+  Buffer::Position at = m_buffer.DeleteRange(from, to);
+  m_cy = at.y;
+  m_cx = at.x;
+  return true;
+}
+
+void Editor::Copy(bool cut) {
+  Buffer::Position from, to;
+  if (!GetSelection(from, to))
+    return;
+
+  // With several cursors the primary selection is what gets copied
+  m_clipboard = m_buffer.Copy(from, to);
+  if (cut && !m_cursors.empty()) {
+    EditAll("", false);
+  } else if (cut) {
+    DeleteSelection();
+  }
+  if (cut) {
+    m_display.SetMessage("Cut " + std::to_string(m_clipboard.Size()) +
+                         " bytes");
+  } else {
+    m_display.SetMessage("Copied " + std::to_string(m_clipboard.Size()) +
+                         " bytes");
+  }
+}
+
+void Editor::Paste() {
+  if (m_clipboard.Empty())
+    return;
+  if (!m_cursors.empty()) {
+    // A batch inserts plain text; its '\n' breaks take the buffer's ending
+    std::string text;
+    text.reserve(m_clipboard.Size());
+    for (const Buffer::Clip::Piece &piece : m_clipboard.pieces) {
+      const char *bytes = piece.block.get() + piece.offset;
+      for (size_t i = 0; i < piece.length; ++i) {
+        if (bytes[i] == '\n' && !text.empty() && text.back() == '\r')
+          text.pop_back();
+        text += bytes[i];
+      }
+    }
+    EditAll(text, false);
+    return;
+  }
+  DeleteSelection();
+  Buffer::Position end = m_buffer.InsertClip({m_cy, m_cx}, m_clipboard);
+  m_cy = end.y;
+  m_cx = end.x;
+}
+
+std::vector<Editor::Cursor> Editor::AllCursors() const {
+  std::vector<Cursor> all;
+  all.reserve(m_cursors.size() + 1);
+  all.push_back({{m_cy, m_cx}, m_anchor, m_selecting});
+  all.insert(all.end(), m_cursors.begin(), m_cursors.end());
+  return all;
+}
+
+void Editor::SetCursors(const std::vector<Cursor> &all) {
+  m_cy = all[0].pos.y;
+  m_cx = all[0].pos.x;
+  m_anchor = all[0].anchor;
+  m_selecting = all[0].selecting;
+
+  // Cursors that met (moving into the same spot, or edits that merged)
+  // become one
+  Buffer::Position primary = all[0].pos;
+  m_cursors.assign(all.begin() + 1, all.end());
+  std::sort(m_cursors.begin(), m_cursors.end(),
+            [](const Cursor &a, const Cursor &b) { return a.pos < b.pos; });
+  m_cursors.erase(std::unique(m_cursors.begin(), m_cursors.end(),
+                              [](const Cursor &a, const Cursor &b) {
+                                return a.pos == b.pos;
+                              }),
+                  m_cursors.end());
+  m_cursors.erase(std::remove_if(m_cursors.begin(), m_cursors.end(),
+                                 [&](const Cursor &c) {
+                                   return c.pos == primary;
+                                 }),
+                  m_cursors.end());
+}
+
+void Editor::EditAll(const std::string &text, bool backspace) {
+  std::vector<Cursor> all = AllCursors();
+
+  // What each cursor replaces: its selection, the character before it
+  // (backspace) or nothing (insert)
+  std::vector<Buffer::Range> ranges(all.size());
+  for (size_t i = 0; i < all.size(); ++i) {
+    const Cursor &c = all[i];
+    Buffer::Range r = {c.pos, c.pos};
+    if (c.selecting && c.anchor != c.pos) {
+      r = {std::min(c.anchor, c.pos), std::max(c.anchor, c.pos)};
+    } else if (backspace && c.pos.x > 0) {
+      std::string_view line = m_buffer.GetLine(c.pos.y);
+      r.from.x = (int)Text().PrevCharIdx(line, c.pos.x);
+    } else if (backspace && c.pos.y > 0) {
+      r.from = {c.pos.y - 1, (int)m_buffer.GetLine(c.pos.y - 1).size()};
+    }
+    ranges[i] = r;
+  }
+
+  // The buffer takes them sorted and disjoint: touching ranges merge, and
+  // their cursors end up as one
+  std::vector<size_t> order(all.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return ranges[a].from < ranges[b].from;
+  });
+  std::vector<Buffer::Range> batch;
+  std::vector<size_t> target(all.size());
+  for (size_t i : order) {
+    const Buffer::Range &r = ranges[i];
+    if (!batch.empty() && !(batch.back().to < r.from)) {
+      batch.back().to = std::max(batch.back().to, r.to);
+    } else {
+      batch.push_back(r);
+    }
+    target[i] = batch.size() - 1;
+  }
+
+  std::vector<Buffer::Position> ends = m_buffer.ReplaceRanges(batch, text);
+  for (size_t i = 0; i < all.size(); ++i)
+    all[i] = {ends[target[i]], ends[target[i]], false};
+  SetCursors(all);
+}
+
+void Editor::AddCursorBelow() {
+  if (m_cursors.size() + 1 >= Edit::MAX_CURSORS) {
+    m_display.SetMessage("Too many cursors");
+    return;
+  }
+
+  // Below the lowest cursor, at the primary's visual column
+  int lowest = m_cy;
+  if (!m_cursors.empty())
+    lowest = std::max(lowest, m_cursors.back().pos.y);
+  int next = m_folds.Down(lowest, 1, m_buffer.LineCount());
+  if (next == lowest)
+    return;
+  int visualX = Text().VisualWidth(m_buffer.GetLine(m_cy).substr(0, m_cx));
+  std::string_view below = m_buffer.GetLine(next);
+
+  // The new cursor becomes the primary, so the view follows it down
+  std::vector<Cursor> all = AllCursors();
+  all.push_back(all[0]);
+  all[0] = {{next, (int)Text().ByteIdxForVisual(below, visualX)},
+            {0, 0},
+            false};
+  SetCursors(all);
+}
+
+void Editor::AddCursorsAtMatches() {
+  // The needle: the primary selection, or else the word under the cursor
+  Buffer::Position from, to;
+  if (GetSelection(from, to)) {
+    if (from.y != to.y) {
+      m_display.SetMessage("Matches are found within a line");
+      return;
+    }
+  } else {
+    std::string_view line = m_buffer.GetLine(m_cy);
+    size_t start = m_cx, end = m_cx;
+    while (start > 0 && TextUtils::IsWordByte(line[start - 1]))
+      start--;
+    while (end < line.size() && TextUtils::IsWordByte(line[end]))
+      end++;
+    if (start == end)
+      return;
+    from = {m_cy, (int)start};
+    to = {m_cy, (int)end};
+  }
+  std::string needle(m_buffer.GetLine(from.y).substr(from.x, to.x - from.x));
+
+  std::vector<Cursor> all = {{to, from, true}};
+  bool capped = false;
+  for (int y = 0; y < m_buffer.LineCount() && !capped; ++y) {
+    std::string_view line = m_buffer.GetLine(y);
+    for (size_t hit = TextUtils::Find(line, needle);
+         hit != std::string_view::npos;
+         hit = TextUtils::Find(line, needle, hit + needle.size())) {
+      if (y == from.y && (int)hit == from.x)
+        continue;
+      if (all.size() >= Edit::MAX_CURSORS) {
+        capped = true;
+        break;
+      }
+      all.push_back({{y, (int)(hit + needle.size())}, {y, (int)hit}, true});
+    }
+  }
+  SetCursors(all);
+  m_display.SetMessage(std::to_string(all.size()) + " matches" +
+                       (capped ? " (cursor limit reached)" : ""));
+}
+
+void Editor::ColumnSelect() {
+  Buffer::Position from, to;
+  if (!GetSelection(from, to) || from.y == to.y) {
+    m_display.SetMessage("Select across lines first");
+    return;
+  }
+
+  // One cursor per line, selecting between the anchor's and the cursor's
+  // visual columns; lines too short get an empty selection at their end
+  std::string_view line = m_buffer.GetLine(m_anchor.y);
+  int anchorX = Text().VisualWidth(line.substr(0, m_anchor.x));
+  line = m_buffer.GetLine(m_cy);
+  int cursorX = Text().VisualWidth(line.substr(0, m_cx));
+
+  auto at = [&](int y) {
+    std::string_view text = m_buffer.GetLine(y);
+    return Cursor{{y, (int)Text().ByteIdxForVisual(text, cursorX)},
+                  {y, (int)Text().ByteIdxForVisual(text, anchorX)},
+                  true};
+  };
+  std::vector<Cursor> all = {at(m_cy)};
+  for (int y = from.y; y <= to.y && all.size() < Edit::MAX_CURSORS; ++y) {
+    if (y != m_cy)
+      all.push_back(at(y));
+  }
+  SetCursors(all);
+}
+
+void Editor::Undo(bool redo) {
+  Buffer::Position at;
+  if (!(redo ? m_buffer.Redo(at) : m_buffer.Undo(at))) {
+    m_display.SetMessage(redo ? "Nothing to redo" : "Nothing to undo");
+    return;
+  }
+  m_cursors.clear();
+  m_selecting = false;
+  m_cy = at.y;
+  m_cx = at.x;
+}
+
+void Editor::SyncEdits() {
+  // An edit finished the stream: the indexes must take the last of it
+  // (and their base) before the edit
+  PumpStream();
+  Buffer::LineEdit edit;
+  if (!m_buffer.TakeLineEdit(edit))
+    return;
+  m_diff.Edited(m_buffer, edit);
+  m_structure.Edited(edit);
+  m_folds.Edited(edit);
+  m_words.Edited(m_buffer, edit);
+}
+
+void Editor::FileChanged(const Buffer::LineEdit &edit) {
+  m_diff.Synced(m_buffer, edit);
+  m_structure.Edited(edit);
+  m_folds.Edited(edit);
+  m_words.Edited(m_buffer, edit);
+}
+
+void Editor::FileReset() {
+  m_structure.Reset(m_buffer.LineCount());
+  m_folds.Clear();
+  if (m_table.Delimiter()) // Sample the new text
+    m_table.Start(m_buffer.GetFileName(), m_table.Delimiter(),
+                  m_buffer.GetEncoding());
+  if (m_buffer.Streaming())
+    return; // Diff and words read the whole file; see PumpStream
+  m_diff.Reset(m_buffer.GetFileName(), m_buffer.LineCount(),
+               m_buffer.InflatedText());
+  m_words.Reset(m_buffer.GetFileName(), m_buffer.LineCount(),
+                m_buffer.InflatedText());
+}
+
+void Editor::PumpStream(int line) {
+  Buffer::LineEdit appended;
+  if (!m_buffer.Pump(appended, line))
+    return;
+  if (appended.added > 0) {
+    m_structure.Edited(appended);
+    m_folds.Edited(appended);
+  }
+  if (m_buffer.Streaming())
+    return;
+
+  // The whole text is in. Edits may have followed it, but SyncEdits has
+  // held them back, so they reach the indexes after this base
+  int lines = appended.first + appended.added;
+  m_diff.Reset(m_buffer.GetFileName(), lines, m_buffer.InflatedText());
+  m_words.Reset(m_buffer.GetFileName(), lines, m_buffer.InflatedText());
+  if (!m_buffer.StreamError().empty()) {
+    m_display.SetMessage("Damaged after line " + std::to_string(lines) +
+                         ": " + m_buffer.StreamError());
+  } else if (!m_buffer.IsDirty()) {
+    m_display.SetMessage(std::to_string(lines) + " lines inflated");
+  }
+}
+
+void Editor::NextChange() {
+  SyncEdits();
+  std::shared_ptr<const DiffIndex::Hunks> hunks = m_diff.Published();
+  if (hunks->empty()) {
+    m_display.SetMessage("No changes");
+    return;
+  }
+
+  // First hunk below the cursor, wrapping around to the top
+  auto next = std::upper_bound(
+      hunks->begin(), hunks->end(), m_cy,
+      [](int y, const DiffIndex::Hunk &h) { return y < h.first; });
+  if (next == hunks->end())
+    next = hunks->begin();
+
+  m_cursors.clear();
+  m_selecting = false;
+  m_cy = std::min(next->first, m_buffer.LineCount() - 1);
+  m_cx = 0;
+}
+
+void Editor::JumpToBracket() {
+  Buffer::Range pair;
+  if (!m_structure.FindMatch(m_buffer, {m_cy, m_cx}, pair)) {
+    m_display.SetMessage("No matching bracket");
+    return;
+  }
+  m_cursors.clear();
+  m_selecting = false;
+  m_cy = pair.to.y;
+  m_cx = pair.to.x;
+}
+
+void Editor::ToggleFold() {
+  if (m_folds.Remove(m_cy))
+    return;
+  int last = m_structure.FoldEnd(m_buffer, m_cy);
+  if (last == m_cy) {
+    m_display.SetMessage("Nothing to fold here");
+    return;
+  }
+  m_folds.Add(m_cy, last);
+}
+
+void Editor::Complete() {
+  if (!m_cursors.empty()) {
+    m_display.SetMessage("Completion needs a single cursor");
+    return;
+  }
+  std::string_view line = m_buffer.GetLine(m_cy);
+
+  if (m_completing && m_completions.size() > 1) {
+    // Again: swap the inserted word for the next candidate
+    const std::string &shown = m_completions[m_completion];
+    Buffer::Position end = {m_completeAt.y, m_completeAt.x +
+                                                (int)shown.size() -
+                                                (int)m_completePrefix.size()};
+    m_buffer.DeleteRange(m_completeAt, end);
+    m_completion = (m_completion + 1) % m_completions.size();
+  } else {
+    m_completing = false;
+    size_t start = m_cx;
+    while (start > 0 && TextUtils::IsWordByte(line[start - 1]))
+      start--;
+    m_completePrefix = std::string(line.substr(start, m_cx - start));
+    if (m_completePrefix.empty()) {
+      m_display.SetMessage("Nothing to complete");
+      return;
+    }
+    SyncEdits();
+    m_completions = m_words.Suggest(m_buffer, m_completePrefix,
+                                    Edit::COMPLETIONS);
+    if (m_completions.empty()) {
+      m_display.SetMessage(m_words.Building() ? "Indexing words..."
+                                              : "No completions");
+      return;
+    }
+    m_completeAt = {m_cy, m_cx};
+    m_completion = 0;
+    m_completing = true;
+    m_selecting = false;
+  }
+
+  std::string rest = m_completions[m_completion].substr(
+      m_completePrefix.size());
+  m_buffer.InsertString(m_completeAt.y, m_completeAt.x, rest);
+  m_cy = m_completeAt.y;
+  m_cx = m_completeAt.x + (int)rest.size();
+
+  std::string list;
+  for (size_t i = 0; i < m_completions.size(); ++i) {
+    list += i == m_completion ? "[" + m_completions[i] + "]"
+                              : m_completions[i];
+    if (i + 1 < m_completions.size())
+      list += " ";
+  }
+  m_display.SetMessage(list);
+}
+
+void Editor::LineCommand() {
+  // The selected lines (a selection ending at a line start stops before
+  // it), or the whole buffer
+  int first = 0;
+  int last = m_buffer.LineCount() - 1;
+  Buffer::Position from, to;
+  if (GetSelection(from, to)) {
+    first = from.y;
+    last = to.x == 0 && to.y > from.y ? to.y - 1 : to.y;
+  }
+  int count = last - first + 1;
+
+  int choice = Choose("Lines: (s)ort (n)umeric sort (u)nique (r)everse "
+                      "(k)eep/(d)rop matching",
+                      "snurkd");
+  LineOps::Op op;
+  switch (choice) {
+  case 's':
+    op = LineOps::Op::Sort;
+    break;
+  case 'n':
+    op = LineOps::Op::SortNumeric;
+    break;
+  case 'u':
+    op = LineOps::Op::Unique;
+    break;
+  case 'r':
+    op = LineOps::Op::Reverse;
+    break;
+  case 'k':
+    op = LineOps::Op::Keep;
+    break;
+  case 'd':
+    op = LineOps::Op::Remove;
+    break;
+  default:
+    return;
+  }
+
+  std::string pattern;
+  if ((op == LineOps::Op::Keep || op == LineOps::Op::Remove) &&
+      (!Prompt(op == LineOps::Op::Keep ? "Keep lines containing: "
+                                       : "Drop lines containing: ",
+               pattern) ||
+       pattern.empty()))
+    return;
+
+  int kept;
+  try {
+    kept = LineOps::Apply(m_buffer, first, count, op, pattern);
+  } catch (const std::exception &e) {
+    m_display.SetMessage(e.what());
+    return;
+  }
+
+  m_cursors.clear();
+  m_selecting = false;
+  m_cy = std::min(first, m_buffer.LineCount() - 1);
+  m_cx = 0;
+  std::string lines = std::to_string(count) + " lines";
+  if (op == LineOps::Op::Reverse)
+    m_display.SetMessage("Reversed " + lines);
+  else if (op == LineOps::Op::Sort || op == LineOps::Op::SortNumeric)
+    m_display.SetMessage("Sorted " + lines);
+  else
+    m_display.SetMessage("Kept " + std::to_string(kept) + " of " + lines);
+}
+
+void Editor::MemoryReport() {
+  Buffer::MemoryUsage usage = m_buffer.Memory();
+  size_t words = m_words.MemoryBytes();
+  size_t brackets = m_structure.MemoryBytes();
+  size_t diff = m_diff.MemoryBytes();
+  size_t total = usage.text + usage.lines + usage.edits + usage.undo + words +
+                 brackets + diff;
+
+  char ratio[32];
+  snprintf(ratio, sizeof(ratio), "%.2fx",
+           (double)total / (double)std::max<size_t>(usage.text, 1));
+  using TextUtils::FormatBytes;
+  m_display.SetMessage(
+      "Memory " + FormatBytes(total) + " (" + ratio + " text): text " +
+      FormatBytes(usage.text) + ", lines " + FormatBytes(usage.lines) +
+      ", edits " + FormatBytes(usage.edits) + ", undo " +
+      FormatBytes(usage.undo) + ", words " + FormatBytes(words) +
+      ", brackets " + FormatBytes(brackets) + ", diff " + FormatBytes(diff));
 }
 
 void Editor::InsertChar(int c) {
@@ -182,31 +935,381 @@ void Editor::DeleteChar() {
   }
 }
 
+bool Editor::Save() {
+  // A clean buffer already matches the disk; rewriting it would only race
+  // with other writers (e.g. a followed log)
+  if (!m_buffer.IsDirty() && m_buffer.ExistsOnDisk())
+    return true;
+
+  if (m_buffer.ExternallyModified() &&
+      !Confirm("File changed on disk since it was opened. Overwrite? (y/n)")) {
+    m_display.SetMessage("Save cancelled - file on disk is newer");
+    return false;
+  }
+
+  if (!m_buffer.StreamError().empty()) {
+    // Writing would drop the text past the damage; keep the original
+    std::string copy = m_buffer.GetFileName() + Edit::RECOVER_EXTENSION;
+    if (!Confirm("File is damaged - write edits to " + copy +
+                 " instead? (y/n)")) {
+      m_display.SetMessage("Save cancelled - file is damaged");
+      return false;
+    }
+    m_buffer.SaveCopy(copy);
+    return true;
+  }
+
+  SyncEdits(); // The diff must have every edit before the base moves
+  m_buffer.Save();
+  m_diff.Saved();
+  m_conflict = false;
+  return true;
+}
+
+bool Editor::Confirm(const std::string &question) {
+  m_display.SetMessage(question);
+  bool answer = false;
+  for (;;) {
+    m_display.Render(m_buffer, m_cy, m_cx);
+    Edit::Key key = Input::ReadKey();
+    if (g_signalStatus != 0 || key.type == Edit::K_QUIT)
+      break;
+    if (key.type == Edit::K_CHAR && (key.value == 'y' || key.value == 'Y')) {
+      answer = true;
+      break;
+    }
+    if (key.type == Edit::K_CHAR && (key.value == 'n' || key.value == 'N'))
+      break;
+  }
+  m_display.SetMessage("");
+  return answer;
+}
+
+int Editor::Choose(const std::string &question, const std::string &keys) {
+  m_display.SetMessage(question);
+  int answer = 0;
+  for (;;) {
+    m_display.Render(m_buffer, m_cy, m_cx);
+    Edit::Key key = Input::ReadKey();
+    if (g_signalStatus != 0 || key.type == Edit::K_QUIT ||
+        key.type == Edit::K_ESC)
+      break;
+    if (key.type == Edit::K_CHAR && key.value < 128 &&
+        keys.find((char)key.value) != std::string::npos) {
+      answer = key.value;
+      break;
+    }
+  }
+  m_display.SetMessage("");
+  return answer;
+}
+
+bool Editor::Prompt(const std::string &question, std::string &answer) {
+  answer.clear();
+  bool accepted = false;
+  size_t recall = m_history.size(); // Past the newest: a fresh answer
+  for (;;) {
+    m_display.SetMessage(question + answer);
+    m_display.Render(m_buffer, m_cy, m_cx);
+    Edit::Key key = Input::ReadKey();
+    if (g_signalStatus != 0 || key.type == Edit::K_QUIT ||
+        key.type == Edit::K_ESC)
+      break;
+    if (key.type == Edit::K_ENTER) {
+      accepted = true;
+      break;
+    }
+    if (key.type == Edit::K_CHAR) {
+      answer += TextUtils::CodePointToUtf8(key.value);
+    } else if (key.type == Edit::K_BACKSPACE && !answer.empty()) {
+      answer.resize(TextUtils::PrevCharIdx(answer, answer.size()));
+    } else if (key.type == Edit::K_ARROW_UP && recall > 0) {
+      answer = m_history[--recall];
+    } else if (key.type == Edit::K_ARROW_DOWN && recall < m_history.size()) {
+      answer = ++recall < m_history.size() ? m_history[recall] : "";
+    }
+  }
+  m_display.SetMessage("");
+
+  if (accepted && !answer.empty()) {
+    m_history.erase(std::remove(m_history.begin(), m_history.end(), answer),
+                    m_history.end());
+    m_history.push_back(answer);
+    if (m_history.size() > Edit::SESSION_HISTORY)
+      m_history.erase(m_history.begin());
+  }
+  return accepted;
+}
+
+void Editor::CheckExternalChange() {
+  // Changes wait until a compressed file has finished inflating
+  if (m_buffer.Streaming())
+    return;
+
+  if (m_follow) {
+    FollowFile();
+    return;
+  }
+
+  // A stale lazy index raises no file event: poll for it as well
+  bool changed = m_watcher.Poll();
+  if ((!changed && !m_buffer.Stale()) || m_conflict ||
+      !m_buffer.ExternallyModified())
+    return;
+
+  if (m_buffer.IsDirty()) {
+    // Keep the user's edits; Save() will ask before overwriting
+    m_conflict = true;
+    m_display.SetMessage("File changed on disk - saving will ask first");
+    return;
+  }
+
+  Buffer::ReloadResult r;
+  try {
+    r = m_buffer.Reload();
+  } catch (const std::exception &) {
+    m_conflict = true;
+    m_display.SetMessage("File was removed or is unreadable on disk");
+    return;
+  }
+
+  // Lines after the replaced range keep their identity, shifted by delta
+  int delta = r.newLines - r.oldLines;
+  int changedEnd = r.firstLine + r.oldLines;
+  if (m_cy >= changedEnd) {
+    m_cy += delta;
+  } else if (m_cy >= r.firstLine && m_cy >= r.firstLine + r.newLines) {
+    m_cy = r.firstLine + (r.newLines > 0 ? r.newLines - 1 : 0);
+  }
+  if (m_display.GetRowOff() >= changedEnd)
+    m_display.SetRowOff(m_display.GetRowOff() + delta);
+  FileChanged({r.firstLine, r.oldLines, r.newLines});
+
+  m_cursors.clear();
+  m_display.SetMessage("Reloaded - file changed on disk");
+}
+
+void Editor::FollowFile() {
+  if (!m_watcher.Poll())
+    return;
+
+  if (m_buffer.IsDirty()) {
+    m_display.SetMessage("Follow paused - save or quit to resume");
+    return;
+  }
+
+  // Stick to the end only if the user is already there
+  int lines = m_buffer.LineCount();
+  bool atEnd = m_cy >= lines - 1;
+
+  Buffer::IngestResult result;
+  try {
+    result = m_buffer.Ingest();
+  } catch (const std::exception &) {
+    m_display.SetMessage("Follow: file is unreadable");
+    return;
+  }
+
+  if (result == Buffer::IngestResult::Unchanged)
+    return;
+  SyncIngest(result, lines);
+  if (result == Buffer::IngestResult::Reset) {
+    m_cursors.clear();
+    m_display.SetMessage("Follow: file was truncated or rotated - reloaded");
+  }
+
+  if (atEnd) {
+    m_cy = m_buffer.LineCount() - 1;
+    m_cx = 0;
+  }
+}
+
+void Editor::ToggleFollow() {
+  SetFollow(!m_follow);
+  if (m_follow) {
+    // Catch up with anything written meanwhile, then jump to the end
+    int lines = m_buffer.LineCount();
+    try {
+      SyncIngest(m_buffer.Ingest(), lines);
+    } catch (const std::exception &) {
+    }
+    m_cy = m_buffer.LineCount() - 1;
+    m_cx = 0;
+  }
+}
+
+void Editor::ToggleTable() {
+  m_display.SetColOff(0); // The other layout starts at the left edge
+  if (m_table.Delimiter()) {
+    m_table.Stop();
+    m_display.SetMessage("Table view off");
+    return;
+  }
+  char delimiter = Table::Detect(m_buffer);
+  if (!delimiter) {
+    m_display.SetMessage("No delimited columns in the first lines");
+    return;
+  }
+  m_table.Start(m_buffer.GetFileName(), delimiter, m_buffer.GetEncoding());
+  m_display.SetMessage(std::string("Table view: columns split at ") +
+                       Table::Name(delimiter) +
+                       "; Ctrl+Left/Right step between fields");
+}
+
+void Editor::FindInFiles() {
+  std::string pattern;
+  if (!Prompt("Search files for (Enter: last results): ", pattern))
+    return;
+  if (!pattern.empty()) {
+    m_searchRoot = ".";
+    m_searchText = pattern;
+    m_hits.clear();
+    m_hit = 0;
+    m_search.Start(m_searchRoot, pattern);
+  } else if (m_searchText.empty()) {
+    return;
+  }
+  PickHit();
+}
+
+bool Editor::PickHit() {
+  for (;;) {
+    m_search.Take(m_hits);
+    std::string status;
+    if (!m_search.Done()) {
+      status = "Searching " + std::to_string(m_search.Files()) +
+               " files for '" + m_searchText + "'... ";
+    } else {
+      status = std::to_string(m_hits.size()) + " matches for '" +
+               m_searchText + "' in " + std::to_string(m_search.Files()) +
+               " files";
+      if (m_search.Capped())
+        status += " (stopped at the limit)";
+      status += " - ";
+    }
+    status += "Enter: open, Esc: back";
+    m_display.RenderHits(m_hits, m_hit, m_searchText.size(), status);
+
+    Edit::Key key = Input::ReadKey();
+    if (g_signalStatus != 0 || key.type == Edit::K_QUIT ||
+        key.type == Edit::K_ESC)
+      return false;
+
+    size_t last = m_hits.empty() ? 0 : m_hits.size() - 1;
+    size_t page = (size_t)std::max(1, m_display.Rows() - 2);
+    switch (key.type) {
+    case Edit::K_ARROW_UP:
+      m_hit = m_hit > 0 ? m_hit - 1 : 0;
+      break;
+    case Edit::K_ARROW_DOWN:
+      m_hit = std::min(m_hit + 1, last);
+      break;
+    case Edit::K_PAGE_UP:
+      m_hit = m_hit > page ? m_hit - page : 0;
+      break;
+    case Edit::K_PAGE_DOWN:
+      m_hit = std::min(m_hit + page, last);
+      break;
+    case Edit::K_HOME:
+      m_hit = 0;
+      break;
+    case Edit::K_END:
+      m_hit = last;
+      break;
+    case Edit::K_WHEEL:
+      if (key.value < 0)
+        m_hit = m_hit > (size_t)-key.value ? m_hit + key.value : 0;
+      else
+        m_hit = std::min(m_hit + (size_t)key.value, last);
+      break;
+    case Edit::K_MOUSE: {
+      size_t row = m_display.HitAtRow(key.mouseY);
+      if (key.mouseY >= m_display.Rows() - 1 || row >= m_hits.size())
+        break;
+      m_hit = row;
+      if (OpenHit(m_hits[m_hit]))
+        return true;
+      break;
+    }
+    case Edit::K_ENTER:
+      if (!m_hits.empty() && OpenHit(m_hits[m_hit]))
+        return true;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+bool Editor::OpenHit(const ProjectSearch::Hit &hit) {
+  if (!m_running) {
+    Open(hit.path);
+  } else if (hit.path != m_buffer.GetFileName()) {
+    // One file at a time: leave this one as quitting would
+    if (!Save())
+      return false;
+    Close();
+    m_cursors.clear();
+    m_selecting = false;
+    m_completing = false;
+    m_conflict = false;
+    SetFollow(false);
+    m_table.Stop();
+    m_display.SetRowOff(0);
+    m_display.SetColOff(0);
+    m_history.clear();
+    Open(hit.path);
+  }
+
+  // Select the match, as the list showed it
+  PumpStream(hit.line);
+  m_cursors.clear();
+  m_cy = std::min(hit.line, m_buffer.LineCount() - 1);
+  size_t length = m_buffer.GetLine(m_cy).size();
+  size_t from = std::min((size_t)hit.column, length);
+  m_anchor = {m_cy, (int)from};
+  m_cx = (int)std::min(from + m_searchText.size(), length);
+  m_selecting = m_cx > (int)from;
+  m_display.FollowCursor();
+  m_display.SetMessage(hit.path + ":" + std::to_string(hit.line + 1));
+  return true;
+}
+
+void Editor::SyncIngest(Buffer::IngestResult result, int lines) {
+  if (result == Buffer::IngestResult::Reset) {
+    FileReset();
+  } else if (result == Buffer::IngestResult::Appended) {
+    // The old last line may have been completed; the rest is new
+    FileChanged({lines - 1, 1, m_buffer.LineCount() - lines + 1});
+  }
+}
+
 void Editor::HandleMouseClick(int screenY, int screenX) {
-  // Convert screen Y to buffer Y
-  int newY = screenY + m_display.GetRowOff();
-  if (newY < 0)
-    newY = 0;
-  if (newY >= m_buffer.LineCount())
-    newY = m_buffer.LineCount() - 1;
-
-  m_cy = newY;
-
-  // Convert screen X to buffer X (accounting for gutter and visual width)
-  int gutterWidth = m_display.GetGutterWidth();
-  int visualX = screenX - gutterWidth + m_display.GetColOff();
-  if (visualX < 0)
-    visualX = 0;
-
-  // Translate visual X to byte X
-  const std::string &line = m_buffer.GetLine(m_cy);
-  size_t byteX = 0;
-  int currentVisual = 0;
-  while (byteX < line.size() && currentVisual < visualX) {
-    size_t nextByte = TextUtils::NextCharIdx(line, byteX);
-    std::string charStr = line.substr(byteX, nextByte - byteX);
-    currentVisual += TextUtils::VisualWidth(charStr);
-    byteX = nextByte;
-  }
-  m_cx = (int)byteX;
+  // Convert screen Y to buffer Y, stepping over folds
+  m_cy = m_display.LineAtRow(screenY, m_buffer.LineCount());
+  m_cursors.clear();
+
+  // Convert screen X to buffer X (gutter, scrolling and table layout)
+  m_cx = (int)m_display.ByteAtX(m_buffer.GetLine(m_cy), screenX);
+
+  // A press starts a (so far empty) selection that dragging extends
+  m_selecting = true;
+  m_anchor = {m_cy, m_cx};
+}
+
+void Editor::HandleMouseDrag(int screenY, int screenX) {
+  if (!m_selecting)
+    return;
+  Buffer::Position anchor = m_anchor;
+  HandleMouseClick(screenY, screenX);
+  m_anchor = anchor;
+
+  // Dragging onto the top row or past the bottom one reaches a line
+  // beyond the view, which then scrolls to follow
+  int step = screenY <= 0 ? -1 : screenY >= m_display.Rows() - 1 ? 1 : 0;
+  if (step == 0)
+    return;
+  m_cy = step < 0 ? m_folds.Up(m_cy, 1)
+                  : m_folds.Down(m_cy, 1, m_buffer.LineCount());
+  m_cx = (int)m_display.ByteAtX(m_buffer.GetLine(m_cy), screenX);
 }
@@ -0,0 +1,84 @@
+/**
+ * @file filetext.cpp
+ * @brief FileText implementation: mapping or inflating a file and splitting
+ * its lines.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/filetext.hpp"
+#include "../include/compression.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileText::FileText(const std::string &path,
+                   std::shared_ptr<const Buffer::TextPieces> inflated)
+    : m_inflated(std::move(inflated)), m_map(nullptr), m_mapSize(0),
+      m_size(0), m_last(0) {
+  if (m_inflated) {
+    for (const Buffer::TextPiece &piece : *m_inflated)
+      Add(piece.bytes.get(), piece.size);
+    return;
+  }
+  if (Compression::InflateFile(path, m_text)) {
+    Add(m_text.data(), m_text.size());
+    return;
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+                     0);
+    if (map != MAP_FAILED) {
+      m_map = map;
+      m_mapSize = (size_t)st.st_size;
+      Add(static_cast<const char *>(map), m_mapSize);
+    }
+  }
+  close(fd);
+}
+
+FileText::~FileText() {
+  if (m_map)
+    munmap(m_map, m_mapSize);
+}
+
+void FileText::Add(const char *data, size_t size) {
+  if (size == 0)
+    return;
+  m_pieces.push_back({data, m_size, size});
+  m_size += size;
+}
+
+std::string_view FileText::Line(size_t &pos) const {
+  if (pos >= m_size) {
+    pos = m_size + 1;
+    return {};
+  }
+  if (pos < m_pieces[m_last].start ||
+      pos >= m_pieces[m_last].start + m_pieces[m_last].size) {
+    auto it = std::upper_bound(
+        m_pieces.begin(), m_pieces.end(), pos,
+        [](size_t at, const Piece &piece) { return at < piece.start; });
+    m_last = (size_t)(it - m_pieces.begin()) - 1;
+  }
+
+  const Piece &piece = m_pieces[m_last];
+  const char *data = piece.data;
+  size_t at = pos - piece.start;
+  const void *hit = memchr(data + at, '\n', piece.size - at);
+  size_t nl =
+      hit ? (size_t)(static_cast<const char *>(hit) - data) : piece.size;
+  size_t len = nl - at;
+  if (hit && len > 0 && data[nl - 1] == '\r')
+    len--;
+  // Pieces end at line boundaries; only the last may lack its "\n"
+  pos = piece.start + nl + (hit || m_last + 1 == m_pieces.size() ? 1 : 0);
+  return std::string_view(data + at, len);
+}
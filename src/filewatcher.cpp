@@ -0,0 +1,74 @@
+/**
+ * @file filewatcher.cpp
+ * @brief FileWatcher implementation on top of inotify.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/filewatcher.hpp"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+FileWatcher::FileWatcher() : m_fd(-1), m_wd(-1) {
+#ifdef __linux__
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+void FileWatcher::Watch(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+  if (dir.empty())
+    dir = "/";
+  m_name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+#ifdef __linux__
+  if (m_fd < 0)
+    return;
+  if (m_wd >= 0)
+    inotify_rm_watch(m_fd, m_wd);
+  m_wd = inotify_add_watch(m_fd, dir.c_str(),
+                           IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                               IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+                               IN_DELETE);
+#endif
+}
+
+bool FileWatcher::Poll() {
+#ifdef __linux__
+  if (m_fd < 0 || m_wd < 0)
+    return true;
+
+  bool hit = false;
+  alignas(struct inotify_event) char events[4096];
+  for (;;) {
+    ssize_t n = read(m_fd, events, sizeof(events));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // EAGAIN: queue drained
+
+    for (char *p = events; p < events + n;) {
+      const struct inotify_event *ev =
+          reinterpret_cast<const struct inotify_event *>(p);
+      if (ev->mask & IN_Q_OVERFLOW)
+        hit = true;
+      else if (ev->len > 0 && m_name == ev->name)
+        hit = true;
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+  return hit;
+#else
+  return true;
+#endif
+}
@@ -0,0 +1,95 @@
+/**
+ * @file folds.cpp
+ * @brief FoldSet implementation.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/folds.hpp"
+#include <algorithm>
+
+void FoldSet::Add(int first, int last) {
+  if (last <= first)
+    return;
+  auto begin = std::lower_bound(
+      m_folds.begin(), m_folds.end(), first,
+      [](const Fold &f, int y) { return f.first < y; });
+  auto end = begin;
+  for (; end != m_folds.end() && end->first <= last; ++end)
+    last = std::max(last, end->last);
+  begin = m_folds.erase(begin, end);
+  m_folds.insert(begin, {first, last});
+}
+
+bool FoldSet::Remove(int y) {
+  int i = At(y);
+  if (i < 0 || y > m_folds[i].last)
+    return false;
+  m_folds.erase(m_folds.begin() + i);
+  return true;
+}
+
+const FoldSet::Fold *FoldSet::Find(int y) const {
+  int i = At(y);
+  return i >= 0 && m_folds[i].first == y ? &m_folds[i] : nullptr;
+}
+
+int FoldSet::Header(int y) const {
+  int i = At(y);
+  return i >= 0 && y <= m_folds[i].last ? m_folds[i].first : y;
+}
+
+int FoldSet::Down(int y, int n, int lineCount) const {
+  for (; n > 0; --n) {
+    const Fold *fold = Find(y);
+    int next = fold ? fold->last + 1 : y + 1;
+    if (next >= lineCount)
+      break;
+    y = next;
+  }
+  return y;
+}
+
+int FoldSet::Up(int y, int n) const {
+  for (; n > 0 && y > 0; --n)
+    y = Header(y - 1);
+  return y;
+}
+
+int FoldSet::Rows(int from, int to) const {
+  if (to <= from)
+    return 0;
+  int rows = to - from;
+  for (size_t i = (size_t)std::max(At(from), 0);
+       i < m_folds.size() && m_folds[i].first < to; ++i) {
+    int lo = std::max(m_folds[i].first + 1, from);
+    int hi = std::min(m_folds[i].last + 1, to);
+    if (hi > lo)
+      rows -= hi - lo;
+  }
+  return rows;
+}
+
+void FoldSet::Edited(const Buffer::LineEdit &edit) {
+  int lo = edit.first;
+  int hi = edit.first + edit.removed;
+  int delta = edit.added - edit.removed;
+  bool inPlace = edit.removed == 1 && edit.added == 1;
+
+  std::vector<Fold> kept;
+  for (Fold f : m_folds) {
+    if (f.last < lo || (inPlace && lo == f.first)) {
+      kept.push_back(f); // Above the edit, or the header retyped
+    } else if (f.first >= hi) {
+      kept.push_back({f.first + delta, f.last + delta});
+    }
+    // Otherwise the edit reaches into the fold: open it
+  }
+  m_folds.swap(kept);
+}
+
+int FoldSet::At(int y) const {
+  auto it = std::upper_bound(
+      m_folds.begin(), m_folds.end(), y,
+      [](int row, const Fold &f) { return row < f.first; });
+  return (int)(it - m_folds.begin()) - 1;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file hexeditor.cpp
+ * @brief HexEditor implementation - hex view loop and input dispatch.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/hexeditor.hpp"
+#include "../include/input.hpp"
+#include <algorithm>
+#include <signal.h>
+
+extern volatile sig_atomic_t g_signalStatus;
+
+HexEditor::HexEditor()
+    : m_cursor(0), m_asciiPane(false), m_lowNibble(false), m_running(false) {}
+
+void HexEditor::Run(const std::string &path) {
+  m_file.Open(path);
+  m_display.SetMessage("Binary file - hex view (Tab: ASCII column)");
+  m_running = true;
+
+  while (m_running) {
+    if (g_signalStatus != 0) {
+      try {
+        m_file.Save();
+      } catch (...) {
+        // Best effort save
+      }
+      break;
+    }
+
+    m_display.ScrollHex(m_file, m_cursor);
+    m_display.RenderHex(m_file, m_cursor, m_asciiPane, m_lowNibble);
+    ProcessKey();
+  }
+}
+
+void HexEditor::ProcessKey() {
+  Edit::Key key = Input::ReadKey();
+  if (key.type != Edit::K_UNKNOWN)
+    m_display.SetMessage("");
+
+  switch (key.type) {
+  case Edit::K_ESC:
+  case Edit::K_QUIT:
+    // Auto-save on quit; exceptions propagate to main for reporting
+    m_file.Save();
+    m_running = false;
+    break;
+
+  case Edit::K_CHAR:
+    if (key.value == '\t') {
+      m_asciiPane = !m_asciiPane;
+      m_lowNibble = false;
+    } else {
+      Type(key.value);
+    }
+    break;
+
+  case Edit::K_UNDO: {
+    uint64_t offset;
+    if (m_file.Undo(offset)) {
+      m_cursor = offset;
+      m_lowNibble = false;
+    } else {
+      m_display.SetMessage("Nothing to undo");
+    }
+    break;
+  }
+
+  case Edit::K_BACKSPACE:
+    Move(Edit::K_ARROW_LEFT);
+    break;
+
+  case Edit::K_ARROW_UP:
+  case Edit::K_ARROW_DOWN:
+  case Edit::K_ARROW_LEFT:
+  case Edit::K_ARROW_RIGHT:
+  case Edit::K_HOME:
+  case Edit::K_END:
+  case Edit::K_PAGE_UP:
+  case Edit::K_PAGE_DOWN:
+    Move(key.type);
+    break;
+
+  default:
+    break;
+  }
+}
+
+void HexEditor::Move(int keyType) {
+  uint64_t size = m_file.Size();
+  if (size == 0)
+    return;
+  uint64_t columns = (uint64_t)m_display.HexColumns();
+  uint64_t page = columns * (uint64_t)std::max(1, m_display.Rows() - 1);
+  uint64_t last = size - 1;
+
+  switch (keyType) {
+  case Edit::K_ARROW_LEFT:
+    if (m_cursor > 0)
+      m_cursor--;
+    break;
+  case Edit::K_ARROW_RIGHT:
+    m_cursor = std::min(m_cursor + 1, last);
+    break;
+  case Edit::K_ARROW_UP:
+    if (m_cursor >= columns)
+      m_cursor -= columns;
+    break;
+  case Edit::K_ARROW_DOWN:
+    if (last - m_cursor >= columns)
+      m_cursor += columns;
+    break;
+  case Edit::K_PAGE_UP:
+    m_cursor -= std::min(m_cursor / columns, page / columns) * columns;
+    break;
+  case Edit::K_PAGE_DOWN:
+    m_cursor = last - m_cursor >= page ? m_cursor + page : last;
+    break;
+  case Edit::K_HOME:
+    m_cursor -= m_cursor % columns;
+    break;
+  case Edit::K_END:
+    m_cursor = std::min(m_cursor - m_cursor % columns + columns - 1, last);
+    break;
+  }
+  m_lowNibble = false;
+}
+
+void HexEditor::Type(int c) {
+  if (m_file.Size() == 0)
+    return;
+  uint8_t byte;
+  m_file.Read(m_cursor, &byte, 1);
+
+  if (m_asciiPane) {
+    if (c < 32 || c >= 127)
+      return;
+    m_file.Set(m_cursor, (uint8_t)c);
+    Move(Edit::K_ARROW_RIGHT);
+    return;
+  }
+
+  int digit = c >= '0' && c <= '9'   ? c - '0'
+              : c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                     : -1;
+  if (digit < 0) {
+    m_display.SetMessage("Type hex digits (Tab: ASCII column)");
+    return;
+  }
+  if (!m_lowNibble) {
+    m_file.Set(m_cursor, (uint8_t)(digit << 4 | (byte & 0x0F)));
+    m_lowNibble = true;
+  } else {
+    m_file.Set(m_cursor, (uint8_t)((byte & 0xF0) | digit));
+    Move(Edit::K_ARROW_RIGHT);
+  }
+}
@@ -0,0 +1,158 @@
+/**
+ * @file hexfile.cpp
+ * @brief HexFile implementation.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/hexfile.hpp"
+#include "../include/constants.hpp"
+#include "../include/textutils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+HexFile::HexFile() : m_fd(-1), m_map(nullptr), m_size(0) {}
+
+HexFile::~HexFile() { Close(); }
+
+void HexFile::Close() {
+  if (m_map)
+    munmap(const_cast<uint8_t *>(m_map), m_size);
+  if (m_fd >= 0)
+    close(m_fd);
+  m_map = nullptr;
+  m_fd = -1;
+  m_size = 0;
+}
+
+bool HexFile::LooksBinary(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  std::string sample(Edit::BINARY_SAMPLE_BYTES, '\0');
+  ssize_t n;
+  do {
+    n = pread(fd, &sample[0], sample.size(), 0);
+  } while (n < 0 && errno == EINTR);
+  close(fd);
+  if (n <= 0)
+    return false;
+  sample.resize((size_t)n);
+  return TextUtils::LooksBinary(sample);
+}
+
+void HexFile::Open(const std::string &path) {
+  Close();
+  m_patches.clear();
+  m_undo.clear();
+  m_filename = path;
+
+  // Read-only files still open; Save reports it
+  m_fd = open(path.c_str(), O_RDWR);
+  if (m_fd < 0)
+    m_fd = open(path.c_str(), O_RDONLY);
+  if (m_fd < 0)
+    throw std::runtime_error("Cannot open " + path + ": " + strerror(errno));
+
+  struct stat st;
+  if (fstat(m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    Close();
+    throw std::runtime_error("Not a regular file: " + path);
+  }
+  m_size = (uint64_t)st.st_size;
+  if (m_size == 0)
+    return;
+
+  void *map = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (map == MAP_FAILED) {
+    int error = errno;
+    Close();
+    throw std::runtime_error("Cannot map " + path + ": " + strerror(error));
+  }
+  m_map = static_cast<const uint8_t *>(map);
+  madvise(map, m_size, MADV_RANDOM); // Only the visible pages are touched
+}
+
+size_t HexFile::Read(uint64_t offset, uint8_t *out, size_t n) const {
+  if (offset >= m_size)
+    return 0;
+  n = (size_t)std::min<uint64_t>(n, m_size - offset);
+  memcpy(out, m_map + offset, n);
+  for (auto it = m_patches.lower_bound(offset);
+       it != m_patches.end() && it->first < offset + n; ++it)
+    out[it->first - offset] = it->second;
+  return n;
+}
+
+bool HexFile::IsPatched(uint64_t offset) const {
+  return m_patches.count(offset) > 0;
+}
+
+void HexFile::Set(uint64_t offset, uint8_t byte) {
+  if (offset >= m_size)
+    return;
+  auto it = m_patches.find(offset);
+  bool patched = it != m_patches.end();
+  uint8_t current = patched ? it->second : m_map[offset];
+  if (byte == current)
+    return;
+
+  m_undo.push_back({offset, patched, patched ? it->second : (uint8_t)0});
+  if (byte == m_map[offset])
+    m_patches.erase(offset); // Back to what the file holds
+  else
+    m_patches[offset] = byte;
+}
+
+bool HexFile::Undo(uint64_t &offset) {
+  if (m_undo.empty())
+    return false;
+  Change change = m_undo.back();
+  m_undo.pop_back();
+  if (change.patched)
+    m_patches[change.offset] = change.value;
+  else
+    m_patches.erase(change.offset);
+  offset = change.offset;
+  return true;
+}
+
+size_t HexFile::Save() {
+  if (m_patches.empty())
+    return 0;
+  if ((fcntl(m_fd, F_GETFL) & O_ACCMODE) == O_RDONLY)
+    throw std::runtime_error("File is read-only");
+
+  const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  std::vector<uint8_t> bytes;
+  size_t pages = 0;
+  for (auto it = m_patches.begin(); it != m_patches.end();) {
+    uint64_t start = it->first / page * page;
+    bytes.resize((size_t)std::min(page, m_size - start));
+    Read(start, bytes.data(), bytes.size());
+    for (size_t done = 0; done < bytes.size();) {
+      ssize_t n = pwrite(m_fd, bytes.data() + done, bytes.size() - done,
+                         (off_t)(start + done));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        throw std::runtime_error("Write failed: " +
+                                 std::string(strerror(errno)));
+      done += (size_t)n;
+    }
+    pages++;
+    it = m_patches.lower_bound(start + page);
+  }
+
+  if (fsync(m_fd) != 0)
+    throw std::runtime_error("Disk sync failed: " +
+                             std::string(strerror(errno)));
+  m_patches.clear();
+  m_undo.clear(); // The journal was relative to the old file bytes
+  return pages;
+}
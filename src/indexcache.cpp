@@ -0,0 +1,242 @@
+/**
+ * @file indexcache.cpp
+ * @brief IndexCache implementation: sidecar layout, lookup and storage.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/indexcache.hpp"
+#include "../include/constants.hpp"
+#include "../include/textutils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+namespace {
+const char MAGIC[8] = {'E', 'D', 'I', 'T', 'I', 'D', 'X', '1'};
+const uint32_t VERSION = 1;
+
+// Bytes before the indexed end that must be unchanged for an append match
+const size_t TAIL_BYTES = 4096;
+
+/// On-disk header; followed by the path (padded to 8) and the checkpoints.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t pathLength;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtimeNs;
+  uint64_t lineCount;
+  uint64_t longestLine;
+  uint64_t nonAscii;
+  uint64_t valid;
+  uint64_t invalid;
+  uint64_t tailHash;
+  uint64_t checkpointCount;
+  uint32_t checkpointLines;
+  uint8_t firstTerm;
+  uint8_t finalNewline;
+  uint8_t reserved[2];
+};
+static_assert(std::is_trivially_copyable<Header>::value, "raw I/O");
+static_assert(sizeof(Header) % 8 == 0, "checkpoints must stay aligned");
+
+size_t Padded(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/// Sidecar file name: hash of the canonical path, in hex.
+std::string SidecarPath(const std::string &canonical) {
+  return IndexCache::EntryPath(canonical, "index", ".idx");
+}
+} // namespace
+
+IndexCache::IndexCache()
+    : m_map(nullptr), m_mapSize(0), m_checkpoints(nullptr), m_count(0) {}
+
+IndexCache::~IndexCache() {
+  if (m_map)
+    munmap(m_map, m_mapSize);
+}
+
+bool IndexCache::Enabled(uint64_t size) {
+  const char *off = getenv("EDIT_NO_INDEX_CACHE");
+  if (off && off[0] != '\0' && off[0] != '0')
+    return false;
+  return size >= Edit::INDEX_CACHE_MIN_BYTES;
+}
+
+std::string IndexCache::Canonical(const std::string &path) {
+  char resolved[PATH_MAX];
+  if (realpath(path.c_str(), resolved))
+    return resolved;
+  return path;
+}
+
+std::string IndexCache::EntryPath(const std::string &canonical,
+                                  const char *kind, const char *extension) {
+  std::string dir;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (xdg && xdg[0] == '/')
+    dir = std::string(xdg) + "/edit/" + kind;
+  else if (home && home[0] == '/')
+    dir = std::string(home) + "/.cache/edit/" + kind;
+  else
+    return "";
+
+  uint64_t h = TextUtils::Hash(canonical);
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx", (unsigned long long)h);
+  return dir + name + extension;
+}
+
+bool IndexCache::MakeDirs(const std::string &dir) {
+  for (size_t i = 1; i <= dir.size(); ++i) {
+    if (i == dir.size() || dir[i] == '/') {
+      std::string part = dir.substr(0, i);
+      if (mkdir(part.c_str(), 0700) != 0 && errno != EEXIST)
+        return false;
+    }
+  }
+  return true;
+}
+
+IndexCache::Match IndexCache::Open(const std::string &path,
+                                   const Buffer::DiskState &disk, int fd) {
+  std::string canonical = Canonical(path);
+  std::string side = SidecarPath(canonical);
+  if (side.empty())
+    return Match::None;
+
+  int sfd = open(side.c_str(), O_RDONLY);
+  if (sfd < 0)
+    return Match::None;
+
+  struct stat st;
+  if (fstat(sfd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+    close(sfd);
+    return Match::None;
+  }
+  m_mapSize = (size_t)st.st_size;
+  m_map = mmap(nullptr, m_mapSize, PROT_READ, MAP_PRIVATE, sfd, 0);
+  close(sfd);
+  if (m_map == MAP_FAILED) {
+    m_map = nullptr;
+    return Match::None;
+  }
+
+  auto reject = [this] {
+    munmap(m_map, m_mapSize);
+    m_map = nullptr;
+    m_checkpoints = nullptr;
+    m_count = 0;
+    return Match::None;
+  };
+
+  const char *base = static_cast<const char *>(m_map);
+  Header h;
+  memcpy(&h, base, sizeof(h));
+  size_t pathBytes = Padded(h.pathLength);
+  if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION ||
+      h.checkpointLines != Edit::CHECKPOINT_LINES ||
+      h.pathLength != canonical.size() ||
+      m_mapSize != sizeof(Header) + pathBytes + h.checkpointCount * 8 ||
+      memcmp(base + sizeof(Header), canonical.data(), canonical.size()) != 0)
+    return reject();
+
+  if (h.dev != disk.dev || h.ino != disk.ino || h.size > disk.size ||
+      h.checkpointCount == 0)
+    return reject();
+
+  m_summary.size = h.size;
+  m_summary.lineCount = h.lineCount;
+  m_summary.longestLine = h.longestLine;
+  m_summary.utf8.nonAscii = h.nonAscii;
+  m_summary.utf8.valid = h.valid;
+  m_summary.utf8.invalid = h.invalid;
+  m_summary.firstTerm = h.firstTerm;
+  m_summary.finalNewline = h.finalNewline != 0;
+  m_checkpoints =
+      reinterpret_cast<const uint64_t *>(base + sizeof(Header) + pathBytes);
+  m_count = (size_t)h.checkpointCount;
+
+  if (h.size == disk.size && h.mtimeNs == disk.mtimeNs)
+    return Match::Exact;
+  if (h.size == disk.size)
+    return reject();
+
+  // Grew: trust the old prefix only if the bytes before its end still match
+  size_t window = (size_t)std::min<uint64_t>(TAIL_BYTES, h.size);
+  std::string tail(window, '\0');
+  if (window > 0 &&
+      pread(fd, &tail[0], window, (off_t)(h.size - window)) != (ssize_t)window)
+    return reject();
+  if (TextUtils::Hash(tail) != h.tailHash)
+    return reject();
+  return Match::Appended;
+}
+
+void IndexCache::Store(const std::string &path, const Buffer::DiskState &disk,
+                       const Summary &summary,
+                       const std::vector<uint64_t> &checkpoints, int fd) {
+  std::string canonical = Canonical(path);
+  std::string side = SidecarPath(canonical);
+  if (side.empty() || !MakeDirs(side.substr(0, side.find_last_of('/'))))
+    return;
+
+  Header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.pathLength = (uint32_t)canonical.size();
+  h.dev = disk.dev;
+  h.ino = disk.ino;
+  h.size = summary.size;
+  h.mtimeNs = disk.mtimeNs;
+  h.lineCount = summary.lineCount;
+  h.longestLine = summary.longestLine;
+  h.nonAscii = summary.utf8.nonAscii;
+  h.valid = summary.utf8.valid;
+  h.invalid = summary.utf8.invalid;
+  size_t window = (size_t)std::min<uint64_t>(TAIL_BYTES, summary.size);
+  std::string tail(window, '\0');
+  if (window > 0 && pread(fd, &tail[0], window,
+                          (off_t)(summary.size - window)) != (ssize_t)window)
+    return;
+  h.tailHash = TextUtils::Hash(tail);
+  h.checkpointCount = checkpoints.size();
+  h.checkpointLines = Edit::CHECKPOINT_LINES;
+  h.firstTerm = (uint8_t)summary.firstTerm;
+  h.finalNewline = summary.finalNewline ? 1 : 0;
+
+  std::string bytes(reinterpret_cast<const char *>(&h), sizeof(h));
+  bytes += canonical;
+  bytes.resize(sizeof(h) + Padded(canonical.size()), '\0');
+  bytes.append(reinterpret_cast<const char *>(checkpoints.data()),
+               checkpoints.size() * sizeof(uint64_t));
+
+  // Same temp + rename dance as Buffer::Save, minus the fsync: a lost
+  // sidecar only costs a rescan.
+  std::string temp = side + Edit::TEMP_EXTENSION;
+  int out = open(temp.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+  if (out < 0)
+    return;
+  bool ok = write(out, bytes.data(), bytes.size()) == (ssize_t)bytes.size();
+  ok = close(out) == 0 && ok;
+  if (!ok || rename(temp.c_str(), side.c_str()) != 0)
+    unlink(temp.c_str());
+}
+
+void IndexCache::Discard(const std::string &path) {
+  std::string side = SidecarPath(Canonical(path));
+  if (!side.empty())
+    unlink(side.c_str());
+}
@@ -9,18 +9,90 @@
 #endif
 
 #include "../include/input.hpp"
+#include "../include/constants.hpp"
 #include <ncurses.h>
 
 // Control Key Macro: (k & 0x1f)
 #define CTRL_KEY(k) ((k) & 0x1f)
 
+namespace {
+/// Code ncurses gave a terminfo extended key (e.g. "kLFT5"), or -1.
+int ExtendedKey(const char *name) {
+  const char *seq = tigetstr(name);
+  if (seq == nullptr || seq == (char *)-1)
+    return -1;
+  int code = key_defined(seq);
+  return code > 0 ? code : -1;
+}
+/// Rows a wheel event scrolls (negative: up), or 0 for other events.
+int WheelRows(mmask_t state) {
+  if (state & BUTTON4_PRESSED)
+    return -Edit::WHEEL_ROWS;
+  if (state & BUTTON5_PRESSED)
+    return Edit::WHEEL_ROWS;
+  return 0;
+}
+
+/// Rows of the wheel events already queued behind the one just read. The
+/// first other input is pushed back for the next ReadKey.
+int QueuedWheelRows() {
+  int rows = 0;
+  int delay = wgetdelay(stdscr);
+  nodelay(stdscr, TRUE);
+  for (;;) {
+    wint_t ch;
+    int ret = get_wch(&ch);
+    if (ret == ERR)
+      break;
+    if (ret == OK) {
+      unget_wch((wchar_t)ch);
+      break;
+    }
+    if (ch != KEY_MOUSE) {
+      ungetch((int)ch);
+      break;
+    }
+    MEVENT event;
+    if (getmouse(&event) != OK)
+      continue;
+    if (int wheel = WheelRows(event.bstate)) {
+      rows += wheel;
+      continue;
+    }
+    ungetmouse(&event);
+    break;
+  }
+  wtimeout(stdscr, delay);
+  return rows;
+}
+} // namespace
+
 Edit::Key Input::ReadKey() {
   wint_t ch;
   int ret = get_wch(&ch);
 
-  Edit::Key key = {Edit::K_UNKNOWN, 0, 0, 0};
+  Edit::Key key = {Edit::K_UNKNOWN, 0, 0, 0, false};
+
+  // Ctrl-arrows have no fixed KEY_ codes: terminfo names them kLFT5 and
+  // kRIT5 (kLFT6 and kRIT6 with Shift)
+  static const int ctrlLeft = ExtendedKey("kLFT5");
+  static const int ctrlRight = ExtendedKey("kRIT5");
+  static const int ctrlShiftLeft = ExtendedKey("kLFT6");
+  static const int ctrlShiftRight = ExtendedKey("kRIT6");
 
   if (ret == KEY_CODE_YES) {
+    int code = (int)ch;
+    if (code == ctrlLeft || code == ctrlShiftLeft) {
+      key.type = Edit::K_WORD_LEFT;
+      key.shift = code == ctrlShiftLeft;
+      return key;
+    }
+    if (code == ctrlRight || code == ctrlShiftRight) {
+      key.type = Edit::K_WORD_RIGHT;
+      key.shift = code == ctrlShiftRight;
+      return key;
+    }
+
     // Handle special keys
     switch (ch) {
     case KEY_UP:
@@ -53,10 +125,51 @@ Edit::Key Input::ReadKey() {
     case KEY_BACKSPACE:
       key.type = Edit::K_BACKSPACE;
       break;
+    case KEY_SR: // Shift-Up
+      key.type = Edit::K_ARROW_UP;
+      key.shift = true;
+      break;
+    case KEY_SF: // Shift-Down
+      key.type = Edit::K_ARROW_DOWN;
+      key.shift = true;
+      break;
+    case KEY_SLEFT:
+      key.type = Edit::K_ARROW_LEFT;
+      key.shift = true;
+      break;
+    case KEY_SRIGHT:
+      key.type = Edit::K_ARROW_RIGHT;
+      key.shift = true;
+      break;
+    case KEY_SHOME:
+      key.type = Edit::K_HOME;
+      key.shift = true;
+      break;
+    case KEY_SEND:
+      key.type = Edit::K_END;
+      key.shift = true;
+      break;
+    case KEY_SPREVIOUS:
+      key.type = Edit::K_PAGE_UP;
+      key.shift = true;
+      break;
+    case KEY_SNEXT:
+      key.type = Edit::K_PAGE_DOWN;
+      key.shift = true;
+      break;
     case KEY_MOUSE: {
       MEVENT event;
       if (getmouse(&event) == OK) {
-        key.type = Edit::K_MOUSE;
+        if (int wheel = WheelRows(event.bstate)) {
+          key.type = Edit::K_WHEEL;
+          key.value = wheel + QueuedWheelRows();
+        } else if (event.bstate & BUTTON1_PRESSED) {
+          key.type = Edit::K_MOUSE;
+        } else if (event.bstate & (REPORT_MOUSE_POSITION | BUTTON1_RELEASED)) {
+          key.type = Edit::K_MOUSE_DRAG;
+        } else {
+          break;
+        }
         key.mouseY = event.y;
         key.mouseX = event.x;
       }
@@ -75,9 +188,62 @@ Edit::Key Input::ReadKey() {
       key.type = Edit::K_ENTER;
       break;
     case CTRL_KEY('q'):
-    case 27:
       key.type = Edit::K_QUIT;
       break;
+    case 27:
+      key.type = Edit::K_ESC;
+      break;
+    case CTRL_KEY('t'):
+      key.type = Edit::K_FOLLOW;
+      break;
+    case CTRL_KEY('c'):
+      key.type = Edit::K_COPY;
+      break;
+    case CTRL_KEY('x'):
+      key.type = Edit::K_CUT;
+      break;
+    case CTRL_KEY('v'):
+      key.type = Edit::K_PASTE;
+      break;
+    case CTRL_KEY('z'):
+      key.type = Edit::K_UNDO;
+      break;
+    case CTRL_KEY('y'):
+      key.type = Edit::K_REDO;
+      break;
+    case CTRL_KEY('n'):
+      key.type = Edit::K_ADD_CURSOR;
+      break;
+    case CTRL_KEY('d'):
+      key.type = Edit::K_MATCHES;
+      break;
+    case CTRL_KEY('l'):
+      key.type = Edit::K_COLUMN;
+      break;
+    case CTRL_KEY('g'):
+      key.type = Edit::K_NEXT_CHANGE;
+      break;
+    case CTRL_KEY('b'):
+      key.type = Edit::K_BRACKET;
+      break;
+    case CTRL_KEY('k'):
+      key.type = Edit::K_FOLD;
+      break;
+    case CTRL_KEY('p'):
+      key.type = Edit::K_COMPLETE;
+      break;
+    case CTRL_KEY('o'):
+      key.type = Edit::K_LINES;
+      break;
+    case CTRL_KEY('r'):
+      key.type = Edit::K_MEMORY;
+      break;
+    case CTRL_KEY('e'):
+      key.type = Edit::K_TABLE;
+      break;
+    case CTRL_KEY('f'):
+      key.type = Edit::K_FIND;
+      break;
     default:
       if (ch >= 32 || ch == '\t') { // Allow proper Unicode code points
         key.type = Edit::K_CHAR;
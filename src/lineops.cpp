@@ -0,0 +1,313 @@
+/**
+ * @file lineops.cpp
+ * @brief LineOps implementation: parallel index sort with spilling, and
+ * the per-operation plans.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/lineops.hpp"
+#include "../include/textutils.hpp"
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+// Lines per task: sort runs, merge pieces and key/filter chunks
+const size_t TASK_LINES = 64 * 1024;
+
+// Indices read back per spilled run at a time while merging
+const size_t SPILL_READ = 4096;
+
+/// fn(begin, end) over [0, n) in TASK_LINES spans, in parallel.
+template <typename F> void ForEachSpan(ThreadPool *pool, size_t n, F fn) {
+  ForEachChunk(pool, (n + TASK_LINES - 1) / TASK_LINES, [&](size_t c) {
+    fn(c * TASK_LINES, std::min(n, (c + 1) * TASK_LINES));
+  });
+}
+
+/// Leading number of a line after blanks, as sort -n reads it; 0 if none.
+double LeadingNumber(std::string_view s) {
+  size_t i = 0;
+  while (i < s.size() && (s[i] == ' ' || s[i] == '\t'))
+    i++;
+  bool negative = false;
+  if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+  double value = 0;
+  for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i)
+    value = value * 10 + (s[i] - '0');
+  if (i < s.size() && s[i] == '.') {
+    double scale = 0.1;
+    for (++i; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i) {
+      value += (s[i] - '0') * scale;
+      scale /= 10;
+    }
+  }
+  return negative ? -value : value;
+}
+
+/// A line index with the key it sorts by, so comparisons mostly stay in
+/// one contiguous array instead of chasing line references.
+template <typename Key> struct Keyed {
+  Key key;
+  uint32_t index;
+};
+
+/// First 8 bytes of a line, big-endian and zero-padded: ordered like the
+/// lines themselves wherever two prefixes differ.
+uint64_t Prefix(std::string_view s) {
+  uint64_t key = 0;
+  for (size_t i = 0; i < 8; ++i)
+    key = key << 8 | (i < s.size() ? (unsigned char)s[i] : 0);
+  return key;
+}
+
+/// How many of the first d merged elements of a and b come from a.
+template <typename T, typename Less>
+size_t CoRank(size_t d, const T *a, size_t na, const T *b, size_t nb,
+              Less &less) {
+  size_t lo = d > nb ? d - nb : 0;
+  size_t hi = std::min(d, na);
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    if (less(a[i], b[d - i - 1]))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+/**
+ * Sort items with less, a strict total order (ties broken by index, so the
+ * result is stable). Runs are sorted in place in parallel; then either
+ * merged pairwise through a scratch array, each merge split into
+ * independent pieces, or, when that array would not fit the budget,
+ * written to a temporary file and merged back into items.
+ */
+template <typename T, typename Less>
+void SortItems(std::vector<T> &items, Less less, ThreadPool *pool,
+               size_t memoryBudget) {
+  size_t n = items.size();
+  bool spill = n * 2 * sizeof(T) > memoryBudget;
+  size_t workers = pool ? pool->Size() + 1 : 1;
+  size_t run = spill ? std::max(TASK_LINES, (n + workers - 1) / workers)
+                     : TASK_LINES;
+  size_t runs = (n + run - 1) / run;
+  ForEachChunk(pool, runs, [&](size_t r) {
+    std::sort(items.begin() + r * run,
+              items.begin() + std::min(n, (r + 1) * run), less);
+  });
+  if (runs <= 1)
+    return;
+
+  if (!spill) {
+    std::vector<T> scratch(n);
+    for (size_t width = run; width < n; width *= 2) {
+      size_t pairs = (n + 2 * width - 1) / (2 * width);
+      size_t pieces = (2 * width + TASK_LINES - 1) / TASK_LINES;
+      ForEachChunk(pool, pairs * pieces, [&](size_t t) {
+        size_t lo = t / pieces * 2 * width;
+        size_t mid = std::min(n, lo + width);
+        size_t hi = std::min(n, lo + 2 * width);
+        size_t d0 = std::min(hi - lo, t % pieces * TASK_LINES);
+        size_t d1 = std::min(hi - lo, d0 + TASK_LINES);
+        if (d0 == d1)
+          return;
+        const T *a = items.data() + lo;
+        const T *b = items.data() + mid;
+        size_t i0 = CoRank(d0, a, mid - lo, b, hi - mid, less);
+        size_t i1 = CoRank(d1, a, mid - lo, b, hi - mid, less);
+        std::merge(a + i0, a + i1, b + (d0 - i0), b + (d1 - i1),
+                   scratch.begin() + lo + d0, less);
+      });
+      items.swap(scratch);
+    }
+    return;
+  }
+
+  auto fail = [](const char *what) {
+    throw std::runtime_error(std::string("Sort spill ") + what +
+                             " failed: " + strerror(errno));
+  };
+  std::unique_ptr<FILE, int (*)(FILE *)> file(tmpfile(), fclose);
+  if (!file)
+    fail("file");
+  if (fwrite(items.data(), sizeof(T), n, file.get()) != n ||
+      fflush(file.get()) != 0)
+    fail("write");
+
+  // k-way merge: each run reads its next SPILL_READ items on demand
+  struct Cursor {
+    size_t next, end; // File positions (in items) still to read
+    std::vector<T> buf;
+    size_t at;
+  };
+  std::vector<Cursor> cursors(runs);
+  auto refill = [&](Cursor &c) {
+    size_t want = std::min(SPILL_READ, c.end - c.next);
+    c.buf.resize(want);
+    c.at = 0;
+    if (want == 0)
+      return;
+    if (fseeko(file.get(), (off_t)(c.next * sizeof(T)), SEEK_SET) != 0 ||
+        fread(c.buf.data(), sizeof(T), want, file.get()) != want)
+      fail("read");
+    c.next += want;
+  };
+  auto later = [&](size_t x, size_t y) {
+    return less(cursors[y].buf[cursors[y].at], cursors[x].buf[cursors[x].at]);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(
+      later);
+  for (size_t r = 0; r < runs; ++r) {
+    cursors[r] = {r * run, std::min(n, (r + 1) * run), {}, 0};
+    refill(cursors[r]);
+    heap.push(r);
+  }
+  for (size_t out = 0; !heap.empty(); ++out) {
+    size_t r = heap.top();
+    heap.pop();
+    Cursor &c = cursors[r];
+    items[out] = c.buf[c.at++];
+    if (c.at == c.buf.size())
+      refill(c);
+    if (c.at < c.buf.size())
+      heap.push(r);
+  }
+}
+
+/// Keyed items for lines [0, n) of the range, keys computed in parallel.
+template <typename Key, typename F>
+std::vector<Keyed<Key>> KeyLines(size_t n, ThreadPool *pool, F keyOf) {
+  std::vector<Keyed<Key>> items(n);
+  ForEachSpan(pool, n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      items[i] = {keyOf((uint32_t)i), (uint32_t)i};
+  });
+  return items;
+}
+} // namespace
+
+std::vector<uint32_t> LineOps::Plan(const Buffer &buffer, int first,
+                                    int count, Op op,
+                                    std::string_view pattern,
+                                    ThreadPool *pool, size_t memoryBudget) {
+  size_t n = (size_t)std::max(0, count);
+  std::vector<uint32_t> order;
+  auto line = [&](uint32_t i) { return buffer.GetLine(first + (int)i); };
+  auto indices = [&](const auto &items) {
+    order.reserve(items.size());
+    for (const auto &item : items)
+      order.push_back(item.index);
+  };
+
+  switch (op) {
+  case Op::Reverse:
+    order.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      order[i] = (uint32_t)(n - 1 - i);
+    break;
+
+  case Op::Keep:
+  case Op::Remove: {
+    std::vector<char> keep(n);
+    bool want = op == Op::Keep;
+    ForEachSpan(pool, n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        bool hit = TextUtils::Find(line((uint32_t)i), pattern) !=
+                   std::string_view::npos;
+        keep[i] = hit == want;
+      }
+    });
+    for (size_t i = 0; i < n; ++i) {
+      if (keep[i])
+        order.push_back((uint32_t)i);
+    }
+    break;
+  }
+
+  case Op::Sort: {
+    auto items = KeyLines<uint64_t>(n, pool, [&](uint32_t i) {
+      return Prefix(line(i));
+    });
+    SortItems(
+        items,
+        [&](const Keyed<uint64_t> &a, const Keyed<uint64_t> &b) {
+          if (a.key != b.key)
+            return a.key < b.key;
+          int c = line(a.index).compare(line(b.index));
+          return c < 0 || (c == 0 && a.index < b.index);
+        },
+        pool, memoryBudget);
+    indices(items);
+    break;
+  }
+
+  case Op::SortNumeric: {
+    auto items = KeyLines<double>(n, pool, [&](uint32_t i) {
+      return LeadingNumber(line(i));
+    });
+    SortItems(
+        items,
+        [](const Keyed<double> &a, const Keyed<double> &b) {
+          return a.key < b.key || (a.key == b.key && a.index < b.index);
+        },
+        pool, memoryBudget);
+    indices(items);
+    break;
+  }
+
+  case Op::Unique: {
+    // Sorting by (hash, text) makes equal lines adjacent; the first of each
+    // group (lowest index) is the occurrence kept
+    auto items = KeyLines<uint64_t>(n, pool, [&](uint32_t i) {
+      return TextUtils::Hash(line(i));
+    });
+    auto compare = [&](const Keyed<uint64_t> &a, const Keyed<uint64_t> &b) {
+      if (a.key != b.key)
+        return a.key < b.key ? -1 : 1;
+      return line(a.index).compare(line(b.index));
+    };
+    SortItems(
+        items,
+        [&](const Keyed<uint64_t> &a, const Keyed<uint64_t> &b) {
+          int c = compare(a, b);
+          return c < 0 || (c == 0 && a.index < b.index);
+        },
+        pool, memoryBudget);
+
+    std::vector<bool> keep(n, false);
+    for (size_t k = 0; k < n; ++k)
+      keep[items[k].index] = k == 0 || compare(items[k - 1], items[k]) != 0;
+    items = {};
+    for (size_t i = 0; i < n; ++i) {
+      if (keep[i])
+        order.push_back((uint32_t)i);
+    }
+    break;
+  }
+  }
+  return order;
+}
+
+int LineOps::Apply(Buffer &buffer, int first, int count, Op op,
+                   std::string_view pattern, unsigned threads) {
+  std::unique_ptr<ThreadPool> localPool;
+  std::vector<uint32_t> order = Plan(buffer, first, count, op, pattern,
+                                     PoolFor(threads, localPool));
+
+  // Already in order (sorted, no duplicates, nothing filtered): no edit
+  bool same = order.size() == (size_t)count;
+  for (size_t i = 0; same && i < order.size(); ++i)
+    same = order[i] == i;
+  if (!same)
+    buffer.ReorderLines(first, count, order);
+  return (int)order.size();
+}
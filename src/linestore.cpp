@@ -0,0 +1,353 @@
+/**
+ * @file linestore.cpp
+ * @brief LineStore implementation: packing lines into blocks, editing them
+ * in place, and the Fenwick tree that finds them.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/linestore.hpp"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+// Block sizes edits keep to: a bigger block is cut in two, a smaller one
+// joins a neighbour
+const size_t MAX_BLOCK = 2 * LineStore::BLOCK_LINES;
+const size_t MIN_BLOCK = LineStore::BLOCK_LINES / 4;
+
+// Entry::length of an edited line, whose offset is its slot
+const uint32_t SLOT = (1u << 30) - 1;
+
+/// Lowest set bit of i: the span a Fenwick tree node covers.
+size_t Low(size_t i) { return i & (~i + 1); }
+
+/// Highest power of two <= n (0 for none), where Locate starts.
+size_t TopFor(size_t n) {
+  size_t top = n > 0 ? 1 : 0;
+  while (top > 0 && top * 2 <= n)
+    top *= 2;
+  return top;
+}
+} // namespace
+
+LineStore::LineStore() : m_tree(1, 0), m_top(0), m_count(0) {}
+
+bool LineStore::Fits(const Block &block, const Ref &ref) {
+  // An empty line without terminator reads no source bytes
+  if (ref.slot >= 0 || (ref.length == 0 && ref.term == 0))
+    return true;
+  return ref.length <= MAX_LENGTH && ref.offset >= block.base &&
+         ref.offset - block.base <= UINT32_MAX;
+}
+
+LineStore::Entry LineStore::Pack(const Block &block, const Ref &ref) {
+  if (ref.slot >= 0)
+    return {(uint32_t)ref.slot, SLOT, ref.term};
+  if (ref.length > MAX_LENGTH)
+    throw std::runtime_error("Lines longer than 1 GB are not supported");
+  if (ref.length == 0 && ref.term == 0)
+    return {0, 0, 0};
+  return {(uint32_t)(ref.offset - block.base), (uint32_t)ref.length,
+          ref.term};
+}
+
+LineStore::Ref LineStore::Unpack(const Block &block, const Entry &entry) {
+  if (entry.length == SLOT)
+    return {0, 0, (int32_t)entry.offset, (uint8_t)entry.term};
+  return {block.base + entry.offset, entry.length, -1, (uint8_t)entry.term};
+}
+
+void LineStore::Unpack(size_t b, size_t from, size_t to,
+                       std::vector<Ref> &out) const {
+  const Block &block = m_blocks[b];
+  for (size_t i = from; i < to; ++i)
+    out.push_back(Unpack(block, block.entries[i]));
+}
+
+size_t LineStore::Locate(int y, int &at) const {
+  // Descend the tree: the last block whose first line is <= y
+  size_t pos = 0;
+  int rest = y;
+  for (size_t step = m_top; step > 0; step >>= 1) {
+    if (pos + step < m_tree.size() && m_tree[pos + step] <= rest) {
+      pos += step;
+      rest -= m_tree[pos];
+    }
+  }
+  at = rest;
+  return pos;
+}
+
+LineStore::Ref LineStore::Get(int y) const {
+  int at;
+  size_t b = Locate(y, at);
+  return Unpack(m_blocks[b], m_blocks[b].entries[at]);
+}
+
+void LineStore::Set(int y, const Ref &ref) {
+  int at;
+  size_t b = Locate(y, at);
+  Block &block = m_blocks[b];
+  if (Fits(block, ref))
+    block.entries[at] = Pack(block, ref);
+  else
+    Replace(y, 1, &ref, 1);
+}
+
+void LineStore::Replace(int first, int count, const Ref *lines, size_t n) {
+  if (m_blocks.empty()) {
+    for (size_t i = 0; i < n; ++i)
+      Push(lines[i]);
+    return;
+  }
+  int at;
+  size_t b = m_blocks.size() - 1;
+  if (first < m_count)
+    b = Locate(first, at);
+  else
+    at = (int)m_blocks[b].entries.size();
+
+  // Inside one block, with every new span near its base: edit in place
+  Block &block = m_blocks[b];
+  std::vector<Entry> &entries = block.entries;
+  bool inside = at + count <= (int)entries.size();
+  for (size_t i = 0; inside && i < n; ++i)
+    inside = Fits(block, lines[i]);
+  if (inside) {
+    size_t keep = std::min(n, (size_t)count);
+    if (n > keep)
+      entries.insert(entries.begin() + at + keep, n - keep, Entry());
+    else
+      entries.erase(entries.begin() + at + n, entries.begin() + at + count);
+    for (size_t i = 0; i < n; ++i)
+      entries[at + i] = Pack(block, lines[i]);
+    int delta = (int)n - count;
+    if (delta != 0) {
+      AddLines(b, delta);
+      m_count += delta;
+    }
+    if (entries.size() > MAX_BLOCK ||
+        (entries.size() < MIN_BLOCK &&
+         (m_blocks.size() > 1 || entries.empty())))
+      Rebalance(b);
+    return;
+  }
+
+  // Otherwise cut the blocks the run touches anew: the head of the first,
+  // the new lines, then what is left of the last
+  std::vector<Ref> run;
+  run.reserve((size_t)at + n + BLOCK_LINES);
+  Unpack(b, 0, (size_t)at, run);
+  run.insert(run.end(), lines, lines + n);
+  size_t e = b;
+  size_t skip = (size_t)(at + count);
+  while (e < m_blocks.size() && skip >= m_blocks[e].entries.size()) {
+    skip -= m_blocks[e].entries.size();
+    e++;
+  }
+  if (e < m_blocks.size() && skip > 0) {
+    Unpack(e, skip, m_blocks[e].entries.size(), run);
+    e++;
+  }
+  Rebuild(b, e, std::move(run));
+}
+
+void LineStore::Rebalance(size_t b) {
+  std::vector<Ref> run;
+  run.reserve(m_blocks[b].entries.size());
+  Unpack(b, 0, m_blocks[b].entries.size(), run);
+  Rebuild(b, b + 1, std::move(run));
+}
+
+void LineStore::Rebuild(size_t b, size_t e, std::vector<Ref> run) {
+  if (run.size() < MIN_BLOCK) {
+    if (e < m_blocks.size()) {
+      Unpack(e, 0, m_blocks[e].entries.size(), run);
+      e++;
+    } else if (b > 0) {
+      std::vector<Ref> before;
+      Unpack(b - 1, 0, m_blocks[b - 1].entries.size(), before);
+      run.insert(run.begin(), before.begin(), before.end());
+      b--;
+    }
+  }
+
+  // Even cuts of about BLOCK_LINES; a block also ends before a span more
+  // than 4 GB away from the others
+  std::vector<Block> made;
+  size_t parts =
+      std::max((size_t)1, (run.size() + BLOCK_LINES / 2) / BLOCK_LINES);
+  size_t per = (run.size() + parts - 1) / parts;
+  for (size_t i = 0; i < run.size();) {
+    size_t lo = SIZE_MAX, hi = 0, j = i;
+    for (; j < run.size() && j - i < per; ++j) {
+      const Ref &ref = run[j];
+      if (ref.slot >= 0 || (ref.length == 0 && ref.term == 0))
+        continue;
+      size_t low = std::min(lo, ref.offset);
+      size_t high = std::max(hi, ref.offset);
+      if (high - low > UINT32_MAX)
+        break;
+      lo = low;
+      hi = high;
+    }
+    Block block;
+    block.base = lo == SIZE_MAX ? 0 : lo;
+    block.entries.reserve(j - i);
+    for (; i < j; ++i)
+      block.entries.push_back(Pack(block, run[i]));
+    made.push_back(std::move(block));
+  }
+
+  // Nothing has changed yet (Pack may throw); now swap the run in
+  int removed = 0;
+  for (size_t i = b; i < e; ++i)
+    removed += (int)m_blocks[i].entries.size();
+  bool same = made.size() == e - b;
+  size_t keep = std::min(made.size(), e - b);
+  for (size_t i = 0; i < keep; ++i) {
+    int delta = (int)made[i].entries.size() -
+                (int)m_blocks[b + i].entries.size();
+    m_blocks[b + i] = std::move(made[i]);
+    if (same && delta != 0)
+      AddLines(b + i, delta);
+  }
+  if (made.size() > keep)
+    m_blocks.insert(m_blocks.begin() + e,
+                    std::make_move_iterator(made.begin() + keep),
+                    std::make_move_iterator(made.end()));
+  else
+    m_blocks.erase(m_blocks.begin() + b + keep, m_blocks.begin() + e);
+  m_count += (int)run.size() - removed;
+  if (!same)
+    BuildTree();
+}
+
+void LineStore::Push(const Ref &ref) {
+  if (!m_blocks.empty()) {
+    Block &last = m_blocks.back();
+    if (last.entries.size() < (size_t)BLOCK_LINES && Fits(last, ref)) {
+      last.entries.push_back(Pack(last, ref));
+      AddLines(m_blocks.size() - 1, 1);
+      m_count++;
+      return;
+    }
+  }
+  Block block;
+  block.base = ref.slot < 0 ? ref.offset : 0;
+  Entry entry = Pack(block, ref);
+  block.entries.reserve(BLOCK_LINES);
+  block.entries.push_back(entry);
+  AddBlock(std::move(block));
+}
+
+void LineStore::Append(LineStore &&other) {
+  for (Block &block : other.m_blocks) {
+    // A short last block takes the next one in when their spans fit
+    if (!m_blocks.empty()) {
+      Block &last = m_blocks.back();
+      bool merge = last.entries.size() + block.entries.size() <=
+                   (size_t)BLOCK_LINES;
+      for (size_t i = 0; merge && i < block.entries.size(); ++i)
+        merge = Fits(last, Unpack(block, block.entries[i]));
+      if (merge) {
+        for (const Entry &entry : block.entries)
+          last.entries.push_back(Pack(last, Unpack(block, entry)));
+        AddLines(m_blocks.size() - 1, (int)block.entries.size());
+        m_count += (int)block.entries.size();
+        continue;
+      }
+    }
+    AddBlock(std::move(block));
+  }
+  other.Clear();
+}
+
+void LineStore::Shift(size_t delta) {
+  for (Block &block : m_blocks)
+    block.base += delta;
+}
+
+void LineStore::Blank(int count) {
+  for (int left = count; left > 0; left -= BLOCK_LINES) {
+    Block block;
+    block.base = 0;
+    block.entries.assign((size_t)std::min(left, BLOCK_LINES), Entry());
+    AddBlock(std::move(block));
+  }
+}
+
+bool LineStore::Fill(int first, const Ref *lines, size_t n) {
+  if (n == 0)
+    return true;
+  bool fitted = true;
+  int at;
+  size_t b = Locate(first, at);
+  for (size_t i = 0; i < n; ++b) {
+    Block &block = m_blocks[b];
+    size_t take = std::min(n - i, block.entries.size());
+    size_t lo = SIZE_MAX;
+    for (size_t k = i; k < i + take; ++k) {
+      if (lines[k].slot < 0 && (lines[k].length > 0 || lines[k].term > 0))
+        lo = std::min(lo, lines[k].offset);
+    }
+    block.base = lo == SIZE_MAX ? 0 : lo;
+    for (size_t k = 0; k < take; ++k) {
+      const Ref &ref = lines[i + k];
+      if (Fits(block, ref)) {
+        block.entries[k] = Pack(block, ref);
+      } else {
+        block.entries[k] = Entry();
+        fitted = false;
+      }
+    }
+    i += take;
+  }
+  return fitted;
+}
+
+void LineStore::Clear() {
+  std::vector<Block>().swap(m_blocks);
+  m_tree.assign(1, 0);
+  m_top = 0;
+  m_count = 0;
+}
+
+size_t LineStore::MemoryBytes() const {
+  size_t bytes =
+      m_blocks.capacity() * sizeof(Block) + m_tree.capacity() * sizeof(int);
+  for (const Block &block : m_blocks)
+    bytes += block.entries.capacity() * sizeof(Entry);
+  return bytes;
+}
+
+void LineStore::AddBlock(Block block) {
+  int lines = (int)block.entries.size();
+  m_blocks.push_back(std::move(block));
+
+  // Node n covers blocks (n - Low(n), n]: its own lines plus its children
+  size_t n = m_blocks.size();
+  int sum = lines;
+  for (size_t i = n - 1; i > n - Low(n); i -= Low(i))
+    sum += m_tree[i];
+  m_tree.push_back(sum);
+  m_top = TopFor(n);
+  m_count += lines;
+}
+
+void LineStore::AddLines(size_t b, int delta) {
+  for (size_t i = b + 1; i < m_tree.size(); i += Low(i))
+    m_tree[i] += delta;
+}
+
+void LineStore::BuildTree() {
+  m_tree.assign(m_blocks.size() + 1, 0);
+  for (size_t i = 1; i < m_tree.size(); ++i) {
+    m_tree[i] += (int)m_blocks[i - 1].entries.size();
+    size_t up = i + Low(i);
+    if (up < m_tree.size())
+      m_tree[up] += m_tree[i];
+  }
+  m_top = TopFor(m_blocks.size());
+}
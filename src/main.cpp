@@ -5,11 +5,21 @@
  * @version 2.0.0
  */
 
+#include "../include/compression.hpp"
 #include "../include/editor.hpp"
+#include "../include/hexeditor.hpp"
+#include "../include/projectsearch.hpp"
+#include "../include/script.hpp"
+#include <cctype>
+#include <cerrno>
 #include <clocale>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <signal.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 /// Global signal status for graceful shutdown handling.
 volatile sig_atomic_t g_signalStatus = 0;
@@ -20,6 +30,90 @@ void SignalHandler(int signal) { g_signalStatus = signal; }
 /// Maximum file size before warning (100 MB).
 constexpr size_t LARGE_FILE_THRESHOLD = 100 * 1024 * 1024;
 
+/// Most workers -j may ask for; more only adds threads that wait.
+constexpr unsigned long MAX_THREADS = 1024;
+
+/// Parse the -j value: digits only, 0 (one per core) to MAX_THREADS.
+bool ParseThreads(const char *text, unsigned &threads) {
+  if (!isdigit((unsigned char)text[0]))
+    return false; // strtoul would accept "-1" and " 8"
+  errno = 0;
+  char *end = nullptr;
+  unsigned long value = strtoul(text, &end, 10);
+  if (errno != 0 || *end != '\0' || value > MAX_THREADS)
+    return false;
+  threads = (unsigned)value;
+  return true;
+}
+
+/// Print usage to stderr and return the usage exit code.
+int Usage() {
+  std::cerr << "Usage: edit [-f|--follow | --hex] <filename>" << std::endl;
+  std::cerr << "       edit --script <ops-file> [-j N] <files...>" << std::endl;
+  std::cerr << "       edit --grep <text> [-j N] [dir]" << std::endl;
+  return 1;
+}
+
+/// Headless mode: apply a script to every file, no terminal UI.
+int RunScript(const std::string &scriptPath,
+              const std::vector<std::string> &files, unsigned threads) {
+  Script script;
+  try {
+    script.Load(scriptPath);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << scriptPath << ": " << e.what() << std::endl;
+    return 2;
+  }
+
+  std::vector<std::string> errors;
+  Script::Result r = script.Run(files, threads, errors);
+  for (const std::string &error : errors)
+    std::cerr << "Error: " << error << std::endl;
+
+  double rate = r.seconds > 0 ? (double)r.files / r.seconds : 0.0;
+  char report[160];
+  snprintf(report, sizeof(report),
+           "%zu files (%zu changed, %zu failed) in %.3f s - %.0f files/s",
+           r.files, r.changed, r.failed, r.seconds, rate);
+  std::cout << report << std::endl;
+
+  if (r.files < files.size()) {
+    std::cerr << "Interrupted after " << r.files << " of " << files.size()
+              << " files" << std::endl;
+    return 130;
+  }
+  return r.failed > 0 ? 2 : 0;
+}
+
+/// Headless search (output is not a terminal): print hits as grep does,
+/// "path:line:text", as they are found.
+int RunGrep(const std::string &pattern, const std::string &root,
+            unsigned threads) {
+  ProjectSearch search;
+  search.Start(root, pattern, threads);
+  std::vector<ProjectSearch::Hit> hits;
+  size_t found = 0;
+  for (;;) {
+    bool done = search.Done(); // Hits delivered before this are taken below
+    hits.clear();
+    search.Take(hits);
+    for (const ProjectSearch::Hit &hit : hits)
+      std::cout << hit.path << ':' << hit.line + 1 << ':' << hit.text << '\n';
+    found += hits.size();
+    if (done)
+      break;
+    if (g_signalStatus != 0) {
+      search.Cancel();
+      return 130;
+    }
+    search.Wait(100);
+  }
+  std::cout.flush();
+  if (search.Capped())
+    std::cerr << "Stopped after " << found << " matches" << std::endl;
+  return found > 0 ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
   // Set locale for UTF-8 support
   setlocale(LC_ALL, "");
@@ -29,16 +123,86 @@ int main(int argc, char *argv[]) {
   signal(SIGINT, SignalHandler);
   signal(SIGTERM, SignalHandler);
 
-  if (argc != 2) {
-    std::cerr << "Usage: edit <filename>" << std::endl;
-    return 1;
+  bool follow = false;
+  bool hex = false;
+  std::string scriptPath;
+  std::string grepPattern;
+  bool grep = false;
+  unsigned threads = 0;
+  bool threadsGiven = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-f" || arg == "--follow") {
+      follow = true;
+    } else if (arg == "--hex") {
+      hex = true;
+    } else if (arg == "--script" && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (arg == "--grep" && i + 1 < argc) {
+      grep = true;
+      grepPattern = argv[++i];
+    } else if (arg == "-j" && i + 1 < argc) {
+      if (!ParseThreads(argv[++i], threads)) {
+        std::cerr << "edit: -j takes a thread count from 0 to " << MAX_THREADS
+                  << std::endl;
+        return Usage();
+      }
+      threadsGiven = true;
+    } else {
+      paths.push_back(arg);
+    }
   }
 
-  std::string path = argv[1];
+  if (threadsGiven && scriptPath.empty() && !grep)
+    return Usage(); // Only the batch modes have workers to size
 
-  // Check file size before loading
+  if (!scriptPath.empty()) {
+    if (paths.empty() || follow || hex)
+      return Usage();
+    return RunScript(scriptPath, paths, threads);
+  }
+
+  if (grep) {
+    if (paths.size() > 1 || grepPattern.empty() || follow || hex)
+      return Usage();
+    std::string root = paths.empty() ? "." : paths[0];
+    if (!isatty(STDOUT_FILENO))
+      return RunGrep(grepPattern, root, threads);
+    try {
+      Editor editor;
+      editor.Grep(root, grepPattern, threads);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 2;
+    }
+    return 0;
+  }
+
+  if (paths.size() != 1 || (hex && follow))
+    return Usage();
+  const std::string &path = paths[0];
+
+  // Binary files open in the hex view, mapped rather than loaded; a
+  // compressed file is binary only if this build cannot inflate it
   struct stat st;
-  if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+  bool regular = stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+  bool compressed =
+      regular && Compression::Supported(Compression::Probe(path));
+  if (regular && !follow &&
+      (hex || (!compressed && HexFile::LooksBinary(path)))) {
+    try {
+      HexEditor editor;
+      editor.Run(path);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 2;
+    }
+    return 0;
+  }
+
+  // Check file size before loading
+  if (regular) {
     if ((size_t)st.st_size > LARGE_FILE_THRESHOLD) {
       double sizeMB = (double)st.st_size / (1024 * 1024);
       std::cerr << "Warning: File is " << (int)sizeMB << " MB." << std::endl;
@@ -54,6 +218,7 @@ int main(int argc, char *argv[]) {
 
   try {
     Editor editor;
+    editor.SetFollow(follow);
     editor.Run(path);
 
   } catch (const std::exception &e) {
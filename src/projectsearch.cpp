@@ -0,0 +1,335 @@
+/**
+ * @file projectsearch.cpp
+ * @brief ProjectSearch implementation: tree walk with .gitignore rules,
+ * parallel scan of mapped files and hit delivery.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/projectsearch.hpp"
+#include "../include/constants.hpp"
+#include "../include/textutils.hpp"
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <fstream>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+// Hits handed over from a worker at once, so a huge file streams too
+const size_t DELIVER_HITS = 256;
+
+/// One line of a .gitignore file.
+struct Rule {
+  std::string glob;
+  bool negate = false;   // "!pattern": re-include
+  bool dirOnly = false;  // "pattern/": directories only
+  bool anchored = false; // Has a '/': matched against the whole path
+};
+
+/// The rules of one .gitignore and the directory they apply below.
+struct IgnoreFile {
+  std::string base; // Relative directory with a trailing '/', or ""
+  std::vector<Rule> rules;
+};
+
+std::vector<Rule> ReadRules(const std::string &path) {
+  std::vector<Rule> rules;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    while (!line.empty() && line.back() == ' ')
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    Rule rule;
+    if (line[0] == '!') {
+      rule.negate = true;
+      line.erase(0, 1);
+    } else if (line[0] == '\\') {
+      line.erase(0, 1); // "\#" and "\!" are literal
+    }
+    if (!line.empty() && line.back() == '/') {
+      rule.dirOnly = true;
+      line.pop_back();
+    }
+    // "dir/**" ignores dir's contents, which is dir itself for a walk
+    if (line.size() > 3 && line.compare(line.size() - 3, 3, "/**") == 0)
+      line.resize(line.size() - 3);
+    // "**/name" is name at any depth, as a pattern without a slash is
+    while (line.compare(0, 3, "**/") == 0)
+      line.erase(0, 3);
+    if (!line.empty() && line[0] == '/') {
+      rule.anchored = true;
+      line.erase(0, 1);
+    }
+    if (line.empty())
+      continue;
+    rule.anchored = rule.anchored || line.find('/') != std::string::npos;
+    rule.glob = line;
+    rules.push_back(rule);
+  }
+  return rules;
+}
+
+/// Whether the .gitignore files in scope exclude relative (a path below
+/// the root); later rules and deeper files win.
+bool Ignored(const std::vector<IgnoreFile> &scope,
+             const std::string &relative, const char *name, bool dir) {
+  bool ignored = false;
+  for (const IgnoreFile &file : scope) {
+    const char *below = relative.c_str() + file.base.size();
+    for (const Rule &rule : file.rules) {
+      if (rule.dirOnly && !dir)
+        continue;
+      if (rule.negate != ignored)
+        continue; // Cannot change the outcome
+      // "**" inside a pattern crosses directories: match without
+      // FNM_PATHNAME there
+      int flags =
+          rule.glob.find("**") == std::string::npos ? FNM_PATHNAME : 0;
+      bool hit = rule.anchored
+                     ? fnmatch(rule.glob.c_str(), below, flags) == 0
+                     : fnmatch(rule.glob.c_str(), name, 0) == 0;
+      if (hit)
+        ignored = !rule.negate;
+    }
+  }
+  return ignored;
+}
+
+/// Newlines in [data, data + size). Byte-wide counters over runs of at
+/// most 255 bytes let the compiler count 16 or 32 bytes per instruction.
+size_t CountNewlines(const char *data, size_t size) {
+  size_t total = 0;
+  while (size > 0) {
+    size_t run = std::min<size_t>(size, 255);
+    unsigned char count = 0;
+    for (size_t i = 0; i < run; ++i)
+      count = (unsigned char)(count + (data[i] == '\n'));
+    total += count;
+    data += run;
+    size -= run;
+  }
+  return total;
+}
+
+/// Path of a file below root as the user would type it: "src/x.cpp" for
+/// root ".", "/tmp/src/x.cpp" for root "/tmp/".
+std::string Join(const std::string &root, const std::string &relative) {
+  if (root == ".")
+    return relative;
+  if (!root.empty() && root.back() == '/')
+    return root + relative;
+  return root + "/" + relative;
+}
+
+/// Collect the regular files under dir (relative: its path from the root,
+/// "" or ending in '/'), pruning ignored entries.
+void Walk(const std::string &root, const std::string &relative,
+          std::vector<IgnoreFile> &scope, std::vector<std::string> &files,
+          const std::atomic<bool> &cancel) {
+  std::string dir = Join(root, relative);
+  if (dir.empty())
+    dir = "./";
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+    return; // Unreadable directories are skipped, as grep -r does
+
+  bool ownRules = false;
+  std::vector<Rule> rules = ReadRules(dir + ".gitignore");
+  if (!rules.empty()) {
+    scope.push_back({relative, std::move(rules)});
+    ownRules = true;
+  }
+
+  // Sorted, so results arrive in a stable order from run to run
+  std::vector<std::pair<std::string, bool>> entries;
+  while (struct dirent *e = readdir(d)) {
+    const char *name = e->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+        strcmp(name, ".git") == 0)
+      continue;
+    unsigned char type = e->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat st;
+      if (lstat((dir + name).c_str(), &st) != 0)
+        continue;
+      type = S_ISDIR(st.st_mode)   ? DT_DIR
+             : S_ISREG(st.st_mode) ? DT_REG
+                                   : DT_UNKNOWN;
+    }
+    if (type == DT_DIR || type == DT_REG)
+      entries.push_back({name, type == DT_DIR});
+  }
+  closedir(d);
+  std::sort(entries.begin(), entries.end());
+
+  for (const auto &entry : entries) {
+    if (cancel)
+      break;
+    std::string path = relative + entry.first;
+    if (Ignored(scope, path, entry.first.c_str(), entry.second))
+      continue;
+    if (entry.second)
+      Walk(root, path + "/", scope, files, cancel);
+    else
+      files.push_back(path);
+  }
+  if (ownRules)
+    scope.pop_back();
+}
+} // namespace
+
+ProjectSearch::ProjectSearch()
+    : m_cancel(false), m_done(true), m_capped(false), m_files(0), m_bytes(0),
+      m_found(0) {}
+
+ProjectSearch::~ProjectSearch() { Cancel(); }
+
+void ProjectSearch::Cancel() {
+  if (m_worker.joinable()) {
+    m_cancel = true;
+    m_worker.join();
+  }
+}
+
+void ProjectSearch::Start(const std::string &root, const std::string &pattern,
+                          unsigned threads) {
+  Cancel();
+  m_cancel = false;
+  m_done = false;
+  m_capped = false;
+  m_files = 0;
+  m_bytes = 0;
+  m_found = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.clear();
+  }
+
+  m_worker = std::thread([this, root, pattern, threads] {
+    std::vector<IgnoreFile> scope;
+    std::vector<std::string> files;
+    Walk(root, "", scope, files, m_cancel);
+    for (std::string &file : files)
+      file = Join(root, file);
+
+    // A pool of its own: the search may run for long and must not hold
+    // the shared workers a paste or a sort in the editor waits for.
+    // ParallelFor hands each worker the next file as soon as it is free
+    std::unique_ptr<ThreadPool> localPool;
+    ThreadPool *pool = BackgroundPoolFor(threads, localPool);
+    ForEachChunk(pool, files.size(), [&](size_t i) {
+      if (!m_cancel)
+        Search(files[i], pattern);
+    });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done = true;
+    m_ready.notify_all();
+  });
+}
+
+void ProjectSearch::Search(const std::string &path,
+                           const std::string &pattern) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  std::string_view text(static_cast<const char *>(map), size);
+  m_files++;
+  if (TextUtils::LooksBinary(
+          text.substr(0, std::min(size, Edit::BINARY_SAMPLE_BYTES)))) {
+    munmap(map, size);
+    return;
+  }
+
+  // The whole file is scanned at once; lines are only counted up to each
+  // hit, and the rest of a matching line is skipped (one hit per line)
+  std::vector<Hit> hits;
+  int line = 0;
+  size_t lineStart = 0; // Start of line `line`
+  size_t counted = 0;   // Newlines before here are counted
+  for (size_t at = TextUtils::Find(text, pattern);
+       at != std::string_view::npos && !m_cancel;) {
+    // Counted in bulk, then the line start found backwards from the hit
+    line += (int)CountNewlines(text.data() + counted, at - counted);
+    counted = at;
+    size_t back = text.rfind('\n', at);
+    if (back != std::string_view::npos && back >= lineStart)
+      lineStart = back + 1;
+
+    size_t lineEnd = text.find('\n', at);
+    if (lineEnd == std::string_view::npos)
+      lineEnd = size;
+    size_t shown = lineEnd;
+    if (shown > lineStart && text[shown - 1] == '\r')
+      shown--;
+    shown = std::min(shown, lineStart + Edit::SEARCH_LINE_BYTES);
+    hits.push_back({path, line, (int)(at - lineStart),
+                    std::string(text.substr(lineStart, shown - lineStart))});
+    if (hits.size() >= DELIVER_HITS)
+      Deliver(hits);
+
+    if (lineEnd >= size)
+      break;
+    at = TextUtils::Find(text, pattern, lineEnd + 1);
+  }
+  Deliver(hits);
+  m_bytes += size;
+  munmap(map, size);
+}
+
+void ProjectSearch::Deliver(std::vector<Hit> &hits) {
+  if (hits.empty())
+    return;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t room = m_found < Edit::SEARCH_MAX_HITS
+                    ? Edit::SEARCH_MAX_HITS - m_found
+                    : 0;
+  if (hits.size() > room) {
+    hits.resize(room);
+    m_capped = true;
+    m_cancel = true;
+  }
+  m_found += hits.size();
+  for (Hit &hit : hits)
+    m_pending.push_back(std::move(hit));
+  hits.clear();
+  m_ready.notify_all();
+}
+
+size_t ProjectSearch::Take(std::vector<Hit> &hits) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t n = m_pending.size();
+  for (Hit &hit : m_pending)
+    hits.push_back(std::move(hit));
+  m_pending.clear();
+  return n;
+}
+
+void ProjectSearch::Wait(int milliseconds) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_ready.wait_for(lock, std::chrono::milliseconds(milliseconds),
+                   [this] { return m_done || !m_pending.empty(); });
+}
@@ -0,0 +1,279 @@
+/**
+ * @file script.cpp
+ * @brief Script implementation: parsing, application and batch runs.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/script.hpp"
+#include "../include/textutils.hpp"
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <signal.h>
+#include <stdexcept>
+
+extern volatile sig_atomic_t g_signalStatus;
+
+namespace {
+/// Split a script line into words and "quoted strings"; '#' ends the line.
+std::vector<std::string> Tokenize(const std::string &line, int lineNo) {
+  std::vector<std::string> tokens;
+  size_t i = 0;
+  while (i < line.size()) {
+    char c = line[i];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      i++;
+      continue;
+    }
+    if (c == '#')
+      break;
+
+    std::string token;
+    if (c != '"') {
+      while (i < line.size() && line[i] != ' ' && line[i] != '\t' &&
+             line[i] != '\r')
+        token += line[i++];
+      tokens.push_back(token);
+      continue;
+    }
+
+    for (i++;; i++) {
+      if (i >= line.size())
+        throw std::runtime_error("line " + std::to_string(lineNo) +
+                                 ": unterminated string");
+      if (line[i] == '"')
+        break;
+      if (line[i] == '\\' && i + 1 < line.size()) {
+        char e = line[++i];
+        token += e == 'n' ? '\n' : e == 't' ? '\t' : e;
+      } else {
+        token += line[i];
+      }
+    }
+    i++; // Closing quote
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+int ParseCount(const std::string &s, int lineNo) {
+  char *end = nullptr;
+  errno = 0;
+  long v = strtol(s.c_str(), &end, 10);
+  if (s.empty() || *end != '\0' || errno != 0 || v < 1 || v > INT_MAX)
+    throw std::runtime_error("line " + std::to_string(lineNo) +
+                             ": expected a positive number, got '" + s + "'");
+  return (int)v;
+}
+
+/// Byte offset of the n-th character (0-based), clamped to the line end.
+int CharToByte(const TextUtils::Kernels &text, std::string_view line, int n) {
+  size_t i = 0;
+  while (n-- > 0 && i < line.size())
+    i = text.NextCharIdx(line, i);
+  return (int)i;
+}
+} // namespace
+
+void Script::Load(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error("Cannot open script " + path);
+
+  m_ops.clear();
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    std::vector<std::string> t = Tokenize(line, lineNo);
+    if (t.empty())
+      continue;
+
+    auto expect = [&](size_t min, size_t max) {
+      if (t.size() - 1 < min || t.size() - 1 > max)
+        throw std::runtime_error("line " + std::to_string(lineNo) +
+                                 ": wrong number of arguments to " + t[0]);
+    };
+
+    Op op = {OpType::Goto, 0, 1, "", "", LineOps::Op::Sort};
+    if (t[0] == "goto") {
+      expect(1, 2);
+      op.line = t[1] == "$" ? -1 : ParseCount(t[1], lineNo);
+      if (t.size() > 2)
+        op.count = ParseCount(t[2], lineNo);
+    } else if (t[0] == "insert") {
+      expect(1, 1);
+      op.type = OpType::Insert;
+      op.text = t[1];
+    } else if (t[0] == "delete") {
+      expect(1, 1);
+      op.type = OpType::Delete;
+      op.count = ParseCount(t[1], lineNo);
+    } else if (t[0] == "replace") {
+      expect(2, 2);
+      op.type = OpType::Replace;
+      op.text = t[1];
+      op.with = t[2];
+      if (op.text.empty() || op.text.find('\n') != std::string::npos ||
+          op.with.find('\n') != std::string::npos)
+        throw std::runtime_error("line " + std::to_string(lineNo) +
+                                 ": replace works within a line");
+    } else if (t[0] == "sort") {
+      expect(0, 1);
+      op.type = OpType::Lines;
+      if (t.size() > 1 && t[1] != "numeric")
+        throw std::runtime_error("line " + std::to_string(lineNo) +
+                                 ": sort takes only 'numeric'");
+      op.lines = t.size() > 1 ? LineOps::Op::SortNumeric : LineOps::Op::Sort;
+    } else if (t[0] == "unique" || t[0] == "reverse") {
+      expect(0, 0);
+      op.type = OpType::Lines;
+      op.lines = t[0] == "unique" ? LineOps::Op::Unique : LineOps::Op::Reverse;
+    } else if (t[0] == "keep" || t[0] == "drop") {
+      expect(1, 1);
+      op.type = OpType::Lines;
+      op.lines = t[0] == "keep" ? LineOps::Op::Keep : LineOps::Op::Remove;
+      op.text = t[1];
+      if (op.text.empty() || op.text.find('\n') != std::string::npos)
+        throw std::runtime_error("line " + std::to_string(lineNo) + ": " +
+                                 t[0] + " matches within a line");
+    } else {
+      throw std::runtime_error("line " + std::to_string(lineNo) +
+                               ": unknown operation '" + t[0] + "'");
+    }
+    m_ops.push_back(op);
+  }
+}
+
+void Script::Apply(Buffer &buffer) const {
+  Buffer::Position cursor = {0, 0};
+
+  for (const Op &op : m_ops) {
+    int last = buffer.LineCount() - 1;
+    cursor.y = std::min(cursor.y, last);
+    cursor.x = std::min(cursor.x, (int)buffer.GetLine(cursor.y).size());
+
+    switch (op.type) {
+    case OpType::Goto:
+      cursor.y = op.line < 0 ? last : std::min(op.line - 1, last);
+      cursor.x = CharToByte(TextUtils::KernelsFor(buffer.GetEncoding()),
+                            buffer.GetLine(cursor.y), op.count - 1);
+      break;
+
+    case OpType::Insert: {
+      size_t start = 0;
+      for (;;) {
+        size_t nl = op.text.find('\n', start);
+        std::string part = op.text.substr(start, nl - start);
+        if (!part.empty()) {
+          buffer.InsertString(cursor.y, cursor.x, part);
+          cursor.x += (int)part.size();
+        }
+        if (nl == std::string::npos)
+          break;
+        buffer.InsertNewLine(cursor.y, cursor.x);
+        cursor = {cursor.y + 1, 0};
+        start = nl + 1;
+      }
+      break;
+    }
+
+    case OpType::Delete: {
+      Buffer::Position end = cursor;
+      for (int i = 0; i < op.count; ++i) {
+        std::string_view text = buffer.GetLine(end.y);
+        if ((size_t)end.x < text.size()) {
+          end.x = (int)TextUtils::KernelsFor(buffer.GetEncoding())
+                      .NextCharIdx(text, end.x);
+        } else if (end.y < last) {
+          end = {end.y + 1, 0};
+        } else {
+          break;
+        }
+      }
+      buffer.DeleteRange(cursor, end);
+      break;
+    }
+
+    case OpType::Replace:
+      for (int y = 0; y <= last; ++y) {
+        std::string_view text = buffer.GetLine(y);
+        size_t hit = text.find(op.text);
+        if (hit == std::string_view::npos)
+          continue;
+
+        std::string replaced;
+        size_t from = 0;
+        while (hit != std::string_view::npos) {
+          replaced.append(text.data() + from, hit - from);
+          replaced += op.with;
+          from = hit + op.text.size();
+          hit = text.find(op.text, from);
+        }
+        replaced.append(text.data() + from, text.size() - from);
+
+        buffer.DeleteRange({y, 0}, {y, (int)text.size()});
+        buffer.InsertString(y, 0, replaced);
+      }
+      break;
+
+    case OpType::Lines:
+      // Files are the unit of parallelism, as for Load
+      LineOps::Apply(buffer, 0, buffer.LineCount(), op.lines, op.text, 1);
+      cursor = {0, 0};
+      break;
+    }
+  }
+}
+
+Script::Result Script::Run(const std::vector<std::string> &files,
+                           unsigned threads,
+                           std::vector<std::string> &errors) const {
+  std::unique_ptr<ThreadPool> localPool;
+  ThreadPool *pool = PoolFor(threads, localPool);
+
+  std::vector<std::string> failures(files.size());
+  std::atomic<size_t> processed{0}, changed{0}, failed{0};
+  auto start = std::chrono::steady_clock::now();
+
+  auto work = [&](size_t i) {
+    if (g_signalStatus != 0)
+      return; // Interrupted: leave the remaining files alone
+    try {
+      Buffer buffer;
+      buffer.Load(files[i], 1); // Files are the unit of parallelism
+      if (!buffer.ExistsOnDisk())
+        throw std::runtime_error("No such file");
+      Apply(buffer);
+      if (buffer.IsDirty()) {
+        buffer.Save();
+        changed++;
+      }
+    } catch (const std::exception &e) {
+      failures[i] = e.what();
+      failed++;
+    }
+    processed++;
+  };
+
+  ForEachChunk(pool, files.size(), work);
+
+  Result result;
+  result.files = processed;
+  result.changed = changed;
+  result.failed = failed;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!failures[i].empty())
+      errors.push_back(files[i] + ": " + failures[i]);
+  }
+  return result;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file session.cpp
+ * @brief Session implementation: record format, lookup and storage.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/session.hpp"
+#include "../include/constants.hpp"
+#include "../include/indexcache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+/*
+ * A record is a few lines of text:
+ *
+ *   edit-session 1
+ *   path /home/me/notes.txt
+ *   cursor <line> <byte>
+ *   scroll <row> <column>
+ *   history <answer>        (one per answer, oldest first)
+ *
+ * The path guards against two files whose paths hash alike. Answers have
+ * '\' and newlines escaped so each stays on its line.
+ */
+const char *const MAGIC = "edit-session 1";
+
+bool Disabled() {
+  const char *off = getenv("EDIT_NO_SESSION");
+  return off && off[0] != '\0' && off[0] != '0';
+}
+
+std::string Escape(const std::string &text) {
+  std::string out;
+  for (char c : text) {
+    if (c == '\\')
+      out += "\\\\";
+    else if (c == '\n')
+      out += "\\n";
+    else
+      out += c;
+  }
+  return out;
+}
+
+std::string Unescape(const std::string &text) {
+  std::string out;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '\\' && i + 1 < text.size()) {
+      ++i;
+      out += text[i] == 'n' ? '\n' : text[i];
+    } else {
+      out += text[i];
+    }
+  }
+  return out;
+}
+} // namespace
+
+bool Session::Read(const std::string &path, State &state) {
+  if (Disabled())
+    return false;
+  std::string canonical = IndexCache::Canonical(path);
+  std::string file = IndexCache::EntryPath(canonical, "session", ".txt");
+  if (file.empty())
+    return false;
+
+  std::ifstream in(file);
+  std::string line;
+  if (!std::getline(in, line) || line != MAGIC)
+    return false;
+  if (!std::getline(in, line) || line != "path " + canonical)
+    return false;
+
+  State read;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    fields >> key;
+    if (key == "cursor") {
+      fields >> read.cy >> read.cx;
+    } else if (key == "scroll") {
+      fields >> read.rowOff >> read.colOff;
+    } else if (key == "history" && line.size() > key.size() + 1) {
+      read.history.push_back(Unescape(line.substr(key.size() + 1)));
+    }
+    if (fields.fail())
+      return false;
+  }
+  // Hand-edited or damaged: a negative position is no place to return to
+  if (read.cy < 0 || read.cx < 0 || read.rowOff < 0 || read.colOff < 0)
+    return false;
+  if (read.history.size() > Edit::SESSION_HISTORY)
+    read.history.erase(read.history.begin(),
+                       read.history.end() - Edit::SESSION_HISTORY);
+  state = std::move(read);
+  return true;
+}
+
+void Session::Write(const std::string &path, const State &state) {
+  if (Disabled())
+    return;
+  std::string canonical = IndexCache::Canonical(path);
+  std::string file = IndexCache::EntryPath(canonical, "session", ".txt");
+  if (file.empty())
+    return;
+
+  // Back at the top with no history: a record would restore nothing
+  if (state.cy == 0 && state.cx == 0 && state.rowOff == 0 &&
+      state.colOff == 0 && state.history.empty()) {
+    unlink(file.c_str());
+    return;
+  }
+  if (!IndexCache::MakeDirs(file.substr(0, file.find_last_of('/'))))
+    return;
+
+  std::string text = std::string(MAGIC) + "\npath " + canonical + "\n";
+  text += "cursor " + std::to_string(state.cy) + " " +
+          std::to_string(state.cx) + "\n";
+  text += "scroll " + std::to_string(state.rowOff) + " " +
+          std::to_string(state.colOff) + "\n";
+  for (const std::string &answer : state.history)
+    text += "history " + Escape(answer) + "\n";
+
+  // As IndexCache::Store: temp + rename, no fsync
+  std::string temp = file + Edit::TEMP_EXTENSION;
+  int out = open(temp.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+  if (out < 0)
+    return;
+  bool ok = write(out, text.data(), text.size()) == (ssize_t)text.size();
+  ok = close(out) == 0 && ok;
+  if (!ok || rename(temp.c_str(), file.c_str()) != 0)
+    unlink(temp.c_str());
+}
@@ -0,0 +1,261 @@
+/**
+ * @file structure.cpp
+ * @brief StructureIndex implementation: block summaries, bracket matching
+ * and fold extents.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/structure.hpp"
+#include "../include/constants.hpp"
+#include <algorithm>
+
+namespace {
+// Target lines per block; an edit re-splits the blocks it touched
+const int BLOCK_LINES = 1024;
+
+int BracketDelta(char c) {
+  switch (c) {
+  case '(':
+  case '[':
+  case '{':
+    return 1;
+  case ')':
+  case ']':
+  case '}':
+    return -1;
+  default:
+    return 0;
+  }
+}
+
+/// Width of the leading whitespace, tabs to TAB_STOP; INT_MAX if blank.
+int Indent(std::string_view line) {
+  int width = 0;
+  for (char c : line) {
+    if (c == ' ')
+      width++;
+    else if (c == '\t')
+      width += Edit::TAB_STOP - width % Edit::TAB_STOP;
+    else if (c != '\r' && c != '\f' && c != '\v')
+      return width;
+  }
+  return INT_MAX;
+}
+} // namespace
+
+StructureIndex::StructureIndex() : m_blocks(BLOCK_LINES) {}
+
+void StructureIndex::Reset(int lineCount) {
+  m_blocks.Reset(lineCount);
+}
+
+void StructureIndex::Edited(const Buffer::LineEdit &edit) {
+  // Every block touched is summarised again
+  m_blocks.Edited(edit, [](LineBlocks<Scan>::Block &) {});
+}
+
+bool StructureIndex::FindMatch(const Buffer &buffer, Buffer::Position cursor,
+                               Buffer::Range &pair, int scanLimit) {
+  Sync(buffer);
+  std::string_view line = buffer.GetLine(cursor.y);
+  int x = cursor.x;
+  if (x >= (int)line.size() || BracketDelta(line[x]) == 0) {
+    if (x < 1 || x > (int)line.size() || BracketDelta(line[x - 1]) == 0)
+      return false;
+    x--; // The bracket just typed or just left behind
+  }
+
+  pair.from = {cursor.y, x};
+  if (BracketDelta(line[x]) > 0)
+    return MatchForward(buffer, pair.from, pair.to, scanLimit);
+  return MatchBackward(buffer, pair.from, pair.to, scanLimit);
+}
+
+int StructureIndex::FoldEnd(const Buffer &buffer, int y) {
+  Sync(buffer);
+  std::string_view line = buffer.GetLine(y);
+
+  // The last bracket this line opens and leaves open
+  int depth = 0;
+  for (size_t x = line.size(); x-- > 0;) {
+    int d = BracketDelta(line[x]);
+    if (d > 0 && depth == 0) {
+      Buffer::Position match;
+      if (MatchForward(buffer, {y, (int)x}, match, INT_MAX) &&
+          match.y > y + 1)
+        return match.y - 1; // The closing line stays visible
+      break;
+    }
+    depth -= d;
+  }
+
+  // Otherwise the lines after it indented deeper, skipping whole blocks
+  int indent = Indent(line);
+  if (indent == INT_MAX)
+    return y;
+  int stop = m_blocks.LineCount();
+  int budget = INT_MAX;
+  int next = y + 1;
+  int blockFirst;
+  for (size_t b = m_blocks.Locate(next, blockFirst);
+       b < m_blocks.Size() && stop == m_blocks.LineCount(); ++b) {
+    int end = blockFirst + m_blocks[b].lines;
+    if (next == blockFirst &&
+        Summarize(buffer, b, blockFirst, budget)->minIndent > indent) {
+      next = blockFirst = end;
+      continue;
+    }
+    for (; next < end; ++next) {
+      if (Indent(buffer.GetLine(next)) <= indent) {
+        stop = next;
+        break;
+      }
+    }
+    blockFirst = end;
+  }
+
+  // Trailing blank lines belong to what follows
+  int end = stop - 1;
+  while (end > y && Indent(buffer.GetLine(end)) == INT_MAX)
+    end--;
+  return end;
+}
+
+StructureIndex::Summary StructureIndex::Measure(std::string_view line) {
+  Summary s = {0, 0, Indent(line)};
+  for (char c : line) {
+    int d = BracketDelta(c);
+    if (d != 0) {
+      s.delta += d;
+      s.minPrefix = std::min(s.minPrefix, s.delta);
+    }
+  }
+  return s;
+}
+
+const StructureIndex::Summary *
+StructureIndex::Summarize(const Buffer &buffer, size_t b, int blockFirst,
+                          int &budget) {
+  LineBlocks<Scan>::Block &block = m_blocks[b];
+  if (block.data.scanned)
+    return &block.data.summary;
+  if (block.lines > budget)
+    return nullptr;
+  budget -= block.lines;
+
+  Summary sum = {0, 0, INT_MAX};
+  for (int y = blockFirst; y < blockFirst + block.lines; ++y) {
+    Summary s = Measure(buffer.GetLine(y));
+    sum.minPrefix = std::min(sum.minPrefix, sum.delta + s.minPrefix);
+    sum.delta += s.delta;
+    sum.minIndent = std::min(sum.minIndent, s.minIndent);
+  }
+  block.data.summary = sum;
+  block.data.scanned = true;
+  return &block.data.summary;
+}
+
+void StructureIndex::Sync(const Buffer &buffer) {
+  // A change that never reached Edited: start over rather than misreport
+  if (m_blocks.LineCount() != buffer.LineCount())
+    Reset(buffer.LineCount());
+}
+
+bool StructureIndex::MatchForward(const Buffer &buffer, Buffer::Position from,
+                                  Buffer::Position &match, int budget) {
+  int depth = 0;
+  std::string_view line = buffer.GetLine(from.y);
+  for (size_t x = from.x; x < line.size(); ++x) {
+    depth += BracketDelta(line[x]);
+    if (depth == 0) {
+      match = {from.y, (int)x};
+      return true;
+    }
+  }
+
+  // Skip blocks that never bring the depth back to zero; descend into the
+  // first one that does
+  int y = from.y + 1;
+  int blockFirst;
+  for (size_t b = m_blocks.Locate(y, blockFirst); b < m_blocks.Size(); ++b) {
+    int end = blockFirst + m_blocks[b].lines;
+    if (y == blockFirst) {
+      const Summary *s = Summarize(buffer, b, blockFirst, budget);
+      if (!s)
+        return false;
+      if (depth + s->minPrefix > 0) {
+        depth += s->delta;
+        y = blockFirst = end;
+        continue;
+      }
+    }
+    for (; y < end; ++y) {
+      line = buffer.GetLine(y);
+      Summary s = Measure(line);
+      if (depth + s.minPrefix > 0) {
+        depth += s.delta;
+        continue;
+      }
+      for (size_t x = 0; x < line.size(); ++x) {
+        depth += BracketDelta(line[x]);
+        if (depth == 0) {
+          match = {y, (int)x};
+          return true;
+        }
+      }
+    }
+    blockFirst = end;
+  }
+  return false;
+}
+
+bool StructureIndex::MatchBackward(const Buffer &buffer,
+                                   Buffer::Position from,
+                                   Buffer::Position &match, int budget) {
+  int depth = 0;
+  // Walking backwards, closers deepen and openers surface; a line's lowest
+  // point from its end is its minPrefix - delta
+  std::string_view line = buffer.GetLine(from.y);
+  for (int x = from.x; x >= 0; --x) {
+    depth -= BracketDelta(line[x]);
+    if (depth == 0) {
+      match = {from.y, x};
+      return true;
+    }
+  }
+
+  int y = from.y - 1;
+  if (y < 0)
+    return false;
+  int blockFirst;
+  size_t b = m_blocks.Locate(y, blockFirst);
+  for (;;) {
+    if (y == blockFirst + m_blocks[b].lines - 1) {
+      const Summary *s = Summarize(buffer, b, blockFirst, budget);
+      if (!s)
+        return false;
+      if (depth + s->minPrefix - s->delta > 0) {
+        depth -= s->delta;
+        y = blockFirst - 1;
+      }
+    }
+    for (; y >= blockFirst; --y) {
+      line = buffer.GetLine(y);
+      Summary s = Measure(line);
+      if (depth + s.minPrefix - s.delta > 0) {
+        depth -= s.delta;
+        continue;
+      }
+      for (int x = (int)line.size() - 1; x >= 0; --x) {
+        depth -= BracketDelta(line[x]);
+        if (depth == 0) {
+          match = {y, x};
+          return true;
+        }
+      }
+    }
+    if (b == 0)
+      return false;
+    blockFirst -= m_blocks[--b].lines;
+  }
+}
@@ -0,0 +1,245 @@
+/**
+ * @file table.cpp
+ * @brief Table implementation: delimiter detection, quote-aware splitting
+ * and the background width sampler.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/table.hpp"
+#include "../include/compression.hpp"
+#include "../include/constants.hpp"
+#include "../include/filetext.hpp"
+#include "../include/textutils.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+// Delimiters tried by Detect, preferred in this order on a tie
+const char DELIMITERS[] = {'\t', ',', ';', '|'};
+
+// Lines Detect looks at; nine in ten must split into the same columns
+const int DETECT_LINES = 64;
+
+// Sampling: rows read from the top of the file, then rows read at each
+// probe spread through the rest
+const int HEAD_ROWS = Edit::TABLE_SAMPLE_ROWS / 2;
+const int PROBE_ROWS = 8;
+const int PROBES = (Edit::TABLE_SAMPLE_ROWS - HEAD_ROWS) / PROBE_ROWS;
+
+// Widths are published after the head and after every this many probes
+const int PUBLISH_PROBES = 32;
+} // namespace
+
+Table::Table()
+    : m_delimiter(0), m_cancel(false),
+      m_published(std::make_shared<Widths>()) {}
+
+Table::~Table() { Cancel(); }
+
+void Table::Cancel() {
+  if (m_sampler.joinable()) {
+    m_cancel = true;
+    m_sampler.join();
+  }
+}
+
+void Table::Split(std::string_view line, char delimiter,
+                  std::vector<Field> &fields) {
+  fields.clear();
+  const char *data = line.data();
+  size_t n = line.size();
+  size_t i = 0;
+  for (;;) {
+    size_t start = i;
+    // A quoted field runs to its closing quote ("" is a literal quote),
+    // delimiters included; an unclosed one runs to the end of the line
+    if (i < n && data[i] == '"') {
+      for (++i; i < n; ++i) {
+        if (data[i] != '"')
+          continue;
+        if (i + 1 < n && data[i + 1] == '"')
+          ++i;
+        else {
+          ++i;
+          break;
+        }
+      }
+    }
+    const void *hit = i < n ? memchr(data + i, delimiter, n - i) : nullptr;
+    size_t end = hit ? (size_t)(static_cast<const char *>(hit) - data) : n;
+    fields.push_back({start, end});
+    if (!hit)
+      return;
+    i = end + 1;
+  }
+}
+
+size_t Table::NextField(std::string_view line, char delimiter, size_t x) {
+  std::vector<Field> fields;
+  Split(line, delimiter, fields);
+  for (const Field &f : fields) {
+    if (f.start > x)
+      return f.start;
+  }
+  return line.size();
+}
+
+size_t Table::PrevField(std::string_view line, char delimiter, size_t x) {
+  std::vector<Field> fields;
+  Split(line, delimiter, fields);
+  size_t start = 0;
+  for (const Field &f : fields) {
+    if (f.start >= x)
+      break;
+    start = f.start;
+  }
+  return start;
+}
+
+void Table::Widen(std::string_view line, char delimiter,
+                  const TextUtils::Kernels &text, std::vector<Field> &fields,
+                  Widths &widths) {
+  Split(line, delimiter, fields);
+  if (widths.size() < fields.size())
+    widths.resize(fields.size(), 0);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const Field &f = fields[i];
+    int width = text.VisualWidth(line.substr(f.start, f.end - f.start));
+    widths[i] = std::max(widths[i], std::min(width, Edit::TABLE_COLUMN_WIDTH));
+  }
+}
+
+char Table::Detect(const Buffer &buffer) {
+  std::vector<Field> fields;
+  std::vector<int> counts;
+  char best = 0;
+  int bestAgree = 0;
+  int bestColumns = 0;
+  for (char delimiter : DELIMITERS) {
+    counts.clear();
+    for (int y = 0; y < buffer.LineCount() && counts.size() < DETECT_LINES;
+         ++y) {
+      std::string_view line = buffer.GetLine(y);
+      if (line.empty())
+        continue;
+      Split(line, delimiter, fields);
+      counts.push_back((int)fields.size());
+    }
+    if (counts.empty())
+      return 0;
+
+    // The most common column count, and how many lines have it
+    std::sort(counts.begin(), counts.end());
+    int columns = 0, agree = 0;
+    for (size_t i = 0; i < counts.size();) {
+      size_t j = i;
+      while (j < counts.size() && counts[j] == counts[i])
+        ++j;
+      if ((int)(j - i) >= agree) {
+        agree = (int)(j - i);
+        columns = counts[i];
+      }
+      i = j;
+    }
+    if (columns < 2 || agree * 10 < (int)counts.size() * 9)
+      continue;
+    if (agree > bestAgree || (agree == bestAgree && columns > bestColumns)) {
+      best = delimiter;
+      bestAgree = agree;
+      bestColumns = columns;
+    }
+  }
+  return best;
+}
+
+bool Table::Suggested(const std::string &path) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  for (const char *packed : {".gz", ".zst"}) {
+    size_t len = strlen(packed);
+    if (name.size() > len && name.compare(name.size() - len, len, packed) == 0)
+      name.resize(name.size() - len);
+  }
+  size_t dot = name.find_last_of('.');
+  if (dot == std::string::npos || dot == 0)
+    return false;
+  std::string ext = name.substr(dot + 1);
+  for (char &c : ext)
+    c = (char)tolower((unsigned char)c);
+  return ext == "csv" || ext == "tsv" || ext == "tab" || ext == "psv";
+}
+
+const char *Table::Name(char delimiter) {
+  switch (delimiter) {
+  case '\t':
+    return "tab";
+  case ',':
+    return "comma";
+  case ';':
+    return "semicolon";
+  case '|':
+    return "pipe";
+  }
+  return "delimiter";
+}
+
+std::shared_ptr<const Table::Widths> Table::Published() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_published;
+}
+
+void Table::Publish(const Widths &widths) {
+  auto copy = std::make_shared<const Widths>(widths);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_published = std::move(copy);
+}
+
+void Table::Stop() {
+  Cancel();
+  m_delimiter = 0;
+  Publish({});
+}
+
+void Table::Start(const std::string &path, char delimiter,
+                  TextUtils::Encoding encoding) {
+  Stop();
+  m_delimiter = delimiter;
+  m_cancel = false;
+  if (path.empty() || Compression::Probe(path) != Compression::Format::None)
+    return;
+
+  m_sampler = std::thread([this, path, delimiter, encoding] {
+    // The file as saved; the buffer may be edited meanwhile and is not
+    // ours to read from this thread
+    FileText file(path);
+    if (file.Size() == 0)
+      return;
+
+    const TextUtils::Kernels &text = TextUtils::KernelsFor(encoding);
+    std::vector<Field> fields;
+    Widths widths;
+
+    // Measure up to rows lines from offset at; returns where it stopped
+    auto measure = [&](size_t at, int rows) {
+      for (int r = 0; r < rows && at < file.Size(); ++r)
+        Widen(file.Line(at), delimiter, text, fields, widths);
+      return at;
+    };
+
+    size_t head = measure(0, HEAD_ROWS);
+    Publish(widths);
+    if (head < file.Size()) {
+      // Probes land mid-line: start at the next full line
+      for (int p = 1; p <= PROBES && !m_cancel; ++p) {
+        size_t at = head + (file.Size() - head) / (PROBES + 1) * (size_t)p;
+        file.Line(at);
+        if (at >= file.Size())
+          break;
+        measure(at, PROBE_ROWS);
+        if (p % PUBLISH_PROBES == 0)
+          Publish(widths);
+      }
+      Publish(widths);
+    }
+  });
+}
@@ -0,0 +1,159 @@
+/**
+ * @file threadpool.cpp
+ * @brief ThreadPool implementation.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+// The pool whose WorkerLoop runs on this thread, if any
+thread_local const ThreadPool *t_pool = nullptr;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) : m_stopping(false) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    m_workers.emplace_back([this] { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_hasWork.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+ThreadPool &ThreadPool::Shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(task));
+  }
+  m_hasWork.notify_one();
+}
+
+void ThreadPool::WorkerLoop() {
+  t_pool = this;
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_hasWork.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+      if (m_queue.empty())
+        return; // Stopping and drained
+      task = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)> &fn) {
+  if (n == 0)
+    return;
+  // Nested in one of our own tasks: every worker may be a caller blocked
+  // like this one, so queued helpers would never run
+  if (n == 1 || m_workers.empty() || t_pool == this) {
+    for (size_t i = 0; i < n; ++i)
+      fn(i);
+    return;
+  }
+
+  // Shared between the helpers and the caller; helpers may outlive a throw
+  struct State {
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t running = 0; // Helpers inside drain
+    bool closed = false; // The caller is done; late helpers just return
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<State>();
+
+  auto drain = [state, n, &fn] {
+    for (;;) {
+      size_t i = state->next.fetch_add(1);
+      if (i >= n)
+        break;
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error)
+          state->error = std::current_exception();
+        state->next = n; // Stop handing out work
+      }
+    }
+  };
+
+  // A helper still queued when the caller has drained everything (the
+  // workers are busy elsewhere, e.g. with a long scan) is not waited for
+  size_t helpers = std::min(n - 1, m_workers.size());
+  for (size_t h = 0; h < helpers; ++h) {
+    Submit([state, drain] {
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->closed)
+          return;
+        state->running++;
+      }
+      drain();
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (--state->running == 0)
+        state->done.notify_all();
+    });
+  }
+
+  drain();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->closed = true;
+  state->done.wait(lock, [&] { return state->running == 0; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+ThreadPool *PoolFor(unsigned threads, std::unique_ptr<ThreadPool> &local) {
+  if (threads == 0)
+    return &ThreadPool::Shared();
+  if (threads == 1)
+    return nullptr;
+  local.reset(new ThreadPool(threads - 1));
+  return local.get();
+}
+
+ThreadPool *BackgroundPoolFor(unsigned threads,
+                              std::unique_ptr<ThreadPool> &local) {
+  if (threads == 0) {
+    local.reset(new ThreadPool());
+    return local.get();
+  }
+  return PoolFor(threads, local);
+}
+
+void ForEachChunk(ThreadPool *pool, size_t n,
+                  const std::function<void(size_t)> &fn) {
+  if (pool) {
+    pool->ParallelFor(n, fn);
+  } else {
+    for (size_t i = 0; i < n; ++i)
+      fn(i);
+  }
+}
@@ -0,0 +1,315 @@
+/**
+ * @file wordindex.cpp
+ * @brief WordIndex implementation: interning, background build, per-block
+ * maintenance and prefix suggestions.
+ * @author rahuldangeofficial
+ */
+
+#include "../include/wordindex.hpp"
+#include "../include/filetext.hpp"
+#include "../include/textutils.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Lines per block; an edit rescans the blocks it touched
+const int BLOCK_LINES = 1024;
+
+// Words shorter or longer than this are not worth completing
+const size_t MIN_WORD = 3;
+const size_t MAX_WORD = 64;
+
+// Arena chunk for interned word bytes
+const size_t ARENA_CHUNK = 64 * 1024;
+
+// New words are merged into the sorted array once this many pile up
+const size_t MERGE_AT = 1024;
+
+// Words no block holds any more are dropped from the arena once there are
+// at least this many and they outnumber the live ones
+const size_t MIN_RECLAIM = 4096;
+
+// Prefix matches examined per suggestion, however many there are
+const size_t MAX_CANDIDATES = 4096;
+
+/// Distinct ids of the completable words in the next `count` lines.
+template <typename Intern, typename NextLine>
+std::vector<uint32_t> BlockWords(int count, Intern intern, NextLine next) {
+  std::vector<uint32_t> ids;
+  for (int i = 0; i < count; ++i) {
+    std::string_view line = next();
+    TextUtils::ForEachWord(line, [&](size_t start, size_t length) {
+      if (length >= MIN_WORD && length <= MAX_WORD)
+        ids.push_back(intern(line.substr(start, length)));
+    });
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+} // namespace
+
+WordIndex::Index::Index() : blocks(BLOCK_LINES) {}
+
+uint32_t WordIndex::Index::Intern(std::string_view word) {
+  auto it = ids.find(word);
+  if (it != ids.end())
+    return it->second;
+  uint32_t id = Store(word, 0);
+  unsorted.push_back(id);
+  return id;
+}
+
+uint32_t WordIndex::Index::Store(std::string_view word, uint32_t refs) {
+  if (arena.empty() || arenaUsed + word.size() > ARENA_CHUNK) {
+    arena.emplace_back(new char[ARENA_CHUNK]);
+    arenaUsed = 0;
+  }
+  char *bytes = arena.back().get() + arenaUsed;
+  memcpy(bytes, word.data(), word.size());
+  arenaUsed += word.size();
+
+  uint32_t id = (uint32_t)entries.size();
+  std::string_view stored(bytes, word.size());
+  entries.push_back({stored, refs});
+  ids.emplace(stored, id);
+  return id;
+}
+
+void WordIndex::Index::AddBlock(Blocks::Block &block,
+                                std::vector<uint32_t> words) {
+  for (uint32_t id : words) {
+    if (entries[id].refs++ == 0)
+      live++;
+  }
+  block.data.words = std::move(words);
+  block.data.dirty = false;
+}
+
+void WordIndex::Index::DropBlock(Blocks::Block &block) {
+  for (uint32_t id : block.data.words) {
+    if (--entries[id].refs == 0)
+      live--;
+  }
+  block.data.words.clear();
+  block.data.dirty = true;
+}
+
+void WordIndex::Index::MergeNew() {
+  auto less = [this](uint32_t a, uint32_t b) {
+    return entries[a].word < entries[b].word;
+  };
+  std::sort(unsorted.begin(), unsorted.end(), less);
+  size_t middle = sorted.size();
+  sorted.insert(sorted.end(), unsorted.begin(), unsorted.end());
+  std::inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(),
+                     less);
+  unsorted.clear();
+
+  size_t dead = entries.size() - live;
+  if (dead >= MIN_RECLAIM && dead > live)
+    Compact();
+}
+
+void WordIndex::Index::Compact() {
+  // Runs after a merge, so every id is in sorted. New ids keep the old
+  // order, so each block's id list stays sorted
+  std::vector<uint32_t> remap(entries.size(), UINT32_MAX);
+  std::vector<Entry> old;
+  old.swap(entries);
+  std::vector<std::unique_ptr<char[]>> oldArena;
+  oldArena.swap(arena);
+  std::unordered_map<std::string_view, uint32_t>().swap(ids);
+  entries.reserve(live);
+  ids.reserve(live);
+  for (size_t id = 0; id < old.size(); ++id) {
+    if (old[id].refs > 0)
+      remap[id] = Store(old[id].word, old[id].refs);
+  }
+
+  size_t n = 0;
+  for (uint32_t id : sorted) {
+    if (remap[id] != UINT32_MAX)
+      sorted[n++] = remap[id];
+  }
+  sorted.resize(n);
+  for (Blocks::Block &block : blocks) {
+    for (uint32_t &id : block.data.words)
+      id = remap[id];
+  }
+}
+
+WordIndex::WordIndex() : m_ready(false), m_done(false), m_cancel(false) {}
+
+WordIndex::~WordIndex() { Cancel(); }
+
+void WordIndex::Cancel() {
+  if (m_builder.joinable()) {
+    m_cancel = true;
+    m_builder.join();
+  }
+}
+
+void WordIndex::Reset(const std::string &path, int lineCount,
+                      std::shared_ptr<const Buffer::TextPieces> inflated) {
+  Cancel();
+  m_index = Index();
+  m_ready = false;
+  m_built.reset();
+  m_pending.clear();
+  m_done = false;
+  m_cancel = false;
+
+  m_builder = std::thread([this, path, lineCount, inflated] {
+    // Read the file as Buffer::Load splits it; the buffer itself may be
+    // edited meanwhile and is not ours to read from this thread
+    std::unique_ptr<Index> index(new Index);
+    std::unique_ptr<FileText> file;
+    try {
+      file.reset(new FileText(path, inflated));
+    } catch (const std::exception &) {
+      m_done = true; // Damaged: its lines cannot match the buffer's
+      return;
+    }
+    size_t pos = 0;
+    int lines = 0;
+    auto next = [&]() {
+      lines++;
+      return file->Line(pos); // Past the end: the empty line of a new file
+    };
+    auto intern = [&](std::string_view w) { return index->Intern(w); };
+    index->blocks.Reset(lineCount);
+    for (Blocks::Block &block : index->blocks) {
+      if (m_cancel)
+        break;
+      index->AddBlock(block, BlockWords(block.lines, intern, next));
+    }
+    index->MergeNew();
+
+    // Changed since the buffer read it: wait for the reload's Reset
+    if (!m_cancel && lines == lineCount && pos >= file->Size())
+      m_built = std::move(index);
+    m_done = true;
+  });
+}
+
+void WordIndex::Edited(const Buffer &buffer, const Buffer::LineEdit &edit) {
+  if (!m_ready) {
+    // Replayed once the build is adopted
+    if (m_builder.joinable()) {
+      m_pending.push_back(edit);
+      Ready(buffer);
+    }
+    return;
+  }
+  Apply(edit);
+  Refresh(buffer);
+}
+
+std::vector<std::string> WordIndex::Suggest(const Buffer &buffer,
+                                            std::string_view prefix,
+                                            size_t limit) {
+  std::vector<std::string> words;
+  if (!Ready(buffer) || prefix.empty())
+    return words;
+
+  Index &ix = m_index;
+  if (ix.unsorted.size() > MERGE_AT)
+    ix.MergeNew();
+
+  std::vector<uint32_t> found;
+  auto consider = [&](uint32_t id) {
+    const Entry &e = ix.entries[id];
+    if (e.refs > 0 && e.word.size() > prefix.size() &&
+        e.word.compare(0, prefix.size(), prefix) == 0)
+      found.push_back(id);
+  };
+  auto it = std::lower_bound(
+      ix.sorted.begin(), ix.sorted.end(), prefix,
+      [&](uint32_t id, std::string_view p) { return ix.entries[id].word < p; });
+  for (size_t n = 0; it != ix.sorted.end() && n < MAX_CANDIDATES; ++it, ++n) {
+    if (ix.entries[*it].word.compare(0, prefix.size(), prefix) != 0)
+      break;
+    consider(*it);
+  }
+  for (uint32_t id : ix.unsorted)
+    consider(id);
+
+  // Most used first, alphabetical among equals
+  limit = std::min(limit, found.size());
+  std::partial_sort(found.begin(), found.begin() + limit, found.end(),
+                    [&](uint32_t a, uint32_t b) {
+                      const Entry &x = ix.entries[a], &y = ix.entries[b];
+                      return x.refs != y.refs ? x.refs > y.refs
+                                              : x.word < y.word;
+                    });
+  for (size_t i = 0; i < limit; ++i)
+    words.emplace_back(ix.entries[found[i]].word);
+  return words;
+}
+
+size_t WordIndex::MemoryBytes() const {
+  if (!m_ready)
+    return 0;
+  const Index &ix = m_index;
+  // Map nodes hold the key, the id, a next pointer and the cached hash
+  size_t node = sizeof(std::pair<const std::string_view, uint32_t>) +
+                2 * sizeof(void *);
+  size_t bytes = ix.arena.size() * ARENA_CHUNK +
+                 ix.arena.capacity() * sizeof(ix.arena[0]) +
+                 ix.entries.capacity() * sizeof(Entry) +
+                 ix.ids.bucket_count() * sizeof(void *) +
+                 ix.ids.size() * node +
+                 (ix.sorted.capacity() + ix.unsorted.capacity()) *
+                     sizeof(uint32_t) +
+                 ix.blocks.MemoryBytes();
+  for (const Blocks::Block &block : ix.blocks)
+    bytes += block.data.words.capacity() * sizeof(uint32_t);
+  return bytes;
+}
+
+bool WordIndex::Ready(const Buffer &buffer) {
+  if (m_ready)
+    return true;
+  if (!m_builder.joinable() || !m_done)
+    return false;
+
+  m_builder.join();
+  if (!m_built)
+    return false; // The file changed underneath; the next Reset retries
+  m_index = std::move(*m_built);
+  m_built.reset();
+  m_ready = true;
+  for (const Buffer::LineEdit &edit : m_pending)
+    Apply(edit);
+  m_pending.clear();
+  Refresh(buffer);
+  return m_ready;
+}
+
+void WordIndex::Apply(const Buffer::LineEdit &edit) {
+  Index &ix = m_index;
+  ix.blocks.Edited(edit, [&](Blocks::Block &block) { ix.DropBlock(block); });
+}
+
+void WordIndex::Refresh(const Buffer &buffer) {
+  Index &ix = m_index;
+  if (ix.blocks.LineCount() != buffer.LineCount()) {
+    // A change that never reached Edited: stop suggesting stale words
+    m_index = Index();
+    m_ready = false;
+    return;
+  }
+
+  auto intern = [&](std::string_view w) { return ix.Intern(w); };
+  for (size_t b = 0; b < ix.blocks.Size(); ++b) {
+    Blocks::Block &block = ix.blocks[b];
+    if (!block.data.dirty)
+      continue;
+    int y = ix.blocks.First(b);
+    auto next = [&]() { return buffer.GetLine(y++); };
+    ix.AddBlock(block, BlockWords(block.lines, intern, next));
+  }
+  if (ix.unsorted.size() > MERGE_AT)
+    ix.MergeNew();
+}